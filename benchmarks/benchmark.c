@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "requests.h"
+#include "loopback_server.h"
+
+/*
+Measure the effect of the TCP options of a config on loopback, against the small HTTP/1.1 server of tools/.
+The server keeps Nagle's algorithm and writes the headers and the body of its responses separately, like many servers do.
+Usage: ./benchmark [number of small requests]
+*/
+
+#define BULK_SIZE (256 * 1024 * 1024)
+#define POST_SIZE (200 * 1000)
+#define SEND_CHUNK (256 * 1024)
+
+static uint16_t server_port = 0;
+
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+/*
+Serve the requests of CONNECTION until it's closed: "/bulk" gets BULK_SIZE bytes, the other requests get a 5 bytes body.
+The headers and the body of the responses are sent separately.
+*/
+static void serve(LoopbackConnection* connection)
+{
+    static const char chunk[SEND_CHUNK];
+    char path[64];
+
+    while(loopback_read_request(connection, path, sizeof(path)))
+    {
+        if(strcmp(path, "/bulk") == 0)
+        {
+            char headers[128];
+            size_t left = BULK_SIZE;
+            snprintf(headers, sizeof(headers), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n", BULK_SIZE);
+            if(!loopback_send_all(connection->fd, headers, strlen(headers)))
+            {
+                return;
+            }
+            while(left > 0)
+            {
+                size_t n = left < SEND_CHUNK ? left : SEND_CHUNK;
+                if(!loopback_send_all(connection->fd, chunk, n))
+                {
+                    return;
+                }
+                left -= n;
+            }
+        }
+        else
+        {
+            const char* response_headers = "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\n";
+            if(!loopback_send_all(connection->fd, response_headers, strlen(response_headers)) || !loopback_send_all(connection->fd, "hello", 5))
+            {
+                return;
+            }
+        }
+    }
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/*
+Send NB_REQUESTS requests with CONFIG on a keep-alive connection and print their median and 99th percentile latency.
+*/
+static void bench_latency(const char* name, RequestsConfig* config, const char* method, const char* data, size_t nb_requests)
+{
+    char url[64];
+    char buffer[64];
+    double* latencies = malloc(nb_requests * sizeof(double));
+    RequestsPool* pool = req_pool_init(1);
+    size_t failures = 0;
+
+    if(latencies == NULL || pool == NULL)
+    {
+        free(latencies);
+        req_pool_free(&pool);
+        return;
+    }
+    req_config_set_pool(config, pool);
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/small", server_port);
+
+    for(size_t i = 0; i < nb_requests; i++)
+    {
+        double start = now_us();
+        RequestsHandler* handler = req_request(config, NULL, method, url, data, "");
+        while(handler != NULL && req_read_output_body(handler, buffer, sizeof(buffer)) > 0)
+        {
+            ;
+        }
+        latencies[i] = now_us() - start;
+        if(handler == NULL)
+        {
+            failures++;
+        }
+        req_close_connection(&handler);
+    }
+
+    qsort(latencies, nb_requests, sizeof(double), compare_doubles);
+    printf("%-34s p50 %9.1f us   p99 %9.1f us   failures %zu\n", name, latencies[nb_requests / 2], latencies[nb_requests * 99 / 100], failures);
+
+    req_config_set_pool(config, NULL);
+    req_pool_free(&pool);
+    free(latencies);
+}
+
+/*
+Download BULK_SIZE bytes with CONFIG and print the throughput.
+*/
+static void bench_throughput(const char* name, RequestsConfig* config)
+{
+    static char buffer[256 * 1024];
+    char url[64];
+    size_t total = 0;
+    size_t n;
+    double start = now_us();
+    RequestsHandler* handler;
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/bulk", server_port);
+    handler = req_get(config, NULL, url, "");
+    while(handler != NULL && (n = req_read_output_body(handler, buffer, sizeof(buffer))) > 0)
+    {
+        total += n;
+    }
+    req_close_connection(&handler);
+    printf("%-34s %9.1f MB/s   (%zu bytes)\n", name, (double)total / (now_us() - start), total);
+}
+
+int main(int argc, char** argv)
+{
+    size_t nb_requests = argc > 1 ? strtoul(argv[1], NULL, 10) : 200;
+    size_t nb_posts;
+    char* post_data = malloc(POST_SIZE + 1);
+    RequestsConfig* config;
+
+    server_port = loopback_server_start(serve);
+    if(nb_requests == 0 || post_data == NULL || server_port == 0)
+    {
+        fprintf(stderr, "usage: %s [number of small requests]\n", argv[0]);
+        free(post_data);
+        return 1;
+    }
+    memset(post_data, 'a', POST_SIZE);
+    post_data[POST_SIZE] = '\0';
+    nb_posts = nb_requests >= 10 ? nb_requests / 10 : 1;  // the big POSTs are slower, but at least one is needed for the percentiles
+
+    req_init();
+    config = req_config_default();
+
+    printf("Small GET, %zu requests on a keep-alive connection\n", nb_requests);
+    req_config_set_tcp_nodelay(config, false);
+    bench_latency("  Nagle", config, "GET ", "", nb_requests);
+    req_config_set_tcp_nodelay(config, true);
+    bench_latency("  TCP_NODELAY (default)", config, "GET ", "", nb_requests);
+    req_config_set_tcp_quickack(config, true);
+    bench_latency("  TCP_NODELAY + TCP_QUICKACK", config, "GET ", "", nb_requests);
+    req_config_set_busy_poll(config, 50);
+    bench_latency("  + SO_BUSY_POLL 50 us", config, "GET ", "", nb_requests);
+    req_config_set_busy_poll(config, 0);
+
+    // TCP_QUICKACK stays on, so only the way the client sends the body differs
+    printf("POST of %d bytes, %zu requests, with TCP_QUICKACK\n", POST_SIZE, nb_posts);
+    req_config_set_tcp_nodelay(config, false);
+    bench_latency("  Nagle", config, "POST ", post_data, nb_posts);
+    req_config_set_tcp_nodelay(config, true);
+    bench_latency("  TCP_NODELAY (default)", config, "POST ", post_data, nb_posts);
+    req_config_set_tcp_quickack(config, false);
+
+    printf("Download of %d MB\n", BULK_SIZE / (1024 * 1024));
+    bench_throughput("  buffers tuned by the kernel", config);
+    req_config_set_socket_buffers(config, 64 * 1024, 64 * 1024);
+    bench_throughput("  64 KB buffers", config);
+    req_config_set_socket_buffers(config, 4 * 1024 * 1024, 4 * 1024 * 1024);
+    bench_throughput("  4 MB buffers", config);
+    req_config_set_receive_buffer_size(config, 256 * 1024);
+    bench_throughput("  4 MB buffers, 256 KB reads", config);
+
+    req_config_free(&config);
+    req_destroy();
+    free(post_data);
+    return 0;
+}
@@ -0,0 +1,16 @@
+import powermake
+
+
+def on_build(config: powermake.Config):
+    files = powermake.get_files("../requests/**/*.c", "../tools/*.c", "*.c")
+
+    config.add_includedirs("../requests", "../tools")
+    config.add_shared_libs("ssl", "crypto", "pthread")
+    config.set_optimization("-O3")
+
+    objects = powermake.compile_files(config, files)
+
+    powermake.link_files(config, objects)
+
+
+powermake.run("benchmark", build_callback=on_build)
@@ -1,18 +1,91 @@
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "requests.h"
 
-void _rh_fuzzer_set_data(const uint8_t* data, size_t size);
+/*
+The response is read from the fuzzer input through an in-memory transport, so the real sockets of the library are linked but never used.
+*/
 
+typedef struct _fuzz_input {
+    const uint8_t* data;
+    size_t size;
+} FuzzInput;
+
+static RequestsConfig* config = NULL;
+static FuzzInput input;
+
+
+static void* fuzz_connect(const char* host, uint16_t port, bool secured, req_milliseconds max_connect_time, void* user_data)
+{
+    (void)host;
+    (void)port;
+    (void)secured;
+    (void)max_connect_time;
+    return user_data;
+}
+
+static ptrdiff_t fuzz_send(void* connection, const char* buffer, size_t n)
+{
+    (void)connection;
+    (void)buffer;
+    return (ptrdiff_t)n;
+}
+
+/*
+Give the next bytes of the input, the stream ends with the input.
+*/
+static ptrdiff_t fuzz_recv(void* connection, char* buffer, size_t n)
+{
+    FuzzInput* fuzz_input = (FuzzInput*)connection;
+    if(n > fuzz_input->size)
+    {
+        n = fuzz_input->size;
+    }
+    memcpy(buffer, fuzz_input->data, n);
+    fuzz_input->data += n;
+    fuzz_input->size -= n;
+    return (ptrdiff_t)n;
+}
+
+static void fuzz_close(void* connection)
+{
+    (void)connection;
+}
+
+int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    RequestsTransport transport = {
+        .connect = fuzz_connect,
+        .send = fuzz_send,
+        .recv = fuzz_recv,
+        .is_alive = NULL,
+        .close = fuzz_close,
+        .user_data = &input
+    };
+
+    req_init();
+    config = req_config_default();
+    if(config == NULL || !req_config_set_transport(config, &transport))
+    {
+        abort();
+    }
+    return 0;
+}
 
 int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
 {
-    _rh_fuzzer_set_data(data, size);
+    input.data = data;
+    input.size = size;
 
     RequestsHandler* handler = NULL;
     char buffer[1024];
 
-    handler = req_get(NULL, handler, "http://foo.bar/", "");
+    handler = req_get(config, handler, "http://foo.bar/", "");
 
     if(handler == NULL)
     {
@@ -4,7 +4,7 @@ import powermake.linkers
 
 
 def on_build(config: powermake.Config):
-    files = powermake.filter_files(powermake.get_files("../requests/**/*.c", "*.c"), "**/easy_tcp_tls.c")
+    files = powermake.get_files("../requests/**/*.c", "*.c")
 
     config.c_compiler = powermake.compilers.CompilerClang()
     config.linker = powermake.linkers.LinkerClang()
@@ -14,6 +14,7 @@ def on_build(config: powermake.Config):
 
     config.add_flags("-ffuzzer", "-fsecurity")
     config.add_includedirs("../requests")
+    config.add_shared_libs("ssl", "crypto", "pthread")
     config.set_optimization("-O0")
 
     objects = powermake.compile_files(config, files)
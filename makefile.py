@@ -1,3 +1,4 @@
+import os
 import powermake
 import typing as T
 
@@ -11,10 +12,14 @@ def on_build(config: powermake.Config):
         config.remove_flags("-fanalyzer")  # for some reason, -fanalyzer under MinGW is full of false positive.
 
     if config.target_is_windows():
-        config.add_shared_libs("ssl", "crypto", "crypt32", "ws2_32")
+        config.add_shared_libs("ssl", "crypto", "crypt32", "ws2_32", "pthread")
         config.add_ld_flags("-static")
     else:
-        config.add_shared_libs("ssl", "crypto")
+        config.add_shared_libs("ssl", "crypto", "pthread")
+
+    if config.target_is_linux() and os.environ.get("REQUESTS_IO_URING") == "1":
+        # the io_uring transport can then be enabled with req_config_set_io_uring
+        config.add_defines("RH_USE_IO_URING")
 
     files = powermake.get_files("requests/**/*.c", "test.c")
 
@@ -29,6 +34,8 @@ def on_build(config: powermake.Config):
 
 def on_install(config: powermake.Config, location: T.Union[str, None]):
     config.add_exported_headers("requests/requests.h", subfolder="requests")
+    config.add_exported_headers("requests/requests.hpp", subfolder="requests")
+    config.add_exported_headers("requests/requests_coro.hpp", subfolder="requests")
 
     powermake.default_on_install(config, location)
 
@@ -1,39 +1,223 @@
 #include <assert.h>
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include "requests_helper/strings/strings.h"
 #include "requests_helper/network/easy_tcp_tls.h"
 #include "requests_helper/parsing/parsing.h"
-#include "requests_helper/path/path.h"
+#include "requests_helper/pool/pool.h"
+#include "requests_helper/cache/cache.h"
+#include "requests_helper/time/timer.h"
 #include "requests.h"
 
-#define HEADERS_LENGTH   300  /* this is exact, don't change */
+#define NB_DEFAULT_HEADERS 5
 
-#define PARSER_BUFFER_SIZE 1024
+
+#define DEFAULT_RECEIVE_BUFFER_SIZE 16384
+#define MIN_RECEIVE_BUFFER_SIZE 1024
+#define DEFAULT_MAX_HEADERS_SIZE (256 * 1024)
+#define DEFAULT_MAX_URL_LENGTH (64 * 1024)
+
+#define DEFAULT_MAX_REDIRECTS 10
+#define DEFAULT_EXPECT_CONTINUE_TIMEOUT 1000
+#define EXPECT_CONTINUE_LINE "Expect: 100-continue\r\n"
+#define REDIRECT_CACHE_SIZE 16
+
+#define MIN_HTTP_STATUS 100
+#define MAX_HTTP_STATUS 599
+#define MILLI_TOKENS 1000  /* the retry budget is counted in thousandths of retries */
+
+#define KEEP_ALIVE_MARGIN_MS 1000  /* the connection is dropped this long before the keep-alive timeout of the server, at most a quarter of it */
+
+#define ORIGIN_MAX_LENGTH (sizeof("http+unix://") - 1 + RH_MAX_CHAR_ON_HOST + sizeof(":65535"))
+#define WARM_CHECK_INTERVAL_MS 1000  /* how often the idle connections of the warm origins are checked, and how long a failed origin waits before a new attempt */
+#define MAX_WARMERS 32  /* the maximum number of connections opened at the same time to keep the origins of a pool warm */
+
+typedef enum _async_state {
+    ASYNC_NONE,  /* not started by req_request_start, or its headers are parsed */
+    ASYNC_CONNECTING,
+    ASYNC_SENDING,
+    ASYNC_RECEIVING,
+    ASYNC_FAILED
+} AsyncState;
 
 struct _requests_handler {
-    rh_SocketHandler* handler;
+    void* connection;  /* returned by transport.connect, NULL if there is none */
+    RequestsTransport transport;
+    rh_SocketOptions socket_options;  /* used to open the connection with the default transport */
+    RequestsPool* pool;
     rh_ParserTree* headers_tree;
-    char* reading_residue;
-    size_t bytes_read;
-    size_t residue_size;
-    size_t residue_offset;
-    ssize_t total_bytes;
+    char* receive_buffer;  /* kept for the whole life of the connection, allocated on the first read */
+    size_t receive_capacity;
+    size_t receive_start;  /* the bytes received but not consumed yet are between receive_start and receive_end */
+    size_t receive_end;
+    size_t max_headers_size;  /* the receive buffer can grow up to this size to hold a header line */
+    size_t bytes_read;  /* the bytes of the body given to the caller */
+    ssize_t total_bytes;  /* the size of the body, or of the current chunk */
+    size_t body_position;  /* the bytes of the body, or of the current chunk, consumed from the connection */
     uint16_t port;
     unsigned short int status_code;
     char host[RH_MAX_CHAR_ON_HOST + 1];
     bool read_finished;
+    bool read_failed;
     bool chunked;
     bool secured;
-    char keep_alive_read;
+    bool reusable;
+    char chunk_length[32];
+    int chunk_length_index;
+    rh_CacheEntry* body_entry;  /* if not NULL, its body is read before the rest of the response */
+    size_t body_offset;
+    rh_nanoseconds idle_deadline;  /* when the server will close the idle connection, according to its Keep-Alive header */
+    size_t remaining_requests;  /* how many more requests the server accepts on this connection */
+    AsyncState async_state;
+    char* pending_request;  /* the request sent by the non-blocking functions, kept until the response starts in case it must be sent again */
+    size_t pending_length;
+    size_t pending_sent;
+    bool pending_reused;  /* the request is sent on a connection that was already used */
+    bool pending_head;
+    bool nonblocking;
+    rh_SocketProgress waiting;  /* set when a non-blocking reception would have blocked */
+    bool awaiting_continue;  /* the body is held back until the server answers, so the interim responses are returned instead of skipped */
 };
 
 
+typedef enum _failure {
+    FAILURE_OTHER,
+    FAILURE_NOT_SENT,  /* the connection couldn't be established or the request couldn't be written */
+    FAILURE_NO_RESPONSE  /* the request was sent, but no response was received */
+} Failure;
+
+typedef struct _retry_policy {
+    unsigned int max_attempts;
+    rh_milliseconds base_backoff;
+    rh_milliseconds max_backoff;
+    uint64_t retry_statuses[(MAX_HTTP_STATUS - MIN_HTTP_STATUS) / 64 + 1];  /* bitmap */
+    bool retry_connection_errors;
+    bool retry_network_errors;
+    bool retry_non_idempotent;
+    size_t budget_deposit;  /* milli-tokens earned by each request that isn't retried */
+    size_t budget_max;  /* in milli-tokens */
+} RetryPolicy;
+
+typedef struct _permanent_redirect {
+    char* from;
+    char* to;
+    bool keep_method;  /* 308 keeps the method and the body, 301 is only used for GET and HEAD */
+} PermanentRedirect;
+
 struct _requests_config {
     rh_milliseconds max_connect_time;
+    RequestsPool* pool;
+    RequestsCache* cache;
+    RequestsSingleFlight* single_flight;
+    size_t receive_buffer_size;
+    size_t max_headers_size;
+    size_t max_url_length;
+    size_t max_redirects;
+    bool io_uring;  /* the new connections receive through io_uring */
+    size_t expect_continue_size;  /* the bodies of at least this size wait for a 100 Continue response, 0 if none does */
+    rh_milliseconds expect_continue_timeout;  /* how long a body waits for the answer of the server before it's sent anyway */
+    RequestsTransport transport;
+    rh_SocketOptions socket_options;
+    RetryPolicy retry;
+    size_t retry_budget;  /* in milli-tokens, each retry costs MILLI_TOKENS */
+    pthread_mutex_t redirects_lock;
+    PermanentRedirect redirects[REDIRECT_CACHE_SIZE];
+    size_t next_redirect;
+};
+
+typedef struct _warm_origin {
+    char origin[ORIGIN_MAX_LENGTH];
+    char host[RH_MAX_CHAR_ON_HOST + 1];
+    uint16_t port;
+    bool secured;
+    size_t min_idle;
+    size_t opening;  /* the connections being opened for this origin */
+    rh_nanoseconds retry_after;  /* set when a connection couldn't be opened, so a dead origin isn't hammered */
+    RequestsConfig* config;  /* a copy of the config given to req_pool_prewarm, using the pool */
+    struct _warm_origin* next;
+} WarmOrigin;
+
+struct _requests_pool {
+    rh_ConnectionPool* idle_connections;
+    size_t max_idle_per_origin;
+    pthread_mutex_t warm_lock;  /* protects the fields below */
+    pthread_cond_t warm_cond;  /* signaled when a connection was taken from the pool, when a warmer is done and when the pool is freed */
+    WarmOrigin* warm_origins;
+    size_t nb_warmers;  /* the threads opening a connection */
+    bool keeper_started;
+    bool closing;
+    pthread_t keeper;
+};
+
+typedef struct _warm_job {
+    RequestsPool* pool;
+    WarmOrigin* warm_origin;
+    RequestsConfig* config;  /* the origin's config may be replaced while the connection is opened */
+} WarmJob;
+
+struct _requests_cache {
+    rh_ResponseCache* responses;
+};
+
+typedef struct _flight {
+    char* key;
+    pthread_cond_t finished_cond;
+    bool finished;
+    rh_CacheEntry* response;  /* NULL if the leader couldn't read the whole response */
+    size_t references;  /* the leader and the waiters */
+    struct _flight* next;
+} Flight;
+
+struct _requests_single_flight {
+    pthread_mutex_t lock;  /* protects the flights and their content */
+    Flight* flights;
+    size_t max_body_size;
+    rh_milliseconds max_wait_time;  /* how long an identical request waits for the shared response before it's sent on its own */
+};
+
+struct _requests_headers {
+    char* block;  /* the default headers that are not overridden, the additional headers and the empty line that ends the headers */
+    size_t block_length;
+};
+
+struct _requests_template {
+    RequestsConfig* config;
+    RequestsHeaders* headers;
+    char* request_line_start;  /* the method and the uri of the base url */
+    size_t request_line_start_length;
+    char* host_line;  /* the end of the request line, the host and the name of the content-length header */
+    size_t host_line_length;
+    char host[RH_MAX_CHAR_ON_HOST + 1];
+    uint16_t port;
+    bool secured;
+    bool is_head;
+    bool empty_base_uri;
+};
+
+typedef struct _default_header {
+    const char* name;
+    const char* line;
+} DefaultHeader;
+
+static const unsigned short int default_retry_statuses[] = {429, 502, 503, 504};
+
+static _Thread_local Failure last_failure = FAILURE_OTHER;  /* why the last exchange of this thread failed */
+static _Thread_local uint64_t jitter_state = 0;
+
+static const DefaultHeader default_headers[NB_DEFAULT_HEADERS] = {
+    {"content-type", "Content-Type: application/x-www-form-urlencoded\r\n"},
+    {"accept", "Accept: */*\r\n"},
+    {"user-agent", "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/51.0.2704.103 Safari/537.36\r\n"},
+    {"connection", "Connection: keep-alive\r\n"},
+    {"accept-encoding", "Accept-Encoding: identity\r\n"}
 };
 
 static inline size_t min_size_t(size_t a, size_t b)
@@ -41,10 +225,112 @@ static inline size_t min_size_t(size_t a, size_t b)
     return a < b ? a: b;
 }
 
-static bool req_parse_headers(RequestsHandler* handler);
+/*
+Parse the number at the start of STR, ignoring what follows, like the "5" of "5, max=100".
+*/
+static uint64_t leading_uint64(const char* str)
+{
+    uint64_t value = 0;
+    while(RH_CHAR_IS_DIGIT(*str) && value <= (UINT64_MAX - 9) / 10)
+    {
+        value = value * 10 + (uint64_t)(*str - '0');
+        str++;
+    }
+    return value;
+}
+
+static bool req_parse_headers(RequestsHandler* handler, bool* received);
 static ssize_t req_read_output(RequestsHandler* handler, char* buffer, size_t n);
-static bool send_headers(RequestsHandler* handler, char* headers);
+static ssize_t fill_receive_buffer(RequestsHandler* handler, size_t max_capacity);
+static size_t next_body_slice(RequestsHandler* handler, const char** data);
+static bool send_headers(RequestsHandler* handler, const char* headers, size_t headers_length);
+static RequestsHandler* send_request(RequestsConfig* config, RequestsHandler* handler, const char* method, const char* url, const char* data, size_t data_length, const RequestsHeaders* prepared_headers);
 static bool connect_socket(RequestsHandler* handler, RequestsConfig* config);
+static void close_transport(RequestsHandler* handler);
+static void destroy_handler(RequestsHandler* handler);
+static RequestsHandler* new_handler(const RequestsConfig* config, const char* host, uint16_t port, bool secured);
+static void build_origin(char* origin, const char* host, uint16_t port, bool secured);
+static bool parse_url(const RequestsConfig* config, const char* url, rh_UrlSplitted* url_splitted);
+static bool idle_connection_usable(RequestsHandler* handler);
+static bool should_retry(RequestsConfig* config, const char* method, RequestsHandler* handler, unsigned int attempt, rh_milliseconds* delay);
+
+
+/*
+Connect to the unix socket whose urlencoded path is HOST, the host of a http+unix url.
+*/
+static rh_SocketHandler* connect_unix_socket(const char* host, req_milliseconds max_connect_time)
+{
+    char path[RH_MAX_CHAR_ON_HOST + 1];
+    rh_urldecode(path, host);
+    return rh_socket_unix_client_init(path, max_connect_time);
+}
+
+static rh_SocketHandler* open_socket(const char* host, uint16_t port, bool secured, req_milliseconds max_connect_time, const rh_SocketOptions* options)
+{
+    if(port == RH_UNIX_SOCKET_PORT)
+    {
+        return connect_unix_socket(host, max_connect_time);
+    }
+    if(secured)
+    {
+        return rh_socket_ssl_client_init(host, port, max_connect_time, options);
+    }
+    return rh_socket_client_init(host, port, max_connect_time, options);
+}
+
+static void* socket_connect(const char* host, uint16_t port, bool secured, req_milliseconds max_connect_time, void* user_data)
+{
+    (void)user_data;
+    return open_socket(host, port, secured, max_connect_time, NULL);
+}
+
+static ptrdiff_t socket_send(void* connection, const char* buffer, size_t n)
+{
+    return rh_socket_send((rh_SocketHandler*)connection, buffer, n);
+}
+
+static ptrdiff_t socket_recv(void* connection, char* buffer, size_t n)
+{
+    return rh_socket_recv((rh_SocketHandler*)connection, buffer, n);
+}
+
+static bool socket_is_alive(void* connection)
+{
+    return rh_socket_is_alive((rh_SocketHandler*)connection);
+}
+
+static void socket_close(void* connection)
+{
+    rh_SocketHandler* s = (rh_SocketHandler*)connection;
+    rh_socket_close(&s);
+}
+
+/* The TCP and TLS sockets of easy_tcp_tls.c, used unless req_config_set_transport is called */
+static const RequestsTransport SOCKET_TRANSPORT = {
+    .connect = socket_connect,
+    .send = socket_send,
+    .recv = socket_recv,
+    .is_alive = socket_is_alive,
+    .close = socket_close,
+    .user_data = NULL
+};
+
+/*
+Returns true if the connections of TRANSPORT are rh_SocketHandler, which the non-blocking functions and io_uring need.
+*/
+static inline bool uses_sockets(const RequestsTransport* transport)
+{
+    return transport->connect == socket_connect;
+}
+
+/*
+Returns true if the connection of HANDLER was opened by the transport of CONFIG, so it can be used for the requests of CONFIG.
+*/
+static bool same_transport(const RequestsHandler* handler, const RequestsConfig* config)
+{
+    const RequestsTransport* transport = config != NULL ? &(config->transport) : &SOCKET_TRANSPORT;
+    return handler->transport.connect == transport->connect && handler->transport.user_data == transport->user_data;
+}
 
 
 void req_init()
@@ -66,11 +352,74 @@ RequestsConfig* req_config_default()
         return config;
     }
 
+    if(pthread_mutex_init(&(config->redirects_lock), NULL) != 0)
+    {
+        free(config);
+        return NULL;
+    }
+
     config->max_connect_time = 5000;
+    config->pool = NULL;
+    config->cache = NULL;
+    config->single_flight = NULL;
+    config->max_redirects = DEFAULT_MAX_REDIRECTS;
+    config->receive_buffer_size = DEFAULT_RECEIVE_BUFFER_SIZE;
+    config->max_headers_size = DEFAULT_MAX_HEADERS_SIZE;
+    config->max_url_length = DEFAULT_MAX_URL_LENGTH;
+    config->io_uring = false;
+    config->expect_continue_size = 0;
+    config->expect_continue_timeout = DEFAULT_EXPECT_CONTINUE_TIMEOUT;
+    config->transport = SOCKET_TRANSPORT;
+    memset(&(config->socket_options), 0, sizeof(rh_SocketOptions));
+    config->socket_options.no_delay = true;
+    memset(&(config->retry), 0, sizeof(RetryPolicy));
+    config->retry.max_attempts = 1;
+    config->retry_budget = 0;
+    config->next_redirect = 0;
+    memset(config->redirects, 0, sizeof(config->redirects));
 
     return config;
 }
 
+RequestsConfig* req_config_copy(const RequestsConfig* config)
+{
+    RequestsConfig* copy = malloc(sizeof(RequestsConfig));
+    if(copy == NULL)
+    {
+        return copy;
+    }
+
+    *copy = *config;
+
+    // The cache of permanent redirects is not shared
+    if(pthread_mutex_init(&(copy->redirects_lock), NULL) != 0)
+    {
+        free(copy);
+        return NULL;
+    }
+    copy->next_redirect = 0;
+    memset(copy->redirects, 0, sizeof(copy->redirects));
+    copy->retry_budget = copy->retry.budget_max;
+
+    return copy;
+}
+
+void req_config_free(RequestsConfig** config)
+{
+    if(*config == NULL)
+    {
+        return;
+    }
+    for(size_t i = 0; i < REDIRECT_CACHE_SIZE; i++)
+    {
+        free((*config)->redirects[i].from);
+        free((*config)->redirects[i].to);
+    }
+    pthread_mutex_destroy(&((*config)->redirects_lock));
+    free(*config);
+    *config = NULL;
+}
+
 bool req_config_set_max_connect_time(RequestsConfig* config, req_milliseconds max_connect_time)
 {
     if(config == NULL)
@@ -82,522 +431,3272 @@ bool req_config_set_max_connect_time(RequestsConfig* config, req_milliseconds ma
 }
 
 
-size_t req_nb_bytes_read(RequestsHandler* handler)
+bool req_config_set_max_redirects(RequestsConfig* config, size_t max_redirects)
 {
-    return handler->bytes_read;
+    if(config == NULL)
+    {
+        return false;
+    }
+    config->max_redirects = max_redirects;
+    return true;
 }
 
-/*
-This is not meant to be used directly, unless you have exotic HTTP methods.
-*/
-RequestsHandler* req_request(RequestsConfig* config, RequestsHandler* handler, const char* method, const char* url, const char* data, const char* additional_headers)
+bool req_config_set_receive_buffer_size(RequestsConfig* config, size_t size)
 {
-    rh_UrlSplitted url_splitted;
-    char content_length[30];
-    char* headers = NULL;
-
+    if(config == NULL || size < MIN_RECEIVE_BUFFER_SIZE)
+    {
+        return false;
+    }
+    config->receive_buffer_size = size;
+    return true;
+}
 
-    if(!rh_parse_url(url, &url_splitted))
+bool req_config_set_max_headers_size(RequestsConfig* config, size_t max_headers_size)
+{
+    if(config == NULL || max_headers_size == 0)
     {
-        goto ERROR;
+        return false;
     }
+    config->max_headers_size = max_headers_size;
+    return true;
+}
 
-    rh_uint64_to_str(content_length, strlen(data));
+bool req_config_set_max_url_length(RequestsConfig* config, size_t max_url_length)
+{
+    if(config == NULL || max_url_length == 0)
+    {
+        return false;
+    }
+    config->max_url_length = max_url_length;
+    return true;
+}
 
+bool req_config_set_io_uring(RequestsConfig* config, bool enabled)
+{
+    if(config == NULL || (enabled && !rh_socket_io_uring_available()))
+    {
+        return false;
+    }
+    config->io_uring = enabled;
+    return true;
+}
 
-    // reserves the exact memory space for the request
-    headers = (char*) malloc((HEADERS_LENGTH + strlen(method) + strlen(url_splitted.uri) + strlen(url_splitted.host) + strlen(content_length) + strlen(data) + strlen(additional_headers))*sizeof(char));
-    if(headers == NULL)
+bool req_config_set_ktls(RequestsConfig* config, bool enabled)
+{
+    if(config == NULL || (enabled && !rh_socket_ktls_available()))
     {
-        goto ERROR;
+        return false;
     }
+    config->socket_options.ktls = enabled;
+    return true;
+}
 
-    // build the request with all the data
-    rh_strcpy(headers, method);
-    rh_strcat(headers, url_splitted.uri);
-    rh_strcat(headers, " HTTP/1.1\r\nHost: ");
-    rh_strcat(headers, url_splitted.host);
-    rh_strcat(headers, "\r\nContent-Length: ");
-    rh_strcat(headers, content_length);
-    rh_strcat(headers, "\r\n");
+bool req_config_set_early_data(RequestsConfig* config, bool enabled)
+{
+    if(config == NULL)
+    {
+        return false;
+    }
+    config->socket_options.session_cache = enabled;
+    config->socket_options.early_data = enabled;
+    return true;
+}
 
-    if(rh_str_search_case_unsensitive(additional_headers, "content-type") == -1)  // we don't want to have the same header two times
+bool req_config_set_expect_continue(RequestsConfig* config, size_t min_body_size, req_milliseconds timeout)
+{
+    if(config == NULL || (min_body_size > 0 && timeout == 0))
     {
-        rh_strcat(headers, "Content-Type: application/x-www-form-urlencoded\r\n");
+        return false;
     }
-    if(rh_str_search_case_unsensitive(additional_headers, "accept") == -1)  // we don't want to have the same header two times
+    config->expect_continue_size = min_body_size;
+    config->expect_continue_timeout = timeout;
+    return true;
+}
+
+bool req_config_set_tcp_nodelay(RequestsConfig* config, bool enabled)
+{
+    if(config == NULL)
     {
-        rh_strcat(headers, "Accept: */*\r\n");
+        return false;
     }
-    if(rh_str_search_case_unsensitive(additional_headers, "user-agent") == -1)  // we don't want to have the same header two times
+    config->socket_options.no_delay = enabled;
+    return true;
+}
+
+bool req_config_set_socket_buffers(RequestsConfig* config, size_t receive_size, size_t send_size)
+{
+    if(config == NULL || receive_size > INT_MAX || send_size > INT_MAX)
     {
-        rh_strcat(headers, "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/51.0.2704.103 Safari/537.36\r\n");
+        return false;
     }
-    if(rh_str_search_case_unsensitive(additional_headers, "connection") == -1)  // we don't want to have the same header two times
+    config->socket_options.receive_buffer_size = (int)receive_size;
+    config->socket_options.send_buffer_size = (int)send_size;
+    return true;
+}
+
+bool req_config_set_tcp_keepalive(RequestsConfig* config, unsigned int idle, unsigned int interval, unsigned int count)
+{
+    if(config == NULL || idle > INT_MAX || interval > INT_MAX || count > INT_MAX)
     {
-        rh_strcat(headers, "Connection: keep-alive\r\n");
+        return false;
     }
-    if(rh_str_search_case_unsensitive(additional_headers, "accept-encoding") == -1)  // we don't want to have the same header two times
+    config->socket_options.keepalive_idle = (int)idle;
+    config->socket_options.keepalive_interval = (int)interval;
+    config->socket_options.keepalive_count = (int)count;
+    return true;
+}
+
+bool req_config_set_tcp_fast_open(RequestsConfig* config, bool enabled)
+{
+    if(config == NULL)
     {
-        rh_strcat(headers, "Accept-Encoding: identity\r\n");
+        return false;
     }
+    config->socket_options.fast_open = enabled;
+    return true;
+}
 
-    rh_strcat(headers, additional_headers);
-    rh_strcat(headers, "\r\n");
-    rh_strcat(headers, data);
+bool req_config_set_busy_poll(RequestsConfig* config, unsigned int microseconds)
+{
+    if(config == NULL || microseconds > INT_MAX)
+    {
+        return false;
+    }
+    config->socket_options.busy_poll = (int)microseconds;
+    return true;
+}
 
-    if(handler != NULL && rh_strcasecmp(handler->host, url_splitted.host) == 0 && handler->port == url_splitted.port && handler->secured == url_splitted.secured)
+bool req_config_set_tcp_quickack(RequestsConfig* config, bool enabled)
+{
+    if(config == NULL)
     {
-        char trash_buffer[2048];
-        //clean the socket
-        while(req_read_output_body(handler, trash_buffer, 2048) > 0)
-        {
-            ;
-        }
-        rh_ptree_free(&(handler->headers_tree));
-        free(handler->reading_residue);
-        handler->reading_residue = NULL;
+        return false;
+    }
+    config->socket_options.quick_ack = enabled;
+    return true;
+}
 
-        if(!send_headers(handler, headers) || rh_socket_recv(handler->handler, &(handler->keep_alive_read), 1) <= 0)
-        {
-            req_close_connection(&handler);  // connection expired
-        }
-        // else: connection successfully reused
+bool req_config_set_transport(RequestsConfig* config, const RequestsTransport* transport)
+{
+    if(config == NULL)
+    {
+        return false;
     }
-    else if(handler != NULL)
+    if(transport == NULL)
     {
-        req_close_connection(&handler);
+        config->transport = SOCKET_TRANSPORT;
+        return true;
     }
-
-    if(handler == NULL)
+    if(transport->connect == NULL || transport->send == NULL || transport->recv == NULL || transport->close == NULL)
     {
-        handler = (RequestsHandler*) calloc(1, sizeof(RequestsHandler));
-        if(handler == NULL)
-        {
-            goto ERROR;
-        }
-
-        handler->keep_alive_read = '\0';
-
-        rh_strncpy(handler->host, url_splitted.host, RH_MAX_CHAR_ON_HOST+1);
-        handler->port = url_splitted.port;
-        handler->secured = url_splitted.secured;
+        return false;
+    }
+    config->transport = *transport;
+    return true;
+}
 
-        if(connect_socket(handler, config) == 0)
-        {
-            goto ERROR;
-        }
+void req_retry_policy_default(RequestsRetryPolicy* policy)
+{
+    policy->max_attempts = 3;
+    policy->base_backoff = 100;
+    policy->max_backoff = 2000;
+    policy->retry_statuses = default_retry_statuses;
+    policy->nb_retry_statuses = sizeof(default_retry_statuses) / sizeof(default_retry_statuses[0]);
+    policy->retry_connection_errors = true;
+    policy->retry_network_errors = true;
+    policy->retry_non_idempotent = false;
+    policy->retry_budget_ratio = 0.1;
+    policy->retry_budget_burst = 10;
+}
 
-        if(!send_headers(handler, headers))
+bool req_config_set_retry_policy(RequestsConfig* config, const RequestsRetryPolicy* policy)
+{
+    if(config == NULL || policy == NULL || policy->max_attempts == 0 || policy->retry_budget_ratio < 0)
+    {
+        return false;
+    }
+    RetryPolicy* retry = &(config->retry);
+    memset(retry, 0, sizeof(RetryPolicy));
+    retry->max_attempts = policy->max_attempts;
+    retry->base_backoff = policy->base_backoff;
+    retry->max_backoff = policy->max_backoff;
+    for(size_t i = 0; i < policy->nb_retry_statuses; i++)
+    {
+        unsigned short int status = policy->retry_statuses[i];
+        if(status >= MIN_HTTP_STATUS && status <= MAX_HTTP_STATUS)
         {
-            goto ERROR;
+            retry->retry_statuses[(status - MIN_HTTP_STATUS) / 64] |= (uint64_t)1 << ((status - MIN_HTTP_STATUS) % 64);
         }
     }
+    retry->retry_connection_errors = policy->retry_connection_errors;
+    retry->retry_network_errors = policy->retry_network_errors;
+    retry->retry_non_idempotent = policy->retry_non_idempotent;
+    retry->budget_deposit = (size_t)(policy->retry_budget_ratio * MILLI_TOKENS);
+    retry->budget_max = (size_t)policy->retry_budget_burst * MILLI_TOKENS;
+    __atomic_store_n(&(config->retry_budget), retry->budget_max, __ATOMIC_RELAXED);
+    return true;
+}
 
-    free(headers);
-    headers = NULL;
+bool req_config_set_pool(RequestsConfig* config, RequestsPool* pool)
+{
+    if(config == NULL)
+    {
+        return false;
+    }
+    config->pool = pool;
+    return true;
+}
 
-    handler->headers_tree = NULL;
-    handler->reading_residue = NULL;
-    handler->residue_size = 0;
-    handler->bytes_read = 0;
-    handler->residue_offset = 0;
-    handler->read_finished = 0;
-    handler->status_code = 0;
 
-    if(!req_parse_headers(handler))
+bool req_config_set_cache(RequestsConfig* config, RequestsCache* cache)
+{
+    if(config == NULL)
     {
-        goto ERROR;
+        return false;
     }
+    config->cache = cache;
+    return true;
+}
 
-    if(strcmp(method, "HEAD ") == 0)
+bool req_config_set_single_flight(RequestsConfig* config, RequestsSingleFlight* single_flight)
+{
+    if(config == NULL)
     {
-        handler->read_finished = 1;
+        return false;
     }
-    else
+    config->single_flight = single_flight;
+    return true;
+}
+
+RequestsPool* req_config_get_pool(const RequestsConfig* config)
+{
+    if(config == NULL)
     {
-        const char* response_content_length = req_get_header_value(handler, "content-length");
+        return NULL;
+    }
+    return config->pool;
+}
+
+
+/*
+Returns true if the server announced that it has closed, or will close very soon, the connection of HANDLER.
+*/
+static bool keep_alive_expired(const RequestsHandler* handler)
+{
+    return handler->remaining_requests == 0 || rh_timer_now() >= handler->idle_deadline;
+}
+
+static bool is_pooled_handler_expired(void* handler)
+{
+    return keep_alive_expired((RequestsHandler*)handler);
+}
+
+/*
+Returns true if the idle connection of HANDLER can be used for a new request.
+This is checked before writing the request, so a dead connection doesn't cost a failed write and a reconnection.
+*/
+static bool connection_usable(RequestsHandler* handler)
+{
+    return handler->connection != NULL && !keep_alive_expired(handler) && (handler->transport.is_alive == NULL || (*handler->transport.is_alive)(handler->connection));
+}
+
+/*
+Read the "Keep-Alive: timeout=5, max=100" header of the response, to know when the server will close the connection.
+*/
+static void parse_keep_alive(RequestsHandler* handler)
+{
+    const char* keep_alive = req_get_header_value(handler, "keep-alive");
+    long long index;
+
+    handler->idle_deadline = UINT64_MAX;
+    handler->remaining_requests = SIZE_MAX;
+    if(keep_alive == NULL)
+    {
+        return;
+    }
+
+    index = rh_str_search_case_unsensitive(keep_alive, "timeout=");
+    if(index != -1)
+    {
+        uint64_t timeout_ms = leading_uint64(keep_alive + index + sizeof("timeout=") - 1) * 1000;
+        uint64_t margin_ms = timeout_ms / 4 < KEEP_ALIVE_MARGIN_MS ? timeout_ms / 4 : KEEP_ALIVE_MARGIN_MS;
+        handler->idle_deadline = rh_timer_now() + (timeout_ms - margin_ms) * 1000 * 1000;
+    }
+    index = rh_str_search_case_unsensitive(keep_alive, "max=");
+    if(index != -1)
+    {
+        handler->remaining_requests = (size_t)leading_uint64(keep_alive + index + sizeof("max=") - 1);
+    }
+}
+
+static void destroy_pooled_handler(void* handler)
+{
+    destroy_handler((RequestsHandler*)handler);
+}
+
+static bool is_pooled_handler_usable(void* handler)
+{
+    return idle_connection_usable((RequestsHandler*)handler);
+}
+
+/*
+Take an idle connection to ORIGIN from POOL, and wake up the keeper of the warm origins so it's replaced.
+*/
+static RequestsHandler* take_idle_connection(RequestsPool* pool, const char* origin)
+{
+    RequestsHandler* handler = (RequestsHandler*) rh_pool_take(pool->idle_connections, origin);
+    if(handler != NULL && __atomic_load_n(&(pool->keeper_started), __ATOMIC_RELAXED))
+    {
+        pthread_cond_broadcast(&(pool->warm_cond));
+    }
+    return handler;
+}
+
+/*
+Open a connection for the warm origin of the job ARG and leave it idle in the pool, ready for a request.
+*/
+static void* warm_connection(void* arg)
+{
+    WarmJob* job = (WarmJob*)arg;
+    RequestsPool* pool = job->pool;
+    WarmOrigin* warm_origin = job->warm_origin;
+    RequestsHandler* handler = new_handler(job->config, warm_origin->host, warm_origin->port, warm_origin->secured);
+    bool connected = false;
+
+    if(handler != NULL)
+    {
+        // the first request isn't known yet, it may not be safe to send as early data
+        handler->socket_options.early_data = false;
+        connected = connect_socket(handler, job->config);
+    }
+    if(connected)
+    {
+        handler->reusable = true;
+        handler->read_finished = true;
+        handler->idle_deadline = UINT64_MAX;
+        handler->remaining_requests = SIZE_MAX;
+        rh_pool_put(pool->idle_connections, warm_origin->origin, handler);  // if the pool is full, the handler is destroyed
+    }
+    else if(handler != NULL)
+    {
+        destroy_handler(handler);
+    }
+    req_config_free(&(job->config));
+    free(job);
+
+    pthread_mutex_lock(&(pool->warm_lock));
+    warm_origin->opening--;
+    if(!connected)
+    {
+        warm_origin->retry_after = rh_timer_now() + (rh_nanoseconds)WARM_CHECK_INTERVAL_MS * 1000 * 1000;
+    }
+    pool->nb_warmers--;
+    pthread_cond_broadcast(&(pool->warm_cond));
+    pthread_mutex_unlock(&(pool->warm_lock));
+    return NULL;
+}
+
+/*
+Start a thread opening a connection for WARM_ORIGIN.
+The warm lock of POOL must be held.
+*/
+static bool start_warmer(RequestsPool* pool, WarmOrigin* warm_origin)
+{
+    pthread_attr_t attributes;
+    pthread_t thread;
+    bool started;
+    WarmJob* job = (WarmJob*) malloc(sizeof(WarmJob));
+    if(job == NULL)
+    {
+        return false;
+    }
+    job->pool = pool;
+    job->warm_origin = warm_origin;
+    job->config = req_config_copy(warm_origin->config);
+    if(job->config == NULL || pthread_attr_init(&attributes) != 0)
+    {
+        req_config_free(&(job->config));
+        free(job);
+        return false;
+    }
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    started = pthread_create(&thread, &attributes, warm_connection, job) == 0;
+    pthread_attr_destroy(&attributes);
+    if(!started)
+    {
+        req_config_free(&(job->config));
+        free(job);
+        return false;
+    }
+    warm_origin->opening++;
+    pool->nb_warmers++;
+    return true;
+}
+
+/*
+The thread that keeps at least min_idle usable connections in the pool for each warm origin of the pool ARG.
+The dead idle connections are dropped, and the missing ones are opened in parallel by other threads.
+*/
+static void* keep_warm(void* arg)
+{
+    RequestsPool* pool = (RequestsPool*)arg;
+
+    pthread_mutex_lock(&(pool->warm_lock));
+    while(!pool->closing)
+    {
+        struct timespec deadline;
+        rh_nanoseconds now = rh_timer_now();
+
+        for(WarmOrigin* warm_origin = pool->warm_origins; warm_origin != NULL; warm_origin = warm_origin->next)
+        {
+            size_t nb_idle;
+            if(warm_origin->min_idle == 0 || now < warm_origin->retry_after)
+            {
+                continue;
+            }
+            nb_idle = rh_pool_prune(pool->idle_connections, warm_origin->origin, is_pooled_handler_usable);
+            while(nb_idle + warm_origin->opening < warm_origin->min_idle && pool->nb_warmers < MAX_WARMERS && start_warmer(pool, warm_origin))
+            {
+                ;
+            }
+        }
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += WARM_CHECK_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (WARM_CHECK_INTERVAL_MS % 1000) * 1000 * 1000;
+        if(deadline.tv_nsec >= 1000 * 1000 * 1000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000 * 1000 * 1000;
+        }
+        pthread_cond_timedwait(&(pool->warm_cond), &(pool->warm_lock), &deadline);
+    }
+    pthread_mutex_unlock(&(pool->warm_lock));
+    return NULL;
+}
+
+RequestsPool* req_pool_init(size_t max_idle_per_origin)
+{
+    RequestsPool* pool = (RequestsPool*) malloc(sizeof(RequestsPool));
+    if(pool == NULL)
+    {
+        return NULL;
+    }
+
+    pool->idle_connections = rh_pool_init(max_idle_per_origin, destroy_pooled_handler, is_pooled_handler_expired);
+    if(pool->idle_connections == NULL)
+    {
+        free(pool);
+        return NULL;
+    }
+    if(pthread_mutex_init(&(pool->warm_lock), NULL) != 0)
+    {
+        goto ERROR;
+    }
+    if(pthread_cond_init(&(pool->warm_cond), NULL) != 0)
+    {
+        pthread_mutex_destroy(&(pool->warm_lock));
+        goto ERROR;
+    }
+    pool->max_idle_per_origin = max_idle_per_origin;
+    pool->warm_origins = NULL;
+    pool->nb_warmers = 0;
+    pool->keeper_started = false;
+    pool->closing = false;
+
+    return pool;
+
+ERROR:
+    rh_pool_free(&(pool->idle_connections));
+    free(pool);
+    return NULL;
+}
+
+void req_pool_free(RequestsPool** pool)
+{
+    if(*pool == NULL)
+    {
+        return;
+    }
+
+    // stop the keeper and wait for the connections being opened, they are put in the pool
+    pthread_mutex_lock(&((*pool)->warm_lock));
+    (*pool)->closing = true;
+    pthread_cond_broadcast(&((*pool)->warm_cond));
+    while((*pool)->nb_warmers > 0)
+    {
+        pthread_cond_wait(&((*pool)->warm_cond), &((*pool)->warm_lock));
+    }
+    pthread_mutex_unlock(&((*pool)->warm_lock));
+    if((*pool)->keeper_started)
+    {
+        pthread_join((*pool)->keeper, NULL);
+    }
+    while((*pool)->warm_origins != NULL)
+    {
+        WarmOrigin* next = (*pool)->warm_origins->next;
+        req_config_free(&((*pool)->warm_origins->config));
+        free((*pool)->warm_origins);
+        (*pool)->warm_origins = next;
+    }
+    pthread_cond_destroy(&((*pool)->warm_cond));
+    pthread_mutex_destroy(&((*pool)->warm_lock));
+
+    rh_pool_free(&((*pool)->idle_connections));
+    free(*pool);
+    *pool = NULL;
+}
+
+/*
+Register the origin of URL as a warm origin of POOL, or update it if it's already one.
+The warm lock of POOL must be held.
+*/
+static bool add_warm_origin(RequestsPool* pool, const RequestsConfig* config, const char* url, size_t min_idle)
+{
+    rh_UrlSplitted url_splitted;
+    char origin[ORIGIN_MAX_LENGTH];
+    RequestsConfig* config_copy;
+    WarmOrigin* warm_origin;
+
+    if(!parse_url(config, url, &url_splitted))
+    {
+        return false;
+    }
+    build_origin(origin, url_splitted.host, url_splitted.port, url_splitted.secured);
+
+    config_copy = config == NULL ? req_config_default() : req_config_copy(config);
+    if(config_copy == NULL)
+    {
+        rh_url_free(&url_splitted);
+        return false;
+    }
+    config_copy->pool = pool;
+
+    for(warm_origin = pool->warm_origins; warm_origin != NULL; warm_origin = warm_origin->next)
+    {
+        if(strcmp(warm_origin->origin, origin) == 0)
+        {
+            break;
+        }
+    }
+    if(warm_origin == NULL)
+    {
+        warm_origin = (WarmOrigin*) malloc(sizeof(WarmOrigin));
+        if(warm_origin == NULL)
+        {
+            req_config_free(&config_copy);
+            rh_url_free(&url_splitted);
+            return false;
+        }
+        rh_strncpy(warm_origin->origin, origin, ORIGIN_MAX_LENGTH);
+        rh_strncpy(warm_origin->host, url_splitted.host, RH_MAX_CHAR_ON_HOST + 1);
+        warm_origin->port = url_splitted.port;
+        warm_origin->secured = url_splitted.secured;
+        warm_origin->opening = 0;
+        warm_origin->config = NULL;
+        warm_origin->next = pool->warm_origins;
+        pool->warm_origins = warm_origin;
+    }
+    req_config_free(&(warm_origin->config));  // the running warmers have their own copy
+    warm_origin->config = config_copy;
+    warm_origin->min_idle = min_idle;
+    warm_origin->retry_after = 0;
+
+    rh_url_free(&url_splitted);
+    return true;
+}
+
+/*
+Keep NB_CONNECTIONS idle connections to each of the NB_ORIGINS ORIGINS in POOL, opened in the background with CONFIG.
+*/
+bool req_pool_prewarm(RequestsPool* pool, const RequestsConfig* config, const char* const* origins, size_t nb_origins, size_t nb_connections)
+{
+    bool success = true;
+
+    if(pool == NULL)
+    {
+        return false;
+    }
+    if(nb_connections > pool->max_idle_per_origin)
+    {
+        nb_connections = pool->max_idle_per_origin;  // the pool would destroy the others at once
+    }
+
+    pthread_mutex_lock(&(pool->warm_lock));
+    for(size_t i = 0; i < nb_origins; i++)
+    {
+        if(!add_warm_origin(pool, config, origins[i], nb_connections))
+        {
+            success = false;
+        }
+    }
+    if(pool->warm_origins != NULL && !pool->keeper_started)
+    {
+        if(pthread_create(&(pool->keeper), NULL, keep_warm, pool) == 0)
+        {
+            __atomic_store_n(&(pool->keeper_started), true, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            success = false;
+        }
+    }
+    pthread_cond_broadcast(&(pool->warm_cond));  // the keeper opens the connections at once
+    pthread_mutex_unlock(&(pool->warm_lock));
+
+    return success;
+}
+
+RequestsCache* req_cache_init(size_t max_memory, const char* directory)
+{
+    RequestsCache* cache = (RequestsCache*) malloc(sizeof(RequestsCache));
+    if(cache == NULL)
+    {
+        return NULL;
+    }
+    cache->responses = rh_cache_init(max_memory, directory);
+    if(cache->responses == NULL)
+    {
+        free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void req_cache_free(RequestsCache** cache)
+{
+    if(*cache == NULL)
+    {
+        return;
+    }
+    rh_cache_free(&((*cache)->responses));
+    free(*cache);
+    *cache = NULL;
+}
+
+RequestsSingleFlight* req_single_flight_init(size_t max_body_size, req_milliseconds max_wait_time)
+{
+    RequestsSingleFlight* single_flight = (RequestsSingleFlight*) calloc(1, sizeof(RequestsSingleFlight));
+    if(single_flight == NULL)
+    {
+        return NULL;
+    }
+    if(pthread_mutex_init(&(single_flight->lock), NULL) != 0)
+    {
+        free(single_flight);
+        return NULL;
+    }
+    single_flight->max_body_size = max_body_size;
+    single_flight->max_wait_time = max_wait_time;
+
+    return single_flight;
+}
+
+void req_single_flight_free(RequestsSingleFlight** single_flight)
+{
+    if(*single_flight == NULL)
+    {
+        return;
+    }
+    pthread_mutex_destroy(&((*single_flight)->lock));
+    free(*single_flight);
+    *single_flight = NULL;
+}
+
+/*
+Write the pool key of a connection in ORIGIN, it should be at least ORIGIN_MAX_LENGTH bytes.
+*/
+static void build_origin(char* origin, const char* host, uint16_t port, bool secured)
+{
+    char port_str[8];
+    rh_uint64_to_str(port_str, port);
+    rh_strcpy(rh_strcpy(rh_strcpy(rh_strcpy(origin, secured ? "https://" : port == RH_UNIX_SOCKET_PORT ? "http+unix://" : "http://"), host), ":"), port_str);
+}
+
+
+size_t req_nb_bytes_read(RequestsHandler* handler)
+{
+    return handler->bytes_read;
+}
+
+/*
+Returns true if the body of the last response was entirely read.
+*/
+static bool response_consumed(RequestsHandler* handler)
+{
+    return !handler->read_failed && (handler->read_finished || (!handler->chunked && (ssize_t)handler->body_position >= handler->total_bytes));
+}
+
+/*
+Returns true if the connection of HANDLER, whose response was drained, can take a new request.
+*/
+static bool idle_connection_usable(RequestsHandler* handler)
+{
+    return handler->reusable && !handler->read_failed && handler->receive_start == handler->receive_end && connection_usable(handler);
+}
+
+/*
+Send the new request on a connection that was already used.
+If the connection has expired, it returns false.
+The server may still have closed it in the meantime, which shows up as an end of stream before the first byte of the response.
+*/
+static bool reuse_connection(RequestsHandler* handler, const char* headers, size_t headers_length)
+{
+    char trash_buffer[2048];
+    if(handler->async_state != ASYNC_NONE || (handler->nonblocking && !rh_socket_set_blocking(handler->connection, true)))
+    {
+        // the request of req_request_start wasn't finished
+        return false;
+    }
+    handler->nonblocking = false;
+
+    //clean the socket
+    while(req_read_output_body(handler, trash_buffer, 2048) > 0)
+    {
+        ;
+    }
+    rh_ptree_free(&(handler->headers_tree));
+
+    if(!idle_connection_usable(handler))
+    {
+        return false;
+    }
+    handler->reusable = false;
+
+    return send_headers(handler, headers, headers_length);
+}
+
+/*
+Returns true if the NAME_LENGTH first characters of NAME are equal to REF, ignoring the case.
+*/
+static bool header_name_equals(const char* name, size_t name_length, const char* ref)
+{
+    size_t i;
+    for(i = 0; i < name_length; i++)
+    {
+        if(ref[i] == '\0' || tolower(name[i]) != ref[i])
+        {
+            return false;
+        }
+    }
+    return ref[i] == '\0';
+}
+
+/*
+Check that each line of ADDITIONAL_HEADERS is like "Name: value\r\n" and find which default headers they override.
+Returns false if the headers are malformed.
+*/
+static bool scan_headers(const char* additional_headers, bool overridden[NB_DEFAULT_HEADERS], size_t* length)
+{
+    const char* line = additional_headers;
+
+    for(int i = 0; i < NB_DEFAULT_HEADERS; i++)
+    {
+        overridden[i] = false;
+    }
+
+    while(*line != '\0')
+    {
+        size_t name_length = 0;
+        while(line[name_length] > ' ' && line[name_length] < 127 && line[name_length] != ':')
+        {
+            name_length++;
+        }
+        if(name_length == 0 || line[name_length] != ':')
+        {
+            return false;
+        }
+        for(int i = 0; i < NB_DEFAULT_HEADERS; i++)
+        {
+            if(header_name_equals(line, name_length, default_headers[i].name))
+            {
+                overridden[i] = true;
+            }
+        }
+
+        line += name_length + 1;
+        while(*line != '\0' && *line != '\r' && *line != '\n')
+        {
+            line++;
+        }
+        if(line[0] != '\r' || line[1] != '\n')
+        {
+            return false;
+        }
+        line += 2;
+    }
+
+    *length = (size_t)(line - additional_headers);
+    return true;
+}
+
+/*
+Parse and validate the headers once, so they can be sent with many requests.
+If the headers are malformed or if there is a memory error, it returns NULL.
+*/
+RequestsHeaders* req_headers_prepare(const char* additional_headers)
+{
+    bool overridden[NB_DEFAULT_HEADERS];
+    size_t additional_length;
+    size_t block_length = sizeof("\r\n") - 1;
+    RequestsHeaders* headers;
+    char* writer;
+
+    if(!scan_headers(additional_headers, overridden, &additional_length))
+    {
+        return NULL;
+    }
+
+    for(int i = 0; i < NB_DEFAULT_HEADERS; i++)
+    {
+        if(!overridden[i])  // we don't want to have the same header two times
+        {
+            block_length += strlen(default_headers[i].line);
+        }
+    }
+    block_length += additional_length;
+
+    headers = (RequestsHeaders*) malloc(sizeof(RequestsHeaders));
+    if(headers == NULL)
+    {
+        return NULL;
+    }
+    headers->block = (char*) malloc((block_length + 1) * sizeof(char));
+    if(headers->block == NULL)
+    {
+        free(headers);
+        return NULL;
+    }
+
+    writer = headers->block;
+    for(int i = 0; i < NB_DEFAULT_HEADERS; i++)
+    {
+        if(!overridden[i])
+        {
+            writer = rh_strcpy(writer, default_headers[i].line);
+        }
+    }
+    writer = rh_strcpy(writer, additional_headers);
+    rh_strcpy(writer, "\r\n");
+    headers->block_length = block_length;
+
+    return headers;
+}
+
+void req_headers_free(RequestsHeaders** headers)
+{
+    if(*headers == NULL)
+    {
+        return;
+    }
+    free((*headers)->block);
+    free(*headers);
+    *headers = NULL;
+}
+
+/*
+Split URL like rh_parse_url, unless it's longer than the limit of CONFIG.
+*/
+static bool parse_url(const RequestsConfig* config, const char* url, rh_UrlSplitted* url_splitted)
+{
+    size_t max_url_length = config != NULL ? config->max_url_length : DEFAULT_MAX_URL_LENGTH;
+    if(strnlen(url, max_url_length + 1) > max_url_length)
+    {
+        url_splitted->uri = NULL;
+        return false;
+    }
+    return rh_parse_url(url, url_splitted);
+}
+
+/*
+Returns true if a request with a body of DATA_LENGTH bytes sends its headers with "Expect: 100-continue" and waits for the server before sending the body.
+The server can only be waited for on the sockets of the library.
+*/
+static bool expects_continue(const RequestsConfig* config, size_t data_length)
+{
+    return config != NULL && config->expect_continue_size > 0 && data_length >= config->expect_continue_size && uses_sockets(&(config->transport));
+}
+
+/*
+Serialize the request in a new buffer.
+HEADERS_LENGTH is set to the length of the request.
+If there is a memory error, it returns NULL.
+*/
+static char* build_request(const char* method, const rh_UrlSplitted* url_splitted, const char* data, size_t data_length, const RequestsHeaders* prepared_headers, bool expect_continue, size_t* headers_length)
+{
+    char content_length[30];
+    size_t length;
+    char* headers;
+    char* writer;
+
+    rh_uint64_to_str(content_length, data_length);
+
+    length = strlen(method) + strlen(url_splitted->uri) + sizeof(" HTTP/1.1\r\nHost: ") - 1 + strlen(url_splitted->host)
+        + sizeof("\r\nContent-Length: ") - 1 + strlen(content_length) + sizeof("\r\n") - 1 + prepared_headers->block_length + data_length;
+    if(expect_continue)
+    {
+        length += sizeof(EXPECT_CONTINUE_LINE) - 1;
+    }
+
+    // reserves the exact memory space for the request
+    headers = (char*) malloc((length + 1) * sizeof(char));
+    if(headers == NULL)
+    {
+        return NULL;
+    }
+
+    // build the request with all the data
+    writer = rh_strcpy(headers, method);
+    writer = rh_strcpy(writer, url_splitted->uri);
+    writer = rh_strcpy(writer, " HTTP/1.1\r\nHost: ");
+    writer = rh_strcpy(writer, url_splitted->host);
+    writer = rh_strcpy(writer, "\r\nContent-Length: ");
+    writer = rh_strcpy(writer, content_length);
+    writer = rh_strcpy(writer, "\r\n");
+    if(expect_continue)
+    {
+        writer = rh_strcpy(writer, EXPECT_CONTINUE_LINE);
+    }
+    memcpy(writer, prepared_headers->block, prepared_headers->block_length);
+    writer += prepared_headers->block_length;
+    memcpy(writer, data, data_length);
+    writer[data_length] = '\0';
+
+    *headers_length = length;
+    return headers;
+}
+
+/*
+This is not meant to be used directly, unless you have exotic HTTP methods.
+*/
+RequestsHandler* req_request(RequestsConfig* config, RequestsHandler* handler, const char* method, const char* url, const char* data, const char* additional_headers)
+{
+    RequestsHeaders* prepared_headers = req_headers_prepare(additional_headers);
+    if(prepared_headers == NULL)
+    {
+        req_close_connection(&handler);
+        return NULL;
+    }
+
+    handler = send_request(config, handler, method, url, data, strlen(data), prepared_headers);
+
+    req_headers_free(&prepared_headers);
+    return handler;
+}
+
+RequestsHandler* req_request_prepared(RequestsConfig* config, RequestsHandler* handler, const char* method, const char* url, const char* data, const RequestsHeaders* prepared_headers)
+{
+    return send_request(config, handler, method, url, data, strlen(data), prepared_headers);
+}
+
+/*
+Create a handler for a connection to HOST, that isn't opened yet.
+*/
+static RequestsHandler* new_handler(const RequestsConfig* config, const char* host, uint16_t port, bool secured)
+{
+    RequestsHandler* handler = (RequestsHandler*) calloc(1, sizeof(RequestsHandler));
+    if(handler == NULL)
+    {
+        return NULL;
+    }
+
+    rh_strncpy(handler->host, host, RH_MAX_CHAR_ON_HOST+1);
+    handler->port = port;
+    handler->secured = secured;
+    handler->pool = config != NULL ? config->pool : NULL;
+    handler->receive_capacity = config != NULL ? config->receive_buffer_size : DEFAULT_RECEIVE_BUFFER_SIZE;
+    handler->max_headers_size = config != NULL ? config->max_headers_size : DEFAULT_MAX_HEADERS_SIZE;
+    handler->transport = config != NULL ? config->transport : SOCKET_TRANSPORT;
+    if(config != NULL)
+    {
+        handler->socket_options = config->socket_options;
+    }
+    return handler;
+}
+
+/*
+Returns true if the serialized request HEADERS can be sent as TLS early data.
+Early data can be replayed by an attacker, so only the safe methods are sent this way (RFC 8470).
+*/
+static bool early_data_allowed(const char* headers)
+{
+    return rh_startswith(headers, "GET ") || rh_startswith(headers, "HEAD ") || rh_startswith(headers, "OPTIONS ");
+}
+
+/*
+Open a new connection to HOST and send the serialized request HEADERS on it.
+If it fails, it returns NULL.
+*/
+static RequestsHandler* open_connection(RequestsConfig* config, const char* host, uint16_t port, bool secured, const char* headers, size_t headers_length)
+{
+    RequestsHandler* handler = new_handler(config, host, port, secured);
+    if(handler == NULL)
+    {
+        return NULL;
+    }
+    if(!early_data_allowed(headers))
+    {
+        handler->socket_options.early_data = false;
+    }
+
+    if(connect_socket(handler, config) == 0 || !send_headers(handler, headers, headers_length))
+    {
+        last_failure = FAILURE_NOT_SENT;
+        destroy_handler(handler);
+        return NULL;
+    }
+    return handler;
+}
+
+/*
+Forget the state of the previous response before reading a new one.
+*/
+static void reset_response(RequestsHandler* handler)
+{
+    handler->headers_tree = NULL;
+    handler->bytes_read = 0;
+    handler->body_position = 0;
+    handler->read_finished = 0;
+    handler->read_failed = false;
+    handler->status_code = 0;
+    handler->chunk_length_index = 0;
+    rh_cache_entry_release(&(handler->body_entry));
+    handler->body_offset = 0;
+}
+
+/*
+Find how the body of the response is delimited, once its headers are parsed, and if the connection can be reused after it.
+Returns false if the Content-Length is invalid.
+*/
+static bool start_body(RequestsHandler* handler, bool is_head)
+{
+    if(is_head || handler->status_code == 204 || handler->status_code == 304)
+    {
+        // there is no body
+        handler->read_finished = 1;
+    }
+    else
+    {
+        const char* response_content_length = req_get_header_value(handler, "content-length");
         const char* transfer_encoding = req_get_header_value(handler, "transfer-encoding");
         if(response_content_length == NULL || (transfer_encoding != NULL && rh_str_search_case_unsensitive(transfer_encoding, "chunked") != -1))
         {
-            handler->total_bytes = 0;
-            handler->chunked = 1;
+            handler->total_bytes = 0;
+            handler->chunked = 1;
+        }
+        else
+        {
+            uint64_t tot_bytes = rh_str_to_uint64(response_content_length);
+            if(tot_bytes > INT64_MAX)
+            {
+                return false;
+            }
+            handler->total_bytes = (ssize_t)tot_bytes;
+            handler->chunked = 0;
+        }
+    }
+
+    const char* connection = req_get_header_value(handler, "connection");
+    handler->reusable = connection == NULL || rh_str_search_case_unsensitive(connection, "close") == -1;
+    parse_keep_alive(handler);
+    return true;
+}
+
+/*
+Read the headers of the response, once the headers of the request were sent.
+The last CONTINUE_LENGTH bytes of HEADERS are the body of a request with "Expect: 100-continue": they are sent when the server answers with 100 Continue,
+or when it doesn't answer in time. If the server answers with a final status first, the body isn't sent and BODY_SENT is set to false.
+The other interim responses, like 103 Early Hints, are skipped without extending the time given to the server.
+*/
+static bool await_response(RequestsConfig* config, RequestsHandler* handler, const char* headers, size_t headers_length, size_t continue_length, bool* body_sent, bool* received)
+{
+    rh_nanoseconds deadline;
+    bool answered = false;
+    bool interim = false;  /* the server answered, so it read the request */
+    bool parsed;
+
+    *body_sent = true;
+    if(continue_length == 0)
+    {
+        return req_parse_headers(handler, received);
+    }
+
+    deadline = rh_timer_now() + config->expect_continue_timeout * 1000 * 1000;
+    while(!answered && uses_sockets(&(handler->transport)))
+    {
+        rh_nanoseconds now = rh_timer_now();
+        if(handler->receive_start == handler->receive_end
+            && (now >= deadline || !rh_socket_wait_readable(handler->connection, (deadline - now) / (1000 * 1000))))
+        {
+            // no answer in time, the body is sent anyway
+            break;
+        }
+
+        handler->awaiting_continue = true;
+        parsed = req_parse_headers(handler, received);
+        handler->awaiting_continue = false;
+        if(!parsed)
+        {
+            return false;
+        }
+        if(handler->status_code < 100 || handler->status_code >= 200 || handler->status_code == 101)
+        {
+            *body_sent = false;
+            return true;
+        }
+        answered = handler->status_code == 100;
+        interim = true;
+        rh_ptree_free(&(handler->headers_tree));
+        reset_response(handler);
+    }
+
+    if(!send_headers(handler, headers + headers_length - continue_length, continue_length))
+    {
+        *received = interim;
+        return false;
+    }
+    parsed = req_parse_headers(handler, received);
+    *received = *received || interim;  // the server read the request, it must not be sent again
+    return parsed;
+}
+
+/*
+Send the serialized request HEADERS to HOST, on a reused connection if possible, and parse the response headers.
+If CONTINUE_LENGTH isn't 0, the request asks for 100 Continue and its last CONTINUE_LENGTH bytes, the body, wait for the answer of the server.
+If it fails, HANDLER is closed and it returns NULL.
+*/
+static RequestsHandler* exchange(RequestsConfig* config, RequestsHandler* handler, const char* host, uint16_t port, bool secured, const char* headers, size_t headers_length, size_t continue_length, bool is_head)
+{
+    bool reused = true;
+    bool received = false;
+    bool body_sent = true;
+
+    if(handler != NULL && handler->connection == NULL)
+    {
+        // served from the cache, there is no connection to reuse
+        destroy_handler(handler);
+        handler = NULL;
+    }
+
+    if(handler != NULL && rh_strcasecmp(handler->host, host) == 0 && handler->port == port && handler->secured == secured && same_transport(handler, config))
+    {
+        if(!reuse_connection(handler, headers, headers_length - continue_length))
+        {
+            // connection expired
+            destroy_handler(handler);
+            handler = NULL;
+        }
+        // else: connection successfully reused
+    }
+    else if(handler != NULL)
+    {
+        req_close_connection(&handler);  // if the handler comes from a pool, it goes back into it
+    }
+
+    if(handler == NULL && config != NULL && config->pool != NULL)
+    {
+        char origin[ORIGIN_MAX_LENGTH];
+        build_origin(origin, host, port, secured);
+        while((handler = take_idle_connection(config->pool, origin)) != NULL
+            && (!same_transport(handler, config) || !reuse_connection(handler, headers, headers_length - continue_length)))
+        {
+            // This one has expired or was opened by another transport, try the next one
+            destroy_handler(handler);
+        }
+    }
+
+    if(handler == NULL)
+    {
+        handler = open_connection(config, host, port, secured, headers, headers_length - continue_length);
+        if(handler == NULL)
+        {
+            goto ERROR;
+        }
+        reused = false;
+    }
+
+    reset_response(handler);
+    while(!await_response(config, handler, headers, headers_length, continue_length, &body_sent, &received))
+    {
+        if(!reused || received)
+        {
+            last_failure = FAILURE_NO_RESPONSE;
+            goto ERROR;
+        }
+        // The server closed the idle connection before reading the request, send it again on a new one
+        destroy_handler(handler);
+        reused = false;
+        handler = open_connection(config, host, port, secured, headers, headers_length - continue_length);
+        if(handler == NULL)
+        {
+            goto ERROR;
+        }
+        reset_response(handler);
+    }
+    last_failure = FAILURE_OTHER;
+
+    if(!start_body(handler, is_head))
+    {
+        goto ERROR;
+    }
+    if(!body_sent)
+    {
+        // the server expects the body that was announced, the connection can't take another request
+        handler->reusable = false;
+    }
+    return handler;
+
+ERROR:
+    req_close_connection(&handler);
+    return NULL;
+}
+
+static inline bool is_redirect(unsigned short int status_code)
+{
+    return status_code == 301 || status_code == 302 || status_code == 303 || status_code == 307 || status_code == 308;
+}
+
+/*
+Remove the "." and ".." segments of PATH, in place, as described in RFC 3986.
+PATH must start with '/'. The query is kept as it is.
+*/
+static void remove_dot_segments(char* path)
+{
+    size_t end = strcspn(path, "?#");
+    size_t r = 0;
+    size_t w = 0;
+
+    while(r < end)
+    {
+        // path[r] is always a '/' here
+        size_t segment_end = r + 1;
+        while(segment_end < end && path[segment_end] != '/')
+        {
+            segment_end++;
+        }
+
+        if(segment_end - r == 2 && path[r+1] == '.')
+        {
+            if(segment_end == end)
+            {
+                path[w++] = '/';
+            }
+        }
+        else if(segment_end - r == 3 && path[r+1] == '.' && path[r+2] == '.')
+        {
+            while(w > 0)
+            {
+                w--;
+                if(path[w] == '/')
+                {
+                    break;
+                }
+            }
+            if(segment_end == end)
+            {
+                path[w++] = '/';
+            }
+        }
+        else
+        {
+            memmove(path + w, path + r, segment_end - r);
+            w += segment_end - r;
+        }
+        r = segment_end;
+    }
+    if(w == 0)
+    {
+        path[w++] = '/';
+    }
+    memmove(path + w, path + end, strlen(path + end) + 1);
+}
+
+/*
+Build the absolute url targeted by LOCATION, relatively to the url in URL_SPLITTED.
+If there is a memory error, it returns NULL.
+*/
+static char* resolve_location(const rh_UrlSplitted* url_splitted, const char* location)
+{
+    char protocol[sizeof("http+unix:")];
+    char port_str[8] = "";
+    size_t uri_directory_length;
+    char* url;
+    char* path;
+    char* writer;
+
+    rh_strcpy(rh_strcpy(protocol, rh_url_scheme(url_splitted)), ":");
+
+    if(rh_startswith(location, "http://") || rh_startswith(location, "https://"))
+    {
+        url = (char*) malloc((strlen(location) + 1) * sizeof(char));
+        if(url != NULL)
+        {
+            rh_strcpy(url, location);
+        }
+        return url;
+    }
+    if(rh_startswith(location, "//"))
+    {
+        // same scheme, other host
+        url = (char*) malloc((strlen(protocol) + strlen(location) + 1) * sizeof(char));
+        if(url != NULL)
+        {
+            rh_strcpy(rh_strcpy(url, protocol), location);
+        }
+        return url;
+    }
+
+    if((url_splitted->secured && url_splitted->port != 443) || (!url_splitted->secured && url_splitted->port != 80 && url_splitted->port != RH_UNIX_SOCKET_PORT))
+    {
+        port_str[0] = ':';
+        rh_uint64_to_str(port_str+1, url_splitted->port);
+    }
+
+    // the directory of the uri, without the query
+    uri_directory_length = 0;
+    for(size_t i = 0; url_splitted->uri[i] != '\0' && url_splitted->uri[i] != '?'; i++)
+    {
+        if(url_splitted->uri[i] == '/')
+        {
+            uri_directory_length = i + 1;
+        }
+    }
+
+    url = (char*) malloc((strlen(protocol) + 2 + strlen(url_splitted->host) + strlen(port_str) + uri_directory_length + strlen(location) + 2) * sizeof(char));
+    if(url == NULL)
+    {
+        return NULL;
+    }
+
+    writer = rh_strcpy(rh_strcpy(rh_strcpy(url, protocol), "//"), url_splitted->host);
+    path = rh_strcpy(writer, port_str);
+    if(location[0] == '/')
+    {
+        rh_strcpy(path, location);
+    }
+    else
+    {
+        memcpy(path, url_splitted->uri, uri_directory_length);
+        rh_strcpy(path + uri_directory_length, location);
+    }
+    if(path[0] != '/')
+    {
+        memmove(path + 1, path, strlen(path) + 1);
+        path[0] = '/';
+    }
+    remove_dot_segments(path);
+
+    return url;
+}
+
+/*
+Remember that FROM is permanently moved to TO.
+*/
+static void cache_permanent_redirect(RequestsConfig* config, const char* from, const char* to, bool keep_method)
+{
+    char* from_copy = (char*) malloc((strlen(from) + 1) * sizeof(char));
+    char* to_copy = (char*) malloc((strlen(to) + 1) * sizeof(char));
+    if(from_copy == NULL || to_copy == NULL)
+    {
+        free(from_copy);
+        free(to_copy);
+        return;
+    }
+    rh_strcpy(from_copy, from);
+    rh_strcpy(to_copy, to);
+
+    pthread_mutex_lock(&(config->redirects_lock));
+    PermanentRedirect* redirect = &(config->redirects[config->next_redirect]);
+    free(redirect->from);
+    free(redirect->to);
+    redirect->from = from_copy;
+    redirect->to = to_copy;
+    redirect->keep_method = keep_method;
+    config->next_redirect = (config->next_redirect + 1) % REDIRECT_CACHE_SIZE;
+    pthread_mutex_unlock(&(config->redirects_lock));
+}
+
+/*
+If URL is known to be permanently moved, returns a copy of the new url that must be freed.
+Otherwise, it returns NULL.
+*/
+static char* find_permanent_redirect(RequestsConfig* config, const char* url, bool* keep_method)
+{
+    char* to = NULL;
+    pthread_mutex_lock(&(config->redirects_lock));
+    for(size_t i = 0; i < REDIRECT_CACHE_SIZE && to == NULL; i++)
+    {
+        PermanentRedirect* redirect = &(config->redirects[i]);
+        if(redirect->from != NULL && strcmp(redirect->from, url) == 0)
+        {
+            to = (char*) malloc((strlen(redirect->to) + 1) * sizeof(char));
+            if(to != NULL)
+            {
+                rh_strcpy(to, redirect->to);
+                *keep_method = redirect->keep_method;
+            }
+        }
+    }
+    pthread_mutex_unlock(&(config->redirects_lock));
+    return to;
+}
+
+/*
+Write the url of URL_SPLITTED in a new string that must be freed.
+*/
+static char* build_url(const rh_UrlSplitted* url_splitted)
+{
+    char port_str[8] = "";
+    char* url = (char*) malloc((sizeof("http+unix://:65535") + strlen(url_splitted->host) + strlen(url_splitted->uri)) * sizeof(char));
+    if(url == NULL)
+    {
+        return NULL;
+    }
+    if(url_splitted->port != RH_UNIX_SOCKET_PORT)
+    {
+        port_str[0] = ':';
+        rh_uint64_to_str(port_str + 1, url_splitted->port);
+    }
+    rh_strcpy(rh_strcpy(rh_strcpy(rh_strcpy(rh_strcpy(url, rh_url_scheme(url_splitted)), "://"), url_splitted->host), port_str), url_splitted->uri);
+    return url;
+}
+
+/*
+While HANDLER holds a redirection, send the request again to the new location, at most config->max_redirects times.
+URL_SPLITTED is the url of the request that was just sent.
+303 turns the request into a GET without body (HEAD stays HEAD), 301 and 302 only do it for a POST, the other redirections keep the method and the body.
+*/
+static RequestsHandler* follow_redirects(RequestsConfig* config, RequestsHandler* handler, const char* method, rh_UrlSplitted* url_splitted, const char* data, size_t data_length, const RequestsHeaders* prepared_headers)
+{
+    size_t max_redirects = config != NULL ? config->max_redirects : DEFAULT_MAX_REDIRECTS;
+    size_t hops = 0;
+    const char* location;
+
+    if(max_redirects == 0)
+    {
+        // the caller handles the redirections
+        return handler;
+    }
+
+    while(is_redirect(handler->status_code) && (location = rh_ptree_get_value(handler->headers_tree, "location")) != NULL)
+    {
+        unsigned short int status_code = handler->status_code;
+        size_t headers_length;
+        bool expect_continue;
+        char* headers;
+        char* next_url;
+
+        if(hops >= max_redirects)
+        {
+            // probably a redirect loop
+            req_close_connection(&handler);
+            return NULL;
+        }
+        hops++;
+
+        next_url = resolve_location(url_splitted, location);
+        if(next_url == NULL)
+        {
+            req_close_connection(&handler);
+            return NULL;
+        }
+
+        if(config != NULL && (status_code == 301 || status_code == 308))
+        {
+            char* url = build_url(url_splitted);
+            if(url != NULL)
+            {
+                cache_permanent_redirect(config, url, next_url, status_code == 308);
+            }
+            free(url);
+        }
+
+        if(status_code == 303 || ((status_code == 301 || status_code == 302) && strcmp(method, "POST ") == 0))
+        {
+            if(strcmp(method, "HEAD ") != 0)
+            {
+                method = "GET ";
+            }
+            data = "";
+            data_length = 0;
+        }
+
+        rh_url_free(url_splitted);
+        if(!parse_url(config, next_url, url_splitted))
+        {
+            free(next_url);
+            req_close_connection(&handler);
+            return NULL;
+        }
+        free(next_url);
+
+        expect_continue = expects_continue(config, data_length);
+        headers = build_request(method, url_splitted, data, data_length, prepared_headers, expect_continue, &headers_length);
+        if(headers == NULL)
+        {
+            req_close_connection(&handler);
+            return NULL;
+        }
+
+        // exchange drains the body of the redirection if the connection can be reused
+        handler = exchange(config, handler, url_splitted->host, url_splitted->port, url_splitted->secured, headers, headers_length, expect_continue ? data_length : 0, strcmp(method, "HEAD ") == 0);
+        free(headers);
+        if(handler == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    return handler;
+}
+
+/*
+Resolve the method, the base url and the headers once, so only the path and the body are left to add for each request.
+If the base url or the headers are invalid, or if there is a memory error, it returns NULL.
+*/
+RequestsTemplate* req_prepare(RequestsConfig* config, const char* method, const char* base_url, const char* additional_headers)
+{
+    rh_UrlSplitted url_splitted;
+    RequestsTemplate* request_template;
+    size_t uri_length;
+
+    if(!parse_url(config, base_url, &url_splitted))
+    {
+        return NULL;
+    }
+
+    // The paths given to req_send_prepared start with a '/'
+    uri_length = strlen(url_splitted.uri);
+    if(uri_length > 0 && url_splitted.uri[uri_length-1] == '/')
+    {
+        uri_length--;
+        url_splitted.uri[uri_length] = '\0';
+    }
+
+    request_template = (RequestsTemplate*) calloc(1, sizeof(RequestsTemplate));
+    if(request_template == NULL)
+    {
+        rh_url_free(&url_splitted);
+        return NULL;
+    }
+
+    request_template->headers = req_headers_prepare(additional_headers);
+    request_template->request_line_start_length = strlen(method) + uri_length;
+    request_template->request_line_start = (char*) malloc((request_template->request_line_start_length + 1) * sizeof(char));
+    request_template->host_line_length = sizeof(" HTTP/1.1\r\nHost: ") - 1 + strlen(url_splitted.host) + sizeof("\r\nContent-Length: ") - 1;
+    request_template->host_line = (char*) malloc((request_template->host_line_length + 1) * sizeof(char));
+    if(request_template->headers == NULL || request_template->request_line_start == NULL || request_template->host_line == NULL)
+    {
+        rh_url_free(&url_splitted);
+        req_template_free(&request_template);
+        return NULL;
+    }
+
+    rh_strcpy(rh_strcpy(request_template->request_line_start, method), url_splitted.uri);
+    rh_strcpy(rh_strcpy(rh_strcpy(request_template->host_line, " HTTP/1.1\r\nHost: "), url_splitted.host), "\r\nContent-Length: ");
+
+    request_template->config = config;
+    rh_strncpy(request_template->host, url_splitted.host, RH_MAX_CHAR_ON_HOST+1);
+    request_template->port = url_splitted.port;
+    request_template->secured = url_splitted.secured;
+    request_template->is_head = strcmp(method, "HEAD ") == 0;
+    request_template->empty_base_uri = uri_length == 0;
+
+    rh_url_free(&url_splitted);
+    return request_template;
+}
+
+void req_template_free(RequestsTemplate** request_template)
+{
+    if(*request_template == NULL)
+    {
+        return;
+    }
+    req_headers_free(&((*request_template)->headers));
+    free((*request_template)->request_line_start);
+    free((*request_template)->host_line);
+    free(*request_template);
+    *request_template = NULL;
+}
+
+/*
+Send the request prepared in TEMPLATE, with PATH added to the base url and BODY as the body of the request.
+*/
+RequestsHandler* req_send_prepared(const RequestsTemplate* request_template, RequestsHandler* handler, const char* path, const char* body, size_t body_length)
+{
+    char content_length[30];
+    size_t path_length = strlen(path);
+    size_t uri_length;
+    size_t content_length_length;
+    size_t headers_length;
+    bool add_slash = request_template->empty_base_uri && path[0] != '/';  // the uri must start with a '/'
+    bool expect_continue = expects_continue(request_template->config, body_length);
+    unsigned int attempt = 1;
+    rh_milliseconds delay;
+    char method[16];
+    size_t method_length;
+    char* headers;
+    char* writer;
+
+    if(request_template->config != NULL && path_length > request_template->config->max_url_length)
+    {
+        req_close_connection(&handler);
+        return NULL;
+    }
+
+    rh_uint64_to_str(content_length, body_length);
+    content_length_length = strlen(content_length);
+
+    headers_length = request_template->request_line_start_length + (add_slash ? 1 : 0) + path_length + request_template->host_line_length + content_length_length
+        + sizeof("\r\n") - 1 + request_template->headers->block_length + body_length;
+    if(expect_continue)
+    {
+        headers_length += sizeof(EXPECT_CONTINUE_LINE) - 1;
+    }
+
+    headers = (char*) malloc((headers_length + 1) * sizeof(char));
+    if(headers == NULL)
+    {
+        req_close_connection(&handler);
+        return NULL;
+    }
+
+    memcpy(headers, request_template->request_line_start, request_template->request_line_start_length);
+    writer = headers + request_template->request_line_start_length;
+    if(add_slash)
+    {
+        *writer = '/';
+        writer++;
+    }
+    memcpy(writer, path, path_length);
+    writer += path_length;
+    uri_length = (size_t)(writer - headers);
+    memcpy(writer, request_template->host_line, request_template->host_line_length);
+    writer += request_template->host_line_length;
+    memcpy(writer, content_length, content_length_length);
+    writer += content_length_length;
+    writer = rh_strcpy(writer, "\r\n");
+    if(expect_continue)
+    {
+        writer = rh_strcpy(writer, EXPECT_CONTINUE_LINE);
+    }
+    memcpy(writer, request_template->headers->block, request_template->headers->block_length);
+    writer += request_template->headers->block_length;
+    memcpy(writer, body, body_length);
+    writer[body_length] = '\0';
+
+    // the method is the first word of the request line, with its space
+    method_length = 0;
+    while(method_length < sizeof(method) - 2 && headers[method_length] != ' ')
+    {
+        method[method_length] = headers[method_length];
+        method_length++;
+    }
+    method[method_length] = ' ';
+    method[method_length+1] = '\0';
+
+    while(true)
+    {
+        last_failure = FAILURE_OTHER;
+        handler = exchange(request_template->config, handler, request_template->host, request_template->port, request_template->secured, headers, headers_length, expect_continue ? body_length : 0, request_template->is_head);
+
+        if(handler != NULL && is_redirect(handler->status_code))
+        {
+            // Redirections are rare, they take the slow path
+            rh_UrlSplitted url_splitted;
+            size_t path_end = uri_length - (method_length + 1);
+
+            rh_strncpy(url_splitted.host, request_template->host, RH_MAX_CHAR_ON_HOST+1);
+            url_splitted.port = request_template->port;
+            url_splitted.secured = request_template->secured;
+            url_splitted.uri = (char*) malloc((path_end + 1) * sizeof(char));
+            if(url_splitted.uri == NULL)
+            {
+                req_close_connection(&handler);
+                break;
+            }
+            memcpy(url_splitted.uri, headers + method_length + 1, path_end);
+            url_splitted.uri[path_end] = '\0';
+
+            handler = follow_redirects(request_template->config, handler, method, &url_splitted, body, body_length, request_template->headers);
+            rh_url_free(&url_splitted);
+        }
+
+        if(!should_retry(request_template->config, method, handler, attempt, &delay))
+        {
+            break;
+        }
+        rh_timer_sleep_ms(delay);
+        attempt++;
+    }
+
+    free(headers);
+    return handler;
+}
+
+/*
+Send the request to the server, without looking in the cache.
+*/
+static RequestsHandler* send_to_origin(RequestsConfig* config, RequestsHandler* handler, const char* method, const char* url, const char* data, size_t data_length, const RequestsHeaders* prepared_headers)
+{
+    rh_UrlSplitted url_splitted;
+    size_t headers_length = 0;
+    char* headers = NULL;
+    char* cached_url = NULL;
+    bool keep_method = false;
+    bool expect_continue;
+
+    if(!parse_url(config, url, &url_splitted))
+    {
+        req_close_connection(&handler);
+        return NULL;
+    }
+
+    if(config != NULL)
+    {
+        // the cache is keyed by the normalized url, with the port written out
+        char* normalized_url = build_url(&url_splitted);
+        if(normalized_url != NULL)
+        {
+            cached_url = find_permanent_redirect(config, normalized_url, &keep_method);
+            free(normalized_url);
+        }
+        if(cached_url != NULL && (keep_method || strcmp(method, "POST ") != 0))
+        {
+            // skip the round trip to the old location
+            rh_url_free(&url_splitted);
+            if(!parse_url(config, cached_url, &url_splitted))
+            {
+                free(cached_url);
+                req_close_connection(&handler);
+                return NULL;
+            }
+        }
+        free(cached_url);
+    }
+
+    expect_continue = expects_continue(config, data_length);
+    headers = build_request(method, &url_splitted, data, data_length, prepared_headers, expect_continue, &headers_length);
+    if(headers == NULL)
+    {
+        req_close_connection(&handler);
+        goto FREE;
+    }
+
+    handler = exchange(config, handler, url_splitted.host, url_splitted.port, url_splitted.secured, headers, headers_length, expect_continue ? data_length : 0, strcmp(method, "HEAD ") == 0);
+    free(headers);
+    if(handler != NULL)
+    {
+        handler = follow_redirects(config, handler, method, &url_splitted, data, data_length, prepared_headers);
+    }
+
+FREE:
+    rh_url_free(&url_splitted);
+    return handler;
+}
+
+/*
+Returns the number of seconds during which a response stays fresh, according to its CACHE_CONTROL and AGE headers (both can be NULL).
+0 means that the response must be revalidated each time. If the response must not be stored, it returns -1.
+*/
+static int64_t cache_lifetime(const char* cache_control, const char* age, bool has_validator)
+{
+    int64_t lifetime = -1;
+    bool no_cache = false;
+
+    if(cache_control != NULL)
+    {
+        if(rh_str_search_case_unsensitive(cache_control, "no-store") != -1)
+        {
+            return -1;
+        }
+        no_cache = rh_str_search_case_unsensitive(cache_control, "no-cache") != -1;
+        long long max_age_index = rh_str_search_case_unsensitive(cache_control, "max-age=");
+        if(max_age_index != -1)
+        {
+            uint64_t max_age = leading_uint64(cache_control + max_age_index + sizeof("max-age=") - 1);
+            lifetime = max_age > INT32_MAX ? INT32_MAX : (int64_t)max_age;
+        }
+    }
+
+    if(no_cache || lifetime < 0)
+    {
+        // the response can only be used after a revalidation
+        return has_validator ? 0 : -1;
+    }
+    if(age != NULL)
+    {
+        uint64_t age_value = rh_str_to_uint64(age);
+        lifetime = age_value >= (uint64_t)lifetime ? 0 : lifetime - (int64_t)age_value;
+    }
+    return lifetime;
+}
+
+static bool add_entry_header(const char* name, const char* value, void* entry)
+{
+    return rh_cache_entry_add_header((rh_CacheEntry*)entry, name, value);
+}
+
+static bool add_tree_header(const char* name, const char* value, void* tree)
+{
+    return rh_ptree_update_key((rh_ParserTree*)tree, name, strlen(name)+1)
+        && rh_ptree_update_value((rh_ParserTree*)tree, value, strlen(value)+1)
+        && rh_ptree_push((rh_ParserTree*)tree, NULL);
+}
+
+/*
+Give the response stored in ENTRY to HANDLER, or to a new handler if HANDLER is NULL.
+The connection of HANDLER is kept for the next request. This takes the reference of ENTRY.
+*/
+static RequestsHandler* serve_entry(RequestsHandler* handler, rh_CacheEntry* entry)
+{
+    char trash_buffer[2048];
+    size_t body_size;
+
+    if(handler == NULL)
+    {
+        handler = (RequestsHandler*) calloc(1, sizeof(RequestsHandler));
+        if(handler == NULL)
+        {
+            rh_cache_entry_release(&entry);
+            return NULL;
+        }
+    }
+    else
+    {
+        // the previous response must leave the connection before the next request
+        while(req_read_output_body(handler, trash_buffer, 2048) > 0)
+        {
+            ;
+        }
+        if(handler->read_failed || !handler->reusable || handler->receive_start != handler->receive_end)
+        {
+            close_transport(handler);
+        }
+        rh_ptree_free(&(handler->headers_tree));
+        rh_cache_entry_release(&(handler->body_entry));
+    }
+
+    handler->headers_tree = rh_ptree_init();
+    if(handler->headers_tree == NULL || !rh_cache_entry_foreach_header(entry, add_tree_header, handler->headers_tree))
+    {
+        rh_cache_entry_release(&entry);
+        req_close_connection(&handler);
+        return NULL;
+    }
+
+    rh_cache_entry_body(entry, &body_size);
+    handler->status_code = rh_cache_entry_status_code(entry);
+    handler->body_entry = entry;
+    handler->body_offset = 0;
+    handler->total_bytes = (ssize_t)body_size;
+    handler->body_position = body_size;  // nothing is left on the connection
+    handler->bytes_read = 0;
+    handler->chunked = false;
+    handler->read_finished = false;
+    handler->read_failed = false;
+
+    return handler;
+}
+
+/*
+Read up to MAX_SIZE bytes of the body of HANDLER in a new entry, that is given back to the caller through req_read_output_body.
+If the whole body fits, ENTRY is set to this entry, otherwise the rest of the body is read from the connection after this part.
+It returns HANDLER, or NULL if a part of the body was lost.
+*/
+static RequestsHandler* buffer_response(RequestsHandler* handler, const char* key, int64_t expires_at, size_t max_size, rh_CacheEntry** entry)
+{
+    const char* content_length = req_get_header_value(handler, "content-length");
+    rh_CacheEntry* buffered;
+    const char* data;
+    size_t stored = 0;
+    size_t size;
+
+    *entry = NULL;
+    if(content_length != NULL && rh_str_to_uint64(content_length) > max_size)
+    {
+        // not worth reading it in advance
+        return handler;
+    }
+
+    buffered = rh_cache_entry_init(key, handler->status_code, expires_at);
+    if(buffered == NULL || !rh_ptree_foreach(handler->headers_tree, add_entry_header, buffered))
+    {
+        rh_cache_entry_release(&buffered);
+        return handler;
+    }
+
+    while(stored <= max_size && (size = next_body_slice(handler, &data)) > 0)
+    {
+        if(!rh_cache_entry_append_body(buffered, data, size))
+        {
+            rh_cache_entry_release(&buffered);
+            req_close_connection(&handler);
+            return NULL;
+        }
+        stored += size;
+    }
+
+    if(stored <= max_size && !handler->read_failed)
+    {
+        *entry = buffered;
+    }
+
+    handler->body_entry = buffered;
+    handler->body_offset = 0;
+    return handler;
+}
+
+/*
+Read the body of the response in HANDLER and store it under KEY if it isn't too big.
+*/
+static RequestsHandler* store_response(rh_ResponseCache* cache, RequestsHandler* handler, const char* key, int64_t expires_at)
+{
+    rh_CacheEntry* entry;
+    handler = buffer_response(handler, key, expires_at, rh_cache_max_entry_size(cache), &entry);
+    if(entry != NULL)
+    {
+        rh_cache_put(cache, entry);
+    }
+    return handler;
+}
+
+/*
+Build the key of a GET request in the cache: the url and the headers, because they can change the response.
+*/
+static char* build_cache_key(const char* url, const RequestsHeaders* prepared_headers)
+{
+    size_t url_length = strlen(url);
+    char* key = (char*) malloc((url_length + 2 + prepared_headers->block_length) * sizeof(char));
+    if(key == NULL)
+    {
+        return NULL;
+    }
+    memcpy(key, url, url_length);
+    key[url_length] = '\n';
+    memcpy(key + url_length + 1, prepared_headers->block, prepared_headers->block_length);
+    key[url_length + 1 + prepared_headers->block_length] = '\0';
+    return key;
+}
+
+/*
+Send a GET request through the cache of CONFIG.
+A fresh stored response is served without contacting the server, a stale one is revalidated with a conditional request.
+*/
+static RequestsHandler* send_cached_request(RequestsConfig* config, RequestsHandler* handler, const char* url, const RequestsHeaders* prepared_headers)
+{
+    rh_ResponseCache* cache = config->cache->responses;
+    rh_CacheEntry* entry = NULL;
+    int64_t now = (int64_t)time(NULL);
+    int64_t lifetime;
+    char* key = build_cache_key(url, prepared_headers);
+    if(key == NULL)
+    {
+        req_close_connection(&handler);
+        return NULL;
+    }
+
+    entry = rh_cache_get(cache, key);
+    if(entry != NULL && now < rh_cache_entry_expires_at(entry))
+    {
+        free(key);
+        return serve_entry(handler, entry);
+    }
+
+    if(entry != NULL)
+    {
+        const char* etag = rh_cache_entry_header(entry, "etag");
+        const char* last_modified = rh_cache_entry_header(entry, "last-modified");
+        RequestsHeaders conditional_headers;
+        char* writer;
+
+        conditional_headers.block_length = prepared_headers->block_length
+            + (etag != NULL ? sizeof("If-None-Match: \r\n") - 1 + strlen(etag) : 0)
+            + (last_modified != NULL ? sizeof("If-Modified-Since: \r\n") - 1 + strlen(last_modified) : 0);
+        conditional_headers.block = (char*) malloc((conditional_headers.block_length + 1) * sizeof(char));
+        if(conditional_headers.block == NULL)
+        {
+            req_close_connection(&handler);
+            goto FREE;
+        }
+        writer = conditional_headers.block;
+        if(etag != NULL)
+        {
+            writer = rh_strcpy(rh_strcpy(rh_strcpy(writer, "If-None-Match: "), etag), "\r\n");
+        }
+        if(last_modified != NULL)
+        {
+            writer = rh_strcpy(rh_strcpy(rh_strcpy(writer, "If-Modified-Since: "), last_modified), "\r\n");
+        }
+        memcpy(writer, prepared_headers->block, prepared_headers->block_length);
+
+        handler = send_to_origin(config, handler, "GET ", url, "", 0, &conditional_headers);
+        free(conditional_headers.block);
+    }
+    else
+    {
+        handler = send_to_origin(config, handler, "GET ", url, "", 0, prepared_headers);
+    }
+    if(handler == NULL)
+    {
+        goto FREE;
+    }
+
+    if(entry != NULL && handler->status_code == 304)
+    {
+        // not modified, the 304 can update the freshness of the stored response
+        const char* cache_control = req_get_header_value(handler, "cache-control");
+        lifetime = cache_lifetime(cache_control != NULL ? cache_control : rh_cache_entry_header(entry, "cache-control"), req_get_header_value(handler, "age"), true);
+        if(lifetime > 0)
+        {
+            rh_CacheEntry* refreshed = rh_cache_entry_copy(entry, now + lifetime);
+            if(refreshed != NULL)
+            {
+                rh_cache_put(cache, refreshed);
+                rh_cache_entry_release(&entry);
+                entry = refreshed;
+            }
+        }
+        handler = serve_entry(handler, entry);
+        entry = NULL;
+    }
+    else if(handler->status_code == 200 && req_get_header_value(handler, "vary") == NULL)
+    {
+        bool has_validator = req_get_header_value(handler, "etag") != NULL || req_get_header_value(handler, "last-modified") != NULL;
+        lifetime = cache_lifetime(req_get_header_value(handler, "cache-control"), req_get_header_value(handler, "age"), has_validator);
+        if(lifetime >= 0)
+        {
+            handler = store_response(cache, handler, key, now + lifetime);
+        }
+        else if(entry != NULL)
+        {
+            rh_cache_remove(cache, key);
+        }
+    }
+
+FREE:
+    rh_cache_entry_release(&entry);
+    free(key);
+    return handler;
+}
+
+/*
+Send the request through the cache of CONFIG if it has one.
+*/
+static RequestsHandler* send_uncoalesced_request(RequestsConfig* config, RequestsHandler* handler, const char* method, const char* url, const char* data, size_t data_length, const RequestsHeaders* prepared_headers)
+{
+    if(config != NULL && config->cache != NULL && strcmp(method, "GET ") == 0)
+    {
+        return send_cached_request(config, handler, url, prepared_headers);
+    }
+    return send_to_origin(config, handler, method, url, data, data_length, prepared_headers);
+}
+
+/*
+Find the value of the header NAME (in lowercase) in the serialized headers BLOCK.
+If there is none, it returns NULL.
+*/
+static const char* find_block_header(const char* block, size_t block_length, const char* name, size_t* value_length)
+{
+    const char* end = block + block_length;
+    const char* line = block;
+    while(line < end)
+    {
+        const char* line_end = (const char*) memchr(line, '\n', (size_t)(end - line));
+        if(line_end == NULL)
+        {
+            return NULL;
+        }
+        const char* colon = (const char*) memchr(line, ':', (size_t)(line_end - line));
+        if(colon != NULL && header_name_equals(line, (size_t)(colon - line), name))
+        {
+            const char* value = colon + 1;
+            while(*value == ' ' || *value == '\t')
+            {
+                value++;
+            }
+            *value_length = (size_t)(line_end - value);
+            if(*value_length > 0 && value[*value_length - 1] == '\r')
+            {
+                (*value_length)--;
+            }
+            return value;
+        }
+        line = line_end + 1;
+    }
+    return NULL;
+}
+
+/*
+Build the key of a request in the single-flight group: the method, the url and all the headers, because they can change the response.
+*/
+static char* build_flight_key(const char* method, const char* url, const RequestsHeaders* prepared_headers)
+{
+    size_t method_length = strlen(method);
+    size_t url_length = strlen(url);
+    char* key = (char*) malloc((method_length + url_length + 2 + prepared_headers->block_length) * sizeof(char));
+    if(key == NULL)
+    {
+        return NULL;
+    }
+    memcpy(key, method, method_length);
+    memcpy(key + method_length, url, url_length);
+    key[method_length + url_length] = '\n';
+    memcpy(key + method_length + url_length + 1, prepared_headers->block, prepared_headers->block_length);
+    key[method_length + url_length + 1 + prepared_headers->block_length] = '\0';
+    return key;
+}
+
+/*
+Returns true if the response depends on a state of the client, given by a Range or a conditional header.
+Such requests are always sent on their own: a download in parts sends many of them at the same time.
+*/
+static bool has_client_state(const RequestsHeaders* prepared_headers)
+{
+    static const char* const names[] = {"range", "if-range", "if-none-match", "if-modified-since", "if-match", "if-unmodified-since"};
+    size_t value_length;
+    for(size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        if(find_block_header(prepared_headers->block, prepared_headers->block_length, names[i], &value_length) != NULL)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+Remove a reference to FLIGHT and free it if it was the last one.
+The single-flight group must be locked.
+*/
+static void release_flight(Flight* flight)
+{
+    flight->references--;
+    if(flight->references == 0)
+    {
+        rh_cache_entry_release(&(flight->response));
+        pthread_cond_destroy(&(flight->finished_cond));
+        free(flight->key);
+        free(flight);
+    }
+}
+
+/*
+If the same request is already in flight, wait for its response and share it. Otherwise, send it and share its response with the requests that come meanwhile.
+*/
+static RequestsHandler* send_coalesced_request(RequestsConfig* config, RequestsHandler* handler, const char* method, const char* url, const RequestsHeaders* prepared_headers)
+{
+    RequestsSingleFlight* single_flight = config->single_flight;
+    rh_CacheEntry* response = NULL;
+    Flight* flight;
+    char* key = build_flight_key(method, url, prepared_headers);
+    if(key == NULL)
+    {
+        req_close_connection(&handler);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&(single_flight->lock));
+    flight = single_flight->flights;
+    while(flight != NULL && strcmp(flight->key, key) != 0)
+    {
+        flight = flight->next;
+    }
+
+    if(flight != NULL)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += (time_t)(single_flight->max_wait_time / 1000);
+        deadline.tv_nsec += (long)(single_flight->max_wait_time % 1000) * 1000 * 1000;
+        if(deadline.tv_nsec >= 1000 * 1000 * 1000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000 * 1000 * 1000;
+        }
+
+        free(key);
+        flight->references++;
+        while(!flight->finished && pthread_cond_timedwait(&(flight->finished_cond), &(single_flight->lock), &deadline) != ETIMEDOUT)
+        {
+            ;
+        }
+        response = flight->response;
+        if(response != NULL)
+        {
+            rh_cache_entry_retain(response);
+        }
+        release_flight(flight);
+        pthread_mutex_unlock(&(single_flight->lock));
+
+        if(response != NULL)
+        {
+            return serve_entry(handler, response);
+        }
+        // the response couldn't be shared, or it was too long to come
+        return send_uncoalesced_request(config, handler, method, url, "", 0, prepared_headers);
+    }
+
+    flight = (Flight*) malloc(sizeof(Flight));
+    if(flight == NULL || pthread_cond_init(&(flight->finished_cond), NULL) != 0)
+    {
+        pthread_mutex_unlock(&(single_flight->lock));
+        free(flight);
+        free(key);
+        return send_uncoalesced_request(config, handler, method, url, "", 0, prepared_headers);
+    }
+    flight->key = key;
+    flight->finished = false;
+    flight->response = NULL;
+    flight->references = 1;
+    flight->next = single_flight->flights;
+    single_flight->flights = flight;
+    pthread_mutex_unlock(&(single_flight->lock));
+
+    handler = send_uncoalesced_request(config, handler, method, url, "", 0, prepared_headers);
+    if(handler != NULL)
+    {
+        handler = buffer_response(handler, key, 0, single_flight->max_body_size, &response);
+    }
+
+    pthread_mutex_lock(&(single_flight->lock));
+    Flight** link = &(single_flight->flights);
+    while(*link != flight)
+    {
+        link = &((*link)->next);
+    }
+    *link = flight->next;  // the next identical requests start a new flight
+    if(response != NULL)
+    {
+        rh_cache_entry_retain(response);
+        flight->response = response;
+    }
+    flight->finished = true;
+    pthread_cond_broadcast(&(flight->finished_cond));
+    release_flight(flight);
+    pthread_mutex_unlock(&(single_flight->lock));
+
+    return handler;
+}
+
+/*
+Send the request once, through the single-flight group of CONFIG if it has one.
+*/
+static RequestsHandler* send_once(RequestsConfig* config, RequestsHandler* handler, const char* method, const char* url, const char* data, size_t data_length, const RequestsHeaders* prepared_headers)
+{
+    if(config != NULL && config->single_flight != NULL && data_length == 0 && (strcmp(method, "GET ") == 0 || strcmp(method, "HEAD ") == 0)
+        && !has_client_state(prepared_headers))
+    {
+        return send_coalesced_request(config, handler, method, url, prepared_headers);
+    }
+    return send_uncoalesced_request(config, handler, method, url, data, data_length, prepared_headers);
+}
+
+static inline bool is_idempotent(const char* method)
+{
+    return strcmp(method, "GET ") == 0 || strcmp(method, "HEAD ") == 0 || strcmp(method, "PUT ") == 0
+        || strcmp(method, "DELETE ") == 0 || strcmp(method, "OPTIONS ") == 0 || strcmp(method, "TRACE ") == 0;
+}
+
+static inline bool is_retry_status(const RetryPolicy* policy, unsigned short int status_code)
+{
+    if(status_code < MIN_HTTP_STATUS || status_code > MAX_HTTP_STATUS)
+    {
+        return false;
+    }
+    return (policy->retry_statuses[(status_code - MIN_HTTP_STATUS) / 64] >> ((status_code - MIN_HTTP_STATUS) % 64)) & 1;
+}
+
+/*
+xorshift64, seeded once per thread. It only spreads the retries, it doesn't need to be unpredictable.
+*/
+static uint64_t next_jitter(void)
+{
+    if(jitter_state == 0)
+    {
+        jitter_state = rh_timer_now() ^ (uint64_t)(uintptr_t)&jitter_state;
+        if(jitter_state == 0)
+        {
+            jitter_state = 1;
+        }
+    }
+    jitter_state ^= jitter_state << 13;
+    jitter_state ^= jitter_state >> 7;
+    jitter_state ^= jitter_state << 17;
+    return jitter_state;
+}
+
+/*
+Add the reward of a request that didn't need a retry to the retry budget of CONFIG.
+*/
+static void deposit_retry_budget(RequestsConfig* config)
+{
+    size_t budget = __atomic_load_n(&(config->retry_budget), __ATOMIC_RELAXED);
+    size_t new_budget;
+    do {
+        if(budget >= config->retry.budget_max)
+        {
+            return;
+        }
+        new_budget = min_size_t(budget + config->retry.budget_deposit, config->retry.budget_max);
+    } while(!__atomic_compare_exchange_n(&(config->retry_budget), &budget, new_budget, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/*
+Take the cost of a retry from the retry budget of CONFIG.
+Returns false if the budget is exhausted, because most of the recent requests needed a retry.
+*/
+static bool withdraw_retry_budget(RequestsConfig* config)
+{
+    size_t budget = __atomic_load_n(&(config->retry_budget), __ATOMIC_RELAXED);
+    do {
+        if(budget < MILLI_TOKENS)
+        {
+            return false;
+        }
+    } while(!__atomic_compare_exchange_n(&(config->retry_budget), &budget, budget - MILLI_TOKENS, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
+/*
+Decide if the attempt number ATTEMPT must be retried, according to the retry policy of CONFIG.
+HANDLER is the response of the attempt, or NULL if it failed. If it returns true, DELAY is set to the time to wait before the next attempt.
+*/
+static bool should_retry(RequestsConfig* config, const char* method, RequestsHandler* handler, unsigned int attempt, rh_milliseconds* delay)
+{
+    const RetryPolicy* policy;
+    bool idempotent = is_idempotent(method);
+    rh_milliseconds backoff;
+
+    if(config == NULL || config->retry.max_attempts <= 1)
+    {
+        return false;
+    }
+    policy = &(config->retry);
+
+    if(handler != NULL && !is_retry_status(policy, handler->status_code))
+    {
+        deposit_retry_budget(config);
+        return false;
+    }
+    if(handler != NULL && !idempotent && !policy->retry_non_idempotent)
+    {
+        return false;
+    }
+    if(handler == NULL)
+    {
+        if(last_failure == FAILURE_NOT_SENT && !policy->retry_connection_errors)
+        {
+            return false;
+        }
+        if(last_failure == FAILURE_NO_RESPONSE && (!policy->retry_network_errors || (!idempotent && !policy->retry_non_idempotent)))
+        {
+            return false;
+        }
+        if(last_failure == FAILURE_OTHER)
+        {
+            return false;
+        }
+    }
+    if(attempt >= policy->max_attempts)
+    {
+        return false;
+    }
+
+    // exponential backoff with full jitter
+    backoff = attempt - 1 >= 32 ? policy->max_backoff : policy->base_backoff << (attempt - 1);
+    if(backoff > policy->max_backoff || backoff < policy->base_backoff)
+    {
+        backoff = policy->max_backoff;
+    }
+    *delay = backoff == 0 ? 0 : next_jitter() % (backoff + 1);
+
+    if(handler != NULL)
+    {
+        const char* retry_after = req_get_header_value(handler, "retry-after");
+        if(retry_after != NULL && RH_CHAR_IS_DIGIT(retry_after[0]))
+        {
+            uint64_t seconds = rh_str_to_uint64(retry_after);
+            if(seconds > policy->max_backoff / 1000)
+            {
+                // the server wants us to wait longer than allowed, give its answer to the caller
+                return false;
+            }
+            if(seconds * 1000 > *delay)
+            {
+                *delay = seconds * 1000;
+            }
+        }
+    }
+
+    return withdraw_retry_budget(config);
+}
+
+/*
+Send the request, and send it again as long as the retry policy of CONFIG allows it.
+*/
+static RequestsHandler* send_request(RequestsConfig* config, RequestsHandler* handler, const char* method, const char* url, const char* data, size_t data_length, const RequestsHeaders* prepared_headers)
+{
+    unsigned int attempt = 1;
+    rh_milliseconds delay;
+
+    while(true)
+    {
+        last_failure = FAILURE_OTHER;
+        handler = send_once(config, handler, method, url, data, data_length, prepared_headers);
+        if(!should_retry(config, method, handler, attempt, &delay))
+        {
+            return handler;
+        }
+        // a retried response is drained by the next attempt, so its connection can be reused
+        rh_timer_sleep_ms(delay);
+        attempt++;
+    }
+}
+
+/*
+Returns the status code of the status LINE "HTTP/1.1 CODE MESSAGE", or 0 if it's not a status line.
+*/
+static unsigned short parse_status(const char* line, size_t length)
+{
+    size_t k = 0;
+    unsigned short status_code = 0;
+    int l = 0;
+
+    if(length < sizeof("HTTP/") - 1 || memcmp(line, "HTTP/", sizeof("HTTP/") - 1) != 0)
+    {
+        return 0;
+    }
+
+    while(k < length && line[k] != ' ')
+        k++;
+    if(k < length)
+        k++;
+    while(l < 3 && k < length && RH_CHAR_IS_DIGIT(line[k]))
+    {
+        status_code = (unsigned short)(status_code * 10 + (unsigned short)(line[k] - '0'));
+        l++;
+        k++;
+    }
+    return status_code;
+}
+
+static inline bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/*
+Read and parse the headers of the response.
+Each line is parsed where it was received. If a line doesn't fit in the receive buffer, the buffer grows, so it's never parsed in several parts.
+It fails if the headers are bigger than the limit of the connection.
+RECEIVED is set to true if at least one byte of the response arrived, so a connection closed before the server read the request can be told apart from a truncated response.
+*/
+static bool req_parse_headers(RequestsHandler* handler, bool* received)
+{
+    if(handler->headers_tree != NULL)
+        return 1;
+
+    size_t headers_size = 0;
+    size_t scanned = 0;  /* the bytes after receive_start that are known to have no end of line */
+    bool status_line = true;
+
+    handler->headers_tree = rh_ptree_init();
+    if(handler->headers_tree == NULL)
+        return false;
+    *received = handler->receive_start < handler->receive_end;
+
+    while(true)
+    {
+        size_t available = handler->receive_end - handler->receive_start;
+        char* line = NULL;
+        char* line_end = NULL;
+
+        if(available > scanned)
+        {
+            line = &(handler->receive_buffer[handler->receive_start]);
+            line_end = (char*) memchr(line + scanned, '\n', available - scanned);
+        }
+
+        if(line_end == NULL)
+        {
+            if(headers_size + available >= handler->max_headers_size)
+            {
+                return false;
+            }
+            scanned = available;
+            if(fill_receive_buffer(handler, handler->max_headers_size) <= 0)
+            {
+                // The connection was closed before the end of the headers
+                return false;
+            }
+            *received = true;
+            continue;
+        }
+
+        size_t line_length = (size_t)(line_end - line);
+        handler->receive_start += line_length + 1;
+        headers_size += line_length + 1;
+        scanned = 0;
+        while(line_length > 0 && is_blank(line[line_length - 1]))
+            line_length--;
+
+        if(status_line)
+        {
+            if(line_length > 0)
+            {
+                // This is meant to happen with the first line "HTTP/1.1 ERROR_CODE MSG"
+                handler->status_code = parse_status(line, line_length);
+                status_line = false;
+            }
+            continue;
+        }
+        if(line_length == 0)
+        {
+            // The empty line at the end of the headers
+            if(handler->status_code >= 100 && handler->status_code < 200 && handler->status_code != 101 && !handler->awaiting_continue)
+            {
+                // An interim response, like 100 Continue or 103 Early Hints, the final one follows
+                rh_ptree_free(&(handler->headers_tree));
+                handler->headers_tree = rh_ptree_init();
+                if(handler->headers_tree == NULL)
+                    return false;
+                handler->status_code = 0;
+                status_line = true;
+                continue;
+            }
+            return true;
+        }
+
+        char* colon = (char*) memchr(line, ':', line_length);
+        if(colon == NULL)
+        {
+            // not a header
+            continue;
         }
-        else
+        size_t key_length = (size_t)(colon - line);
+        const char* value = colon + 1;
+        while(key_length > 0 && is_blank(line[key_length - 1]))
+            key_length--;
+        while(value < line + line_length && is_blank(*value))
+            value++;
+
+        if(!rh_ptree_update_key(handler->headers_tree, line, key_length + 1)
+            || !rh_ptree_update_value(handler->headers_tree, value, (size_t)(line + line_length - value) + 1)
+            || !rh_ptree_push(handler->headers_tree, NULL))
         {
-            uint64_t tot_bytes = rh_str_to_uint64(response_content_length);
-            if(tot_bytes > INT64_MAX)
+            return false;
+        }
+    }
+}
+
+/*
+Returns the HTTP status code of the page
+*/
+unsigned short int req_get_status_code(RequestsHandler* handler)
+{
+    return handler->status_code;
+}
+
+/*
+Returns the value of a specific header.
+If HEADER_NAME is not in the server response headers, it returns NULL.
+If you have to modify this value, copy it before.
+*/
+const char* req_get_header_value(RequestsHandler* handler, const char* header_name)
+{
+    return rh_ptree_get_value(handler->headers_tree, header_name);
+}
+
+/*
+This display all headers in server response.
+Used for debug purpose.
+*/
+void req_display_headers(RequestsHandler* handler)
+{
+    printf("STATUS CODE: %hu\n\n", handler->status_code);
+    rh_ptree_display(handler->headers_tree);
+}
+
+static ssize_t get_chunk_size(RequestsHandler* handler, char c)
+{
+    int* i = &(handler->chunk_length_index);
+    char* length = handler->chunk_length;
+
+    if(*i >= 32)
+    {
+        *i = 0;
+        return -1;
+    }
+
+    if(RH_CHAR_IS_HEXDIGIT(c))
+    {
+        length[*i] = c;
+        (*i)++;
+    }
+    else if(c == '\r')
+    {
+        if(*i == 0)
+        {
+            return -1;
+        }
+        length[*i] = '\0';
+        (*i)++;
+    }
+    else if(c == '\n' && *i != 0)
+    {
+        length[*i] = '\0';
+        *i = 0;
+        uint64_t len = rh_hex_to_uint64(length);
+        if(len > INT64_MAX)
+        {
+            return -1;
+        }
+        return (ssize_t)len;
+    }
+    return -1;
+}
+
+/*
+Returns true if the last reception failed only because the non-blocking socket had nothing to give.
+*/
+static inline bool would_block(const RequestsHandler* handler)
+{
+    return handler->nonblocking && (handler->waiting == RH_SOCKET_WANT_READ || handler->waiting == RH_SOCKET_WANT_WRITE);
+}
+
+static size_t start_chunk_read(RequestsHandler* handler, char* buffer, size_t bytes_in_buffer, size_t buffer_size)
+{
+    size_t offset = 0;
+    handler->total_bytes = -1;
+    while(handler->total_bytes == -1)
+    {
+        while(handler->total_bytes == -1 && offset < bytes_in_buffer)
+        {
+            handler->total_bytes = get_chunk_size(handler, buffer[offset]);
+            (offset)++;
+        }
+        if(handler->total_bytes == -1)
+        {
+            ssize_t read = req_read_output(handler, buffer, buffer_size);
+            if(read <= 0 && would_block(handler))
             {
-                goto ERROR;
+                // the size of the chunk is kept in the handler until the rest arrives
+                return 0;
             }
-            handler->total_bytes = (ssize_t)tot_bytes;
-            handler->chunked = 0;
+            if(read <= 0)
+            {
+                handler->read_finished = true;
+                handler->read_failed = true;
+                return 0;
+            }
+            bytes_in_buffer = (size_t)read;
+            offset = 0;
+        }
+    }
+
+    if(handler->total_bytes == 0)
+    {
+        // That was the last one
+        handler->read_finished = 1;
+        return 0;
+    }
+    if(bytes_in_buffer <= 0)
+    {
+        return bytes_in_buffer;
+    }
+    if(bytes_in_buffer > offset)
+    {
+        bytes_in_buffer -= offset;
+    }
+    else
+    {
+        bytes_in_buffer = 0;
+    }
+    memmove(buffer, &(buffer[offset]), bytes_in_buffer);
+    handler->body_position = bytes_in_buffer;
+
+
+    if((ssize_t)bytes_in_buffer > handler->total_bytes && bytes_in_buffer > 0)
+    {
+        size_t chunk_size = 0;
+        if(handler->total_bytes > 0)
+        {
+            chunk_size = (size_t)handler->total_bytes;
+        }
+        bytes_in_buffer = chunk_size + start_chunk_read(handler, buffer + chunk_size, bytes_in_buffer - chunk_size, buffer_size - chunk_size);
+    }
+
+    return bytes_in_buffer;
+}
+
+
+/*
+    Fill BUFFER with the body of the response in HANDLER, without counting the bytes given to the caller.
+    Returns the number of bytes read
+*/
+static size_t read_output_body(RequestsHandler* handler, char* buffer, size_t buffer_size)
+{
+    ssize_t read = 0;
+    size_t size = 0;
+    bool new_chunk = false;
+
+    if(handler->body_entry != NULL)
+    {
+        size_t body_size;
+        const char* body = rh_cache_entry_body(handler->body_entry, &body_size);
+        size = min_size_t(buffer_size, body_size - handler->body_offset);
+        memcpy(buffer, body + handler->body_offset, size);
+        handler->body_offset += size;
+        if(handler->body_offset == body_size)
+        {
+            rh_cache_entry_release(&(handler->body_entry));
+        }
+        if(size > 0 && size < buffer_size)
+        {
+            // the rest of the response, if any, comes from the connection
+            return size + read_output_body(handler, &(buffer[size]), buffer_size - size);
+        }
+        if(size > 0)
+        {
+            return size;
         }
     }
 
-    const char* location = rh_ptree_get_value(handler->headers_tree, "location");
-    if(location != NULL)
+    if(handler->read_finished)
+    {
+        return 0;
+    }
+    if(handler->total_bytes > (ssize_t)handler->body_position)
+    {
+        size_t n = min_size_t(buffer_size, (size_t)handler->total_bytes - handler->body_position);
+        read = req_read_output(handler, buffer, n);
+        if(read <= 0 && would_block(handler))
+        {
+            return 0;
+        }
+        if(read <= 0)
+        {
+            handler->read_finished = true;
+            handler->read_failed = true;
+            return 0;
+        }
+        size = (size_t)read;
+        handler->body_position += size;
+    }
+    else if(handler->chunked)
     {
-        char temp_url[2*RH_MAX_URI_LENGTH];
-        char location_url[2*RH_MAX_URI_LENGTH];
-        char port_str[8] = "";
-        char protocol[] = "https://";
-        size_t n;
-        if(rh_startswith(location, "http://") || rh_startswith(location, "https://"))
+        new_chunk = true;
+        read = req_read_output(handler, buffer, buffer_size);
+        if(read <= 0 && would_block(handler))
+        {
+            return 0;
+        }
+        if(read <= 0)
         {
-            return req_request(config, handler, method, location, data, additional_headers);
+            handler->read_finished = true;
+            handler->read_failed = true;
+            return 0;
         }
+        size = (size_t)read;
+    }
+
+    if(size <= 0)
+    {
+        return size;
+    }
 
-        n = strlen(url_splitted.uri);
-        while(n > 0 && url_splitted.uri[n] != '/')
+    if(handler->chunked)
+    {
+        if(new_chunk)
         {
-            n--;
+            size = start_chunk_read(handler, buffer, size, buffer_size);
         }
-        url_splitted.uri[n] = '\0';
+    }
+    if(size < buffer_size)
+    {
+        return size + read_output_body(handler, &(buffer[size]), buffer_size - size);
+    }
+    return size;
+}
 
-        if((url_splitted.secured && url_splitted.port != 443) || (!url_splitted.secured && url_splitted.port != 80))
+/*
+Give the next part of the body of HANDLER without copying it: DATA points into the stored entry or into the receive buffer, and stays valid until the next read.
+Returns the number of bytes, 0 at the end of the body, if it failed or if a non-blocking socket has nothing to give.
+*/
+static size_t next_body_slice(RequestsHandler* handler, const char** data)
+{
+    if(handler->body_entry != NULL)
+    {
+        size_t body_size;
+        const char* body = rh_cache_entry_body(handler->body_entry, &body_size);
+        if(handler->body_offset < body_size)
         {
-            port_str[0] = ':';
-            rh_uint64_to_str(port_str+1, url_splitted.port);
+            *data = body + handler->body_offset;
+            size_t size = body_size - handler->body_offset;
+            handler->body_offset = body_size;
+            return size;
         }
-        if(!url_splitted.secured)
+        // the rest of the response, if any, comes from the connection
+        rh_cache_entry_release(&(handler->body_entry));
+    }
+
+    while(!handler->read_finished)
+    {
+        if(handler->receive_start == handler->receive_end && (handler->total_bytes > (ssize_t)handler->body_position || handler->chunked))
         {
-            rh_strcpy(protocol, "http://");
+            if(fill_receive_buffer(handler, handler->receive_capacity) <= 0)
+            {
+                if(!would_block(handler))
+                {
+                    handler->read_finished = true;
+                    handler->read_failed = true;
+                }
+                return 0;
+            }
         }
 
-        rh_strcpy(rh_strcpy(rh_strcpy(location_url, protocol), url_splitted.host), port_str);
+        if(handler->total_bytes > (ssize_t)handler->body_position)
+        {
+            size_t size = min_size_t((size_t)handler->total_bytes - handler->body_position, handler->receive_end - handler->receive_start);
+            *data = &(handler->receive_buffer[handler->receive_start]);
+            handler->receive_start += size;
+            handler->body_position += size;
+            return size;
+        }
+        if(!handler->chunked)
+        {
+            handler->read_finished = true;
+            return 0;
+        }
 
-        rh_path_join(temp_url, (size_t)(2 * RH_MAX_URI_LENGTH), 3, location_url, url_splitted.uri, location);
-        rh_simplify_path(location_url, temp_url);
-        return req_request(config, handler, method, location_url, data, additional_headers);
+        // between two chunks, the size line may arrive in several parts
+        ssize_t chunk_size = -1;
+        while(chunk_size == -1 && handler->receive_start < handler->receive_end)
+        {
+            chunk_size = get_chunk_size(handler, handler->receive_buffer[handler->receive_start]);
+            handler->receive_start++;
+        }
+        if(chunk_size == 0)
+        {
+            // That was the last one
+            handler->total_bytes = 0;
+            handler->read_finished = true;
+        }
+        else if(chunk_size > 0)
+        {
+            handler->total_bytes = chunk_size;
+            handler->body_position = 0;
+        }
     }
+    return 0;
+}
+/*
+    Skip the response header and fill the buffer with the server response
+    Returns the number of bytes read
+    Use this in a loop.
+    Note: This function reads binary data.
+    If you are getting text, use `sizeof(buffer)-1` for buffer_size and add an '\0' at the end of the read buffer.
+*/
+size_t req_read_output_body(RequestsHandler* handler, char* buffer, size_t buffer_size)
+{
+    assert(handler != NULL);
 
-    return handler;
+    size_t size = read_output_body(handler, buffer, buffer_size);
+    handler->bytes_read += size;
+    return size;
+}
 
-ERROR:
-    free(headers);
-    req_close_connection(&handler);
-    return NULL;
+
+typedef struct _sink_context {
+    const RequestsSink* sink;
+    void* user_data;
+} SinkContext;
+
+static bool sink_header(const char* key, const char* value, void* context)
+{
+    return (*((SinkContext*)context)->sink->on_header)(key, value, ((SinkContext*)context)->user_data);
 }
 
-static unsigned short parse_status(char* key_value, char keep_alive_read)
+/*
+    Push the status, the headers and the body of the response to the callbacks of SINK.
+    Returns false if the body couldn't be read entirely or if a callback aborted.
+*/
+bool req_stream_output(RequestsHandler* handler, const RequestsSink* sink, void* user_data)
 {
-    int k = 0;
-    char status_code[4];
-    int l = 0;
+    SinkContext context = {
+        .sink = sink,
+        .user_data = user_data
+    };
+    const char* data;
+    size_t size;
+
+    assert(handler != NULL);
 
-    if(!rh_startswith(key_value, "HTTP/") && (keep_alive_read != 'H' || !rh_startswith(key_value, "TTP/")))
+    if(sink->on_status != NULL && !(*sink->on_status)(handler->status_code, user_data))
     {
-        return 0;
+        return false;
+    }
+    if(sink->on_header != NULL && !rh_ptree_foreach(handler->headers_tree, sink_header, &context))
+    {
+        return false;
     }
 
-    // This is meant to happen with the first header "HTTP/1.1 ERROR_CODE MSG"
+    while((size = next_body_slice(handler, &data)) > 0)
+    {
+        handler->bytes_read += size;
+        if(sink->on_body != NULL && !(*sink->on_body)(data, size, user_data))
+        {
+            return false;
+        }
+    }
 
-    while(key_value[k] != '\0' && key_value[k] != ' ')
-        k++;
-    if(key_value[k] != '\0')
-        k++;
-    while(l < 3 && RH_CHAR_IS_DIGIT(key_value[k]))
+    return !handler->read_failed;
+}
+
+/*
+Start to connect HANDLER without blocking.
+A unix socket is connected at once or fails, it only has to be switched to the non-blocking mode.
+*/
+static rh_SocketHandler* start_socket(RequestsHandler* handler)
+{
+    if(handler->port != RH_UNIX_SOCKET_PORT)
+    {
+        return rh_socket_client_start(handler->host, handler->port, handler->secured, &(handler->socket_options));
+    }
+    rh_SocketHandler* s = connect_unix_socket(handler->host, 0);
+    if(s != NULL && !rh_socket_set_blocking(s, false))
     {
-        status_code[l] = key_value[k];
-        l++;
-        k++;
+        rh_socket_close(&s);
     }
-    status_code[l] = '\0';
-    return (unsigned short)rh_str_to_uint64(status_code);
+    return s;
 }
 
-
-static bool req_parse_headers(RequestsHandler* handler)
+/*
+Start a request that is then driven by req_request_continue, without blocking.
+The serialized request is kept in the handler until the response starts, to send it again if a reused connection turns out to be closed.
+*/
+RequestsHandler* req_request_start(RequestsConfig* config, const char* method, const char* url, const char* data, const char* additional_headers)
 {
-    if(handler->headers_tree != NULL)
-        return 1;
-
-    char buffer[PARSER_BUFFER_SIZE];
-    char key_value[PARSER_BUFFER_SIZE];
-
-    bool c_return = false;
-    int offset = -1;
-    ssize_t read = 0;
-    size_t size = 0;
-    bool in_value = false;
-    int j = 0;
+    rh_UrlSplitted url_splitted;
+    RequestsHeaders* prepared_headers = NULL;
+    RequestsHandler* handler = NULL;
+    char* request = NULL;
+    size_t request_length;
 
-    handler->headers_tree = rh_ptree_init();
+    if(config != NULL && !uses_sockets(&(config->transport)))
+    {
+        return NULL;
+    }
+    if(!parse_url(config, url, &url_splitted))
+    {
+        goto FREE;
+    }
+    prepared_headers = req_headers_prepare(additional_headers);
+    if(prepared_headers == NULL)
+    {
+        goto FREE;
+    }
+    request = build_request(method, &url_splitted, data, strlen(data), prepared_headers, false, &request_length);
+    if(request == NULL)
+    {
+        goto FREE;
+    }
 
-    while(offset == -1 && (read = req_read_output(handler, buffer, PARSER_BUFFER_SIZE)) > 0)
+    if(config != NULL && config->pool != NULL)
     {
-        size = (size_t)read;
-        size_t i = 0;
-        while(i < size && (buffer[i] != '\n' || !c_return))
+        char origin[ORIGIN_MAX_LENGTH];
+        build_origin(origin, url_splitted.host, url_splitted.port, url_splitted.secured);
+        while((handler = take_idle_connection(config->pool, origin)) != NULL
+            && (!same_transport(handler, config) || !idle_connection_usable(handler) || !rh_socket_set_blocking(handler->connection, false)))
         {
-            key_value[j] = '\0';
-
-            if(j == PARSER_BUFFER_SIZE-1)
-            {
-                char* trimmed = rh_strtrim_inplace(key_value);
-                if(in_value)
-                {
-                    if(rh_ptree_update_value(handler->headers_tree, trimmed, strlen(trimmed)+1) == 0)
-                        return false;
-                }
-                else
-                {
-                    if(rh_ptree_update_key(handler->headers_tree, trimmed, strlen(trimmed)+1) == 0)
-                        return false;
-                }
-                j = 0;
-                key_value[0] = '\0';
-            }
-            if(!in_value && buffer[i] == ':')
-            {
-                in_value = true;
-                char* trimmed = rh_strtrim_inplace(key_value);
-                if(rh_ptree_update_key(handler->headers_tree, trimmed, strlen(trimmed)+1) == 0)
-                    return false;
-                j = 0;
-            }
-            else if(buffer[i] == '\n')
-            {
-                c_return = true;
-                if(in_value)
-                {
-                    in_value = false;
-                    char* trimmed = rh_strtrim_inplace(key_value);
-                    if(rh_ptree_update_value(handler->headers_tree, trimmed, strlen(trimmed)+1) == 0)
-                        return false;
-                    if(rh_ptree_push(handler->headers_tree, NULL) == 0)
-                        return false;
-                }
-                else
-                {
-                    unsigned short status_code = parse_status(key_value, handler->keep_alive_read);
-                    if(status_code != 0)
-                    {
-                        handler->status_code = status_code;
-                    }
-                    rh_ptree_abort(handler->headers_tree);
-                }
-                j = 0;
-            }
-            else
-            {
-                if(buffer[i] >= '0')
-                    c_return = false;
-
-                key_value[j] = buffer[i];
-                j++;
-            }
+            // This one has expired or was opened by another transport, try the next one
+            destroy_handler(handler);
+        }
+    }
 
-            i++;
+    if(handler != NULL)
+    {
+        handler->reusable = false;
+        handler->pending_reused = true;
+        handler->async_state = ASYNC_SENDING;
+    }
+    else
+    {
+        handler = new_handler(config, url_splitted.host, url_splitted.port, url_splitted.secured);
+        if(handler == NULL)
+        {
+            goto FREE;
         }
-        if(i < size)
+        handler->connection = start_socket(handler);
+        if(handler->connection == NULL)
         {
-            offset = (int)i + 1;
+            destroy_handler(handler);
+            handler = NULL;
+            goto FREE;
         }
+        handler->async_state = ASYNC_CONNECTING;
     }
 
-    if(offset < 0)
+    reset_response(handler);
+    handler->nonblocking = true;
+    handler->pending_request = request;
+    request = NULL;
+    handler->pending_length = request_length;
+    handler->pending_sent = 0;
+    handler->pending_head = strcmp(method, "HEAD ") == 0;
+
+FREE:
+    free(request);
+    req_headers_free(&prepared_headers);
+    rh_url_free(&url_splitted);
+    return handler;
+}
+
+static inline RequestsProgress to_progress(rh_SocketProgress progress)
+{
+    switch(progress)
     {
-        // We couldn't read a single byte
-        return false;
+        case RH_SOCKET_DONE:
+            return REQ_DONE;
+        case RH_SOCKET_WANT_READ:
+            return REQ_WANT_READ;
+        case RH_SOCKET_WANT_WRITE:
+            return REQ_WANT_WRITE;
+        default:
+            return REQ_FAILED;
     }
-
-    handler->reading_residue = (char*) malloc((size - (size_t)offset) * sizeof(char));
-    if(handler->reading_residue == NULL)
-        return false;
-    handler->residue_size = size - (size_t)offset;
-    memcpy(handler->reading_residue, &(buffer[offset]), size - (size_t)offset);
-
-    return true;
 }
 
-/*
-Returns the HTTP status code of the page
-*/
-unsigned short int req_get_status_code(RequestsHandler* handler)
+static RequestsProgress fail_request(RequestsHandler* handler)
 {
-    return handler->status_code;
+    handler->async_state = ASYNC_FAILED;
+    handler->read_failed = true;
+    return REQ_FAILED;
 }
 
 /*
-Returns the value of a specific header.
-If HEADER_NAME is not in the server response headers, it returns NULL.
-If you have to modify this value, copy it before.
+Open a new connection for the pending request of HANDLER, if the reused connection was closed by the server before the response started.
 */
-const char* req_get_header_value(RequestsHandler* handler, const char* header_name)
+static bool reconnect(RequestsHandler* handler)
 {
-    return rh_ptree_get_value(handler->headers_tree, header_name);
+    if(!handler->pending_reused || handler->receive_start != handler->receive_end)
+    {
+        return false;
+    }
+    close_transport(handler);
+    handler->pending_reused = false;
+    handler->pending_sent = 0;
+    handler->receive_start = 0;
+    handler->receive_end = 0;
+    handler->async_state = ASYNC_CONNECTING;
+    handler->connection = start_socket(handler);
+    return handler->connection != NULL;
 }
 
 /*
-This display all headers in server response.
-Used for debug purpose.
+Returns true if the receive buffer holds the whole headers, so req_parse_headers doesn't need to receive anything.
+The lines are ended the same way as in req_parse_headers.
 */
-void req_display_headers(RequestsHandler* handler)
-{
-    printf("STATUS CODE: %hu\n\n", handler->status_code);
-    rh_ptree_display(handler->headers_tree);
-}
-
-static ssize_t get_chunk_size(char c)
+static bool headers_received(const RequestsHandler* handler)
 {
-    static int i = 0;
-    static char length[32];
-
-    if(i >= 32)
-    {
-        i = 0;
-        return -1;
-    }
-
-    if(RH_CHAR_IS_HEXDIGIT(c))
-    {
-        length[i] = c;
-        i++;
-    }
-    else if(c == '\r')
+    if(handler->receive_buffer == NULL)
     {
-        if(i == 0)
-        {
-            return -1;
-        }
-        length[i] = '\0';
-        i++;
+        return false;
     }
-    else if(c == '\n' && i != 0)
+    const char* cursor = &(handler->receive_buffer[handler->receive_start]);
+    const char* end = &(handler->receive_buffer[handler->receive_end]);
+    const char* block;
+
+    while(cursor < end && (*cursor == '\n' || is_blank(*cursor)))
+        cursor++;  // the empty lines before the status line
+    block = cursor;
+    while((cursor = (const char*) memchr(cursor, '\n', (size_t)(end - cursor))) != NULL)
     {
-        length[i] = '\0';
-        i = 0;
-        uint64_t len = rh_hex_to_uint64(length);
-        if(len > INT64_MAX)
+        cursor++;
+        while(cursor < end && is_blank(*cursor))
+            cursor++;
+        if(cursor < end && *cursor == '\n')
         {
-            return -1;
+            unsigned short status_code = parse_status(block, (size_t)(end - block));
+            if(status_code < 100 || status_code >= 200 || status_code == 101)
+            {
+                return true;
+            }
+            // an interim response, req_parse_headers skips it and reads the next one
+            while(cursor < end && (*cursor == '\n' || is_blank(*cursor)))
+                cursor++;
+            block = cursor;
         }
-        return (ssize_t)len;
     }
-    return -1;
+    return false;
 }
 
-static size_t start_chunk_read(RequestsHandler* handler, char* buffer, size_t bytes_in_buffer, size_t buffer_size)
+RequestsProgress req_request_continue(RequestsHandler* handler)
 {
-    size_t offset = 0;
-    handler->total_bytes = -1;
-    while(handler->total_bytes == -1)
+    while(true)
     {
-        while(handler->total_bytes == -1 && offset < bytes_in_buffer)
+        rh_SocketProgress progress = RH_SOCKET_DONE;
+        switch(handler->async_state)
         {
-            handler->total_bytes = get_chunk_size(buffer[offset]);
-            (offset)++;
+            case ASYNC_NONE:
+                return REQ_DONE;
+
+            case ASYNC_FAILED:
+                return REQ_FAILED;
+
+            case ASYNC_CONNECTING:
+                progress = rh_socket_client_continue(handler->connection);
+                if(progress == RH_SOCKET_DONE)
+                {
+                    handler->async_state = ASYNC_SENDING;
+                }
+                break;
+
+            case ASYNC_SENDING:
+                while(progress == RH_SOCKET_DONE && handler->pending_sent < handler->pending_length)
+                {
+                    ssize_t sent = rh_socket_send(handler->connection, handler->pending_request + handler->pending_sent, handler->pending_length - handler->pending_sent);
+                    if(sent <= 0)
+                    {
+                        progress = rh_socket_progress(handler->connection, sent, false);
+                    }
+                    else
+                    {
+                        handler->pending_sent += (size_t)sent;
+                    }
+                }
+                if(progress == RH_SOCKET_DONE)
+                {
+                    handler->async_state = ASYNC_RECEIVING;
+                }
+                break;
+
+            case ASYNC_RECEIVING:
+                if(!headers_received(handler))
+                {
+                    handler->waiting = RH_SOCKET_DONE;
+                    if(fill_receive_buffer(handler, handler->max_headers_size) > 0)
+                    {
+                        handler->pending_reused = false;  // the server answered, it's too late to send it again
+                    }
+                    else
+                    {
+                        progress = would_block(handler) ? handler->waiting : RH_SOCKET_FAILED;
+                    }
+                    break;
+                }
+
+                bool received;
+                if(!req_parse_headers(handler, &received) || !start_body(handler, handler->pending_head))
+                {
+                    return fail_request(handler);
+                }
+                free(handler->pending_request);
+                handler->pending_request = NULL;
+                handler->async_state = ASYNC_NONE;
+                return REQ_DONE;
         }
-        if(handler->total_bytes == -1)
+
+        if(progress == RH_SOCKET_FAILED && !reconnect(handler))
         {
-            ssize_t read = req_read_output(handler, buffer, buffer_size);
-            if(read < 0)
-            {
-                return 0;
-            }
-            bytes_in_buffer = (size_t)read;
-            offset = 0;
+            return fail_request(handler);
+        }
+        if(progress == RH_SOCKET_WANT_READ || progress == RH_SOCKET_WANT_WRITE)
+        {
+            return to_progress(progress);
         }
     }
+}
 
-    if(handler->total_bytes == 0)
-    {
-        // That was the last one
-        handler->read_finished = 1;
-        return 0;
-    }
-    if(bytes_in_buffer <= 0)
+RequestsProgress req_read_output_body_nonblocking(RequestsHandler* handler, char* buffer, size_t buffer_size, size_t* size)
+{
+    *size = 0;
+    if(handler->async_state != ASYNC_NONE)
     {
-        return bytes_in_buffer;
+        return REQ_FAILED;
     }
-    if(bytes_in_buffer > offset)
+
+    handler->waiting = RH_SOCKET_DONE;
+    *size = req_read_output_body(handler, buffer, buffer_size);
+    if(*size > 0)
     {
-        bytes_in_buffer -= offset;
+        return REQ_DONE;
     }
-    else
+    if(would_block(handler))
     {
-        bytes_in_buffer = 0;
+        return to_progress(handler->waiting);
     }
-    memmove(buffer, &(buffer[offset]), bytes_in_buffer);
-    handler->bytes_read = bytes_in_buffer;
-
+    return handler->read_failed ? REQ_FAILED : REQ_DONE;
+}
 
-    if((ssize_t)bytes_in_buffer > handler->total_bytes && bytes_in_buffer > 0)
+int req_get_socket(RequestsHandler* handler)
+{
+    if(handler->connection == NULL || !uses_sockets(&(handler->transport)))
     {
-        size_t chunk_size = 0;
-        if(handler->total_bytes > 0)
-        {
-            chunk_size = (size_t)handler->total_bytes;
-        }
-        bytes_in_buffer = chunk_size + start_chunk_read(handler, buffer + chunk_size, bytes_in_buffer - chunk_size, buffer_size - chunk_size);
+        return -1;
     }
-
-    return bytes_in_buffer;
+    return rh_socket_fd(handler->connection);
 }
 
-
 /*
-    Skip the response header and fill the buffer with the server response
-    Returns the number of bytes read
-    Use this in a loop.
-    Note: This function reads binary data.
-    If you are getting text, use `sizeof(buffer)-1` for buffer_size and add an '\0' at the end of the read buffer.
+    Receive at most N bytes from the connection.
+    If the socket is non-blocking and nothing was received, the event to wait for is kept in the handler.
 */
-size_t req_read_output_body(RequestsHandler* handler, char* buffer, size_t buffer_size)
+static ssize_t receive(RequestsHandler* handler, char* buffer, size_t n)
 {
-    ssize_t read = 0;
-    size_t size = 0;
-    bool new_chunk = false;
-
-    assert(handler != NULL);
-
-    if(handler->read_finished)
-    {
-        return 0;
-    }
-    if(handler->total_bytes > (ssize_t)handler->bytes_read)
+    ssize_t received = (*handler->transport.recv)(handler->connection, buffer, n);
+    if(received <= 0 && handler->nonblocking)
     {
-        size_t n = min_size_t(buffer_size, (size_t)handler->total_bytes - handler->bytes_read);
-        read = req_read_output(handler, buffer, n);
-        if(read <= 0)
-        {
-            handler->read_finished = true;
-            return 0;
-        }
-        size = (size_t)read;
-        handler->bytes_read += size;
+        handler->waiting = rh_socket_progress(handler->connection, received, true);
     }
-    else if(handler->chunked)
+    return received;
+}
+
+/*
+    Receive as many bytes as possible in the receive buffer of the connection, after the bytes that are not consumed yet.
+    If the buffer is full, it grows, doubling its size up to MAX_CAPACITY bytes.
+    Returns the numbers of bytes received.
+    Can block if there is no data left.
+*/
+static ssize_t fill_receive_buffer(RequestsHandler* handler, size_t max_capacity)
+{
+    if(handler->receive_buffer == NULL)
     {
-        new_chunk = true;
-        read = req_read_output(handler, buffer, buffer_size);
-        if(read <= 0)
+        handler->receive_buffer = (char*) malloc(handler->receive_capacity * sizeof(char));
+        if(handler->receive_buffer == NULL)
         {
-            handler->read_finished = true;
-            return 0;
+            return -1;
         }
-        size = (size_t)read;
     }
-
-    if(size <= 0)
+    if(handler->receive_start > 0)
     {
-        return size;
+        memmove(handler->receive_buffer, &(handler->receive_buffer[handler->receive_start]), handler->receive_end - handler->receive_start);
+        handler->receive_end -= handler->receive_start;
+        handler->receive_start = 0;
     }
-
-    if(handler->chunked)
+    if(handler->receive_end == handler->receive_capacity)
     {
-        if(new_chunk)
+        size_t capacity = min_size_t(2 * handler->receive_capacity, max_capacity);
+        if(capacity <= handler->receive_capacity)
         {
-            size = start_chunk_read(handler, buffer, size, buffer_size);
+            return -1;
         }
+        char* temp = (char*) realloc(handler->receive_buffer, capacity * sizeof(char));
+        if(temp == NULL)
+        {
+            return -1;
+        }
+        handler->receive_buffer = temp;
+        handler->receive_capacity = capacity;
     }
-    if(size < buffer_size)
+
+    ssize_t read = receive(handler, &(handler->receive_buffer[handler->receive_end]), handler->receive_capacity - handler->receive_end);
+    if(read > 0)
     {
-        return size + req_read_output_body(handler, &(buffer[size]), buffer_size - size);
+        handler->receive_end += (size_t)read;
     }
-    return size;
+    return read;
 }
 
 /*
@@ -607,20 +3706,23 @@ size_t req_read_output_body(RequestsHandler* handler, char* buffer, size_t buffe
 */
 static ssize_t req_read_output(RequestsHandler* handler, char* buffer, size_t n)
 {
-    if(handler->residue_size <= 0)
+    if(handler->receive_start == handler->receive_end)
     {
-        return rh_socket_recv(handler->handler, buffer, n);
+        if(n >= handler->receive_capacity)
+        {
+            // The caller's buffer is big enough, don't copy the bytes twice
+            return receive(handler, buffer, n);
+        }
+        ssize_t received = fill_receive_buffer(handler, handler->receive_capacity);
+        if(received <= 0)
+        {
+            return received;
+        }
     }
 
-    size_t read = min_size_t(n, (size_t)handler->residue_size);
-    memcpy(buffer, &(handler->reading_residue[handler->residue_offset]), read);
-    handler->residue_size -= read;
-    handler->residue_offset += read;
-    if(handler->residue_size <= 0)
-    {
-        free(handler->reading_residue);
-        handler->reading_residue = NULL;
-    }
+    size_t read = min_size_t(n, handler->receive_end - handler->receive_start);
+    memcpy(buffer, &(handler->receive_buffer[handler->receive_start]), read);
+    handler->receive_start += read;
     return (ssize_t)read;
 }
 
@@ -632,31 +3734,33 @@ static bool connect_socket(RequestsHandler* handler, RequestsConfig* config)
         max_connect_time = config->max_connect_time;
     }
 
-    if(!handler->secured)
+    if(uses_sockets(&(handler->transport)))
     {
-        handler->handler = rh_socket_client_init(handler->host, handler->port, max_connect_time);
-        if(handler->handler == NULL)
-        {
-            return false;
-        }
+        handler->connection = open_socket(handler->host, handler->port, handler->secured, max_connect_time, &(handler->socket_options));
     }
     else
     {
-        handler->handler = rh_socket_ssl_client_init(handler->host, handler->port, max_connect_time);
-        if(handler->handler == NULL)
-        {
-            return false;
-        }
+        handler->connection = (*handler->transport.connect)(handler->host, handler->port, handler->secured, max_connect_time, handler->transport.user_data);
+    }
+    if(handler->connection == NULL)
+    {
+        return false;
+    }
+    if(config != NULL && config->io_uring && uses_sockets(&(handler->transport)) && (handler->secured || !handler->socket_options.fast_open))
+    {
+        // A plain Fast Open connection isn't connected before its first write, a reception couldn't be posted yet.
+        // If it fails, the connection simply doesn't use io_uring
+        rh_socket_use_io_uring(handler->connection);
     }
     return true;
 }
 
-static bool send_headers(RequestsHandler* handler, char* headers)
+static bool send_headers(RequestsHandler* handler, const char* headers, size_t headers_length)
 {
-    size_t total = strlen(headers);
+    size_t total = headers_length;
     size_t sent = 0;
     do {
-        ssize_t bytes = rh_socket_send(handler->handler, headers + sent, total - sent);
+        ssize_t bytes = (*handler->transport.send)(handler->connection, headers + sent, total - sent);
         if (bytes < 0)
         {
             return false;
@@ -669,19 +3773,53 @@ static bool send_headers(RequestsHandler* handler, char* headers)
     return true;
 }
 
+/*
+Close the connection of HANDLER, if it has one.
+*/
+static void close_transport(RequestsHandler* handler)
+{
+    if(handler->connection != NULL)
+    {
+        (*handler->transport.close)(handler->connection);
+        handler->connection = NULL;
+    }
+}
+
+static void destroy_handler(RequestsHandler* handler)
+{
+    close_transport(handler);
+    rh_ptree_free(&(handler->headers_tree));
+    free(handler->receive_buffer);
+    free(handler->pending_request);
+    rh_cache_entry_release(&(handler->body_entry));
+    free(handler);
+}
+
 /*
     Close the connection and free the ssl ctx.
+    If the handler belongs to a pool and its response was entirely read, the connection is kept idle in the pool instead.
     PPR must be the address of the socket handler.
 */
 void req_close_connection(RequestsHandler** ppr)
 {
-    if(*ppr == NULL)
+    RequestsHandler* handler = *ppr;
+    if(handler == NULL)
     {
         return;
     }
-    rh_socket_close(&((*ppr)->handler));
-    rh_ptree_free(&((*ppr)->headers_tree));
-    free((*ppr)->reading_residue);
-    free(*ppr);
     *ppr = NULL;
+
+    if(handler->pool != NULL && handler->connection != NULL && handler->reusable && handler->async_state == ASYNC_NONE && handler->receive_start == handler->receive_end
+        && response_consumed(handler) && !keep_alive_expired(handler) && (!handler->nonblocking || rh_socket_set_blocking(handler->connection, true)))
+    {
+        char origin[ORIGIN_MAX_LENGTH];
+        build_origin(origin, handler->host, handler->port, handler->secured);
+        handler->nonblocking = false;
+        rh_ptree_free(&(handler->headers_tree));
+        rh_cache_entry_release(&(handler->body_entry));
+        rh_pool_put(handler->pool->idle_connections, origin, handler);  // if the pool is full, the handler is destroyed
+        return;
+    }
+
+    destroy_handler(handler);
 }
\ No newline at end of file
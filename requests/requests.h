@@ -6,9 +6,77 @@
 
     typedef struct _requests_handler RequestsHandler;
     typedef struct _requests_config RequestsConfig;
+    typedef struct _requests_pool RequestsPool;
+    typedef struct _requests_cache RequestsCache;
+    typedef struct _requests_single_flight RequestsSingleFlight;
+    typedef struct _requests_headers RequestsHeaders;
+    typedef struct _requests_template RequestsTemplate;
 
     typedef uint64_t req_milliseconds;
 
+    /**
+     * @brief What a non-blocking function needs before it can go on, see `req_request_start`.
+     */
+    typedef enum _requests_progress {
+        REQ_DONE,
+        REQ_WANT_READ,  /* call it again once the socket of the handler is readable */
+        REQ_WANT_WRITE,  /* call it again once the socket of the handler is writable */
+        REQ_FAILED
+    } RequestsProgress;
+
+    /**
+     * @brief The callbacks used by `req_stream_output` to push a response. Each of them can be NULL.  
+     * @brief The strings and the buffers given to the callbacks are borrowed from the handler, they are only valid during the call.  
+     * @brief If a callback returns false, the streaming stops.
+     */
+    typedef struct _requests_sink {
+        bool (*on_status)(unsigned short int status_code, void* user_data);
+        bool (*on_header)(const char* name, const char* value, void* user_data);
+        bool (*on_body)(const char* data, size_t size, void* user_data);
+    } RequestsSink;
+
+    /**
+     * @brief How a failed request is sent again, see `req_config_set_retry_policy`.
+     */
+    typedef struct _requests_retry_policy {
+        unsigned int max_attempts;  /* the first attempt included, 1 disables the retries */
+        req_milliseconds base_backoff;  /* the maximum delay before the first retry, doubled for each next one */
+        req_milliseconds max_backoff;  /* the maximum delay between two attempts */
+        const unsigned short int* retry_statuses;  /* the response status codes that are retried */
+        size_t nb_retry_statuses;
+        bool retry_connection_errors;  /* retry when the connection fails before the request is sent */
+        bool retry_network_errors;  /* retry when the request was sent but no response came back */
+        bool retry_non_idempotent;  /* also retry POST and PATCH requests after they were sent */
+        double retry_budget_ratio;  /* the number of retries earned by each request that succeeds on the first attempt */
+        unsigned int retry_budget_burst;  /* the maximum number of retries that can be saved */
+    } RequestsRetryPolicy;
+
+    /**
+     * @brief How the connections of a config are opened, written, read and closed, see `req_config_set_transport`.  
+     * @brief `connection` is the value returned by `connect`. The functions are called by one thread at a time for a given connection.
+     * @brief For a `http+unix://` url, `connect` gets the urlencoded path of the socket as `host` and 0 as `port`.
+     */
+    typedef struct _requests_transport {
+        void* (*connect)(const char* host, uint16_t port, bool secured, req_milliseconds max_connect_time, void* user_data);  /* NULL if it fails */
+        ptrdiff_t (*send)(void* connection, const char* buffer, size_t n);  /* the number of bytes sent, -1 if it fails */
+        ptrdiff_t (*recv)(void* connection, char* buffer, size_t n);  /* the number of bytes received, 0 at the end of the stream, -1 if it fails */
+        bool (*is_alive)(void* connection);  /* false if an idle connection was closed by the peer, can be NULL */
+        void (*close)(void* connection);
+        void* user_data;  /* given to connect */
+    } RequestsTransport;
+
+    /**
+     * @brief Called by `req_get_many` for each response, from one of its worker threads.
+     * @brief `handler` is NULL if the request failed. Don't close it, it's done once the callback returns.
+     */
+    typedef void (*req_batch_callback)(RequestsHandler* handler, const char* url, size_t index, void* user_data);
+
+    /**
+     * @brief Returns the next url to request, or NULL when there is no url left.
+     * @brief The string returned only needs to stay valid until the next call.
+     */
+    typedef const char* (*req_url_iterator)(void* iterator_data);
+
     #ifdef __cplusplus
     extern "C"{
     #endif
@@ -18,8 +86,342 @@
 
     RequestsConfig* req_config_default();
 
+    /**
+     * @brief Create a new config with the same settings as `config`.
+     * @brief The pool is not copied, both configs share the same pool. The cache of permanent redirections starts empty.
+     * 
+     * @param config the config to copy
+     * @return - When it succeeds, it returns a pointer to the new config.
+     * @return - When it fails, it returns NULL.
+     */
+    RequestsConfig* req_config_copy(const RequestsConfig* config);
+
+    /**
+     * @brief Free a config created by `req_config_default` or `req_config_copy` and put your config to `NULL`.
+     * 
+     * @param config the address of your config. It's a pointer to a pointer.
+     */
+    void req_config_free(RequestsConfig** config);
+
     bool req_config_set_max_connect_time(RequestsConfig* config, req_milliseconds max_connect_time);
 
+    /**
+     * @brief Set the maximum number of redirections followed by a request (10 by default).  
+     * @brief If a request is redirected more than that, it fails. With 0, redirections are not followed and the 3xx response is returned.
+     * 
+     * @param config the config returned by `req_config_default`
+     * @param max_redirects the maximum number of redirections.
+     * @return false if config is NULL, true otherwise.
+     */
+    bool req_config_set_max_redirects(RequestsConfig* config, size_t max_redirects);
+
+
+    /**
+     * @brief Set the size of the buffer that each new connection receives into (16 KB by default).  
+     * @brief The buffer is allocated once per connection and kept across keep-alive requests. Bigger buffers mean fewer system calls on big responses, 16 KB to 64 KB is a good range.
+     * 
+     * @param config the config returned by `req_config_default`
+     * @param size the size of the buffer in bytes, at least 1024.
+     * @return false if config is NULL or if size is too small, true otherwise.
+     */
+    bool req_config_set_receive_buffer_size(RequestsConfig* config, size_t size);
+
+
+    /**
+     * @brief Set the maximum size of the headers of a response, status line included (256 KB by default).  
+     * @brief The headers are parsed in a single pass, a response with bigger headers fails.
+     * 
+     * @param config the config returned by `req_config_default`
+     * @param max_headers_size the maximum size in bytes.
+     * @return false if config is NULL or if max_headers_size is 0, true otherwise.
+     */
+    bool req_config_set_max_headers_size(RequestsConfig* config, size_t max_headers_size);
+
+
+    /**
+     * @brief Set the maximum length of the urls requested, redirections included (64 KB by default).  
+     * @brief A request to a longer url fails.
+     * 
+     * @param config the config returned by `req_config_default`
+     * @param max_url_length the maximum length in bytes.
+     * @return false if config is NULL or if max_url_length is 0, true otherwise.
+     */
+    bool req_config_set_max_url_length(RequestsConfig* config, size_t max_url_length);
+
+
+    /**
+     * @brief Receive through io_uring on the new connections opened by the blocking functions: a multishot reception fills registered buffers as the data arrives,
+     * @brief and a single system call collects the data of all the connections of the process. HTTPS records are read from io_uring too.  
+     * @brief It needs the library to be built with `REQUESTS_IO_URING=1` and Linux 6.0.
+     * 
+     * @param config the config returned by `req_config_default`
+     * @param enabled true to use io_uring
+     * @return false if config is NULL, or if io_uring is asked but not available, true otherwise.
+     */
+    bool req_config_set_io_uring(RequestsConfig* config, bool enabled);
+
+
+    /**
+     * @brief Let the kernel encrypt and decrypt the HTTPS connections of the config once their handshake is done (kTLS), so OpenSSL doesn't copy each byte in user space.  
+     * @brief If the kernel (the `tls` module) or the negotiated cipher don't support it, the connection is encrypted by OpenSSL as usual.  
+     * @brief The receptions decrypted by the kernel don't go through io_uring.
+     * 
+     * @param config the config returned by `req_config_default`
+     * @param enabled true to use kTLS when possible
+     * @return false if config is NULL, or if kTLS is asked but OpenSSL was built without it, true otherwise.
+     */
+    bool req_config_set_ktls(RequestsConfig* config, bool enabled);
+
+
+    /**
+     * @brief Resume the TLS sessions that the servers gave on the previous connections, and send the GET, HEAD and OPTIONS requests
+     * @brief of the blocking functions as TLS 1.3 early data (0-RTT) when the resumed session allows it: the request leaves with the handshake, one round trip earlier.  
+     * @brief If the server rejects the early data, the request is sent again once the handshake is done. The non-blocking functions only resume the sessions.  
+     * @brief Early data can be replayed by an attacker who records them, so only enable it for servers where these requests have no side effect.
+     * 
+     * @param config the config returned by `req_config_default`
+     * @param enabled true to resume the sessions and send early data
+     * @return false if config is NULL, true otherwise.
+     */
+    bool req_config_set_early_data(RequestsConfig* config, bool enabled);
+
+
+    /**
+     * @brief Send the requests with a big body with the header `Expect: 100-continue`: the headers are sent first, and the body only when the server answers with 100 Continue,
+     * @brief or when it didn't answer after `timeout` milliseconds, since some servers ignore the header.  
+     * @brief If the server answers with a final status instead, like 401 or a redirection, the body isn't sent at all and the connection is closed once the response is read.  
+     * @brief It applies to the blocking functions with the default transport. The interim responses (1xx) are always skipped.
+     * 
+     * @param config the config returned by `req_config_default`
+     * @param min_body_size the size in bytes from which a body waits for the server, 0 to never wait (the default).
+     * @param timeout how long to wait for the answer of the server in milliseconds, 1000 is a good value.
+     * @return false if config is NULL or if timeout is 0 while min_body_size isn't, true otherwise.
+     */
+    bool req_config_set_expect_continue(RequestsConfig* config, size_t min_body_size, req_milliseconds timeout);
+
+
+    /**
+     * @brief Disable Nagle's algorithm (`TCP_NODELAY`) on the connections of the config, so a small write isn't held back until the previous one is acknowledged. It's enabled by default.
+     *
+     * @param config the config returned by `req_config_default`
+     * @param enabled false to let the kernel coalesce the small writes
+     * @return false if config is NULL, true otherwise.
+     */
+    bool req_config_set_tcp_nodelay(RequestsConfig* config, bool enabled);
+
+
+    /**
+     * @brief Set the size of the kernel buffers of the connections (`SO_RCVBUF` and `SO_SNDBUF`), before they connect.  
+     * @brief Large buffers let a bulk transfer keep more data in flight on a path with a large bandwidth-delay product. Setting them disables the automatic tuning of the kernel, which is usually better for small exchanges.
+     *
+     * @param config the config returned by `req_config_default`
+     * @param receive_size the size of the reception buffer in bytes, 0 to let the kernel tune it
+     * @param send_size the size of the sending buffer in bytes, 0 to let the kernel tune it
+     * @return false if config is NULL or if a size is over `INT_MAX`, true otherwise.
+     */
+    bool req_config_set_socket_buffers(RequestsConfig* config, size_t receive_size, size_t send_size);
+
+
+    /**
+     * @brief Send TCP keepalive probes on the idle connections, so the pool notices a peer or a middlebox that vanished without closing them.
+     *
+     * @param config the config returned by `req_config_default`
+     * @param idle the seconds of idleness before the first probe, 0 to send no probe (the default)
+     * @param interval the seconds between two probes, 0 for the default of the system
+     * @param count the number of unanswered probes before the connection is dropped, 0 for the default of the system
+     * @return false if config is NULL or if a value is over `INT_MAX`, true otherwise.
+     */
+    bool req_config_set_tcp_keepalive(RequestsConfig* config, unsigned int idle, unsigned int interval, unsigned int count);
+
+
+    /**
+     * @brief Open the connections of the blocking functions with TCP Fast Open (`TCP_FASTOPEN_CONNECT`, Linux only): once a server gave a cookie, the next connections to it send the request, or the TLS ClientHello, with the SYN and save a round trip.  
+     * @brief The connection is only made by the first write, so `req_config_set_max_connect_time` doesn't apply to it and an unreachable address isn't skipped for the next one.
+     *
+     * @param config the config returned by `req_config_default`
+     * @param enabled true to use TCP Fast Open when the system has it
+     * @return false if config is NULL, true otherwise.
+     */
+    bool req_config_set_tcp_fast_open(RequestsConfig* config, bool enabled);
+
+
+    /**
+     * @brief Busy poll the device queue for a while when a reception finds nothing yet (`SO_BUSY_POLL`, Linux only), trading CPU time for a lower latency.  
+     * @brief A value over the `net.core.busy_read` sysctl needs `CAP_NET_ADMIN`, otherwise it's ignored.
+     *
+     * @param config the config returned by `req_config_default`
+     * @param microseconds how long to busy poll, 0 to disable it (the default)
+     * @return false if config is NULL or if the value is over `INT_MAX`, true otherwise.
+     */
+    bool req_config_set_busy_poll(RequestsConfig* config, unsigned int microseconds);
+
+
+    /**
+     * @brief Acknowledge the received data at once instead of delaying the ACK (`TCP_QUICKACK`, Linux only). The kernel clears it, so it's set again before each reception.  
+     * @brief It avoids the stall of a server that writes its response in several parts with Nagle's algorithm enabled, at the cost of a system call per reception and more ACKs.
+     *
+     * @param config the config returned by `req_config_default`
+     * @param enabled true to acknowledge at once
+     * @return false if config is NULL, true otherwise.
+     */
+    bool req_config_set_tcp_quickack(RequestsConfig* config, bool enabled);
+
+
+    /**
+     * @brief Open the new connections of the config with other functions than the TCP and TLS sockets of the library,
+     * @brief for example an in-memory transport for the tests and the benchmarks, or a tunnel.  
+     * @brief The connections of another transport found in the pool are not reused by this config.
+     * @brief The non-blocking functions (`req_request_start`...) and io_uring need the default transport.
+     * 
+     * @param config the config returned by `req_config_default`
+     * @param transport the functions to use, copied in the config, or NULL to go back to the default transport.
+     * @return false if config is NULL or if a function of transport (apart from is_alive) is NULL, true otherwise.
+     */
+    bool req_config_set_transport(RequestsConfig* config, const RequestsTransport* transport);
+
+
+    /**
+     * @brief Fill `policy` with the default retry policy: 3 attempts, a backoff from 100ms to 2s, the statuses 429, 502, 503 and 504,
+     * @brief the connection and network errors, only for idempotent methods, and a budget of 1 retry for 10 successful requests (up to 10 saved retries).
+     * 
+     * @param policy the policy to fill, it can be modified before being given to `req_config_set_retry_policy`.
+     */
+    void req_retry_policy_default(RequestsRetryPolicy* policy);
+
+
+    /**
+     * @brief Set how the requests done with `config` are retried (by default, they are never retried).  
+     * @brief The delay before a retry is random, between 0 and `base_backoff * 2^(retry - 1)`, capped by `max_backoff`.
+     * @brief If a retried response has a `Retry-After` header in seconds, the delay is at least this long, and if it's longer than `max_backoff`, the response is returned instead.
+     * @brief Each retry costs one token of a budget shared by all the requests of the config, so the retries can't multiply the load of a failing server.
+     * @brief When the budget is empty, the last response or NULL is returned.
+     * 
+     * @param config the config returned by `req_config_default`
+     * @param policy the policy, copied in the config.
+     * @return false if config or policy is NULL, or if the policy is invalid, true otherwise.
+     */
+    bool req_config_set_retry_policy(RequestsConfig* config, const RequestsRetryPolicy* policy);
+
+
+    /**
+     * @brief Make all the requests done with `config` share the idle connections of `pool`.
+     * @brief The pool is thread-safe, so a single config and a single pool can be used by all the threads of a program.
+     * 
+     * @param config the config returned by `req_config_default`
+     * @param pool the pool returned by `req_pool_init`, or NULL to stop using a pool.
+     * @return false if config is NULL, true otherwise.
+     */
+    bool req_config_set_pool(RequestsConfig* config, RequestsPool* pool);
+
+    /**
+     * @brief Returns the pool used by `config`, or NULL if it doesn't use one.
+     */
+    RequestsPool* req_config_get_pool(const RequestsConfig* config);
+
+
+    /**
+     * @brief Make all the GET requests done with `config` go through `cache`.
+     * @brief The cache must outlive the config and all its copies.
+     * 
+     * @param config the config returned by `req_config_default`
+     * @param cache the cache returned by `req_cache_init`, or NULL to disable the cache.
+     * @return false if config is NULL, true otherwise.
+     */
+    bool req_config_set_cache(RequestsConfig* config, RequestsCache* cache);
+
+
+    /**
+     * @brief Make the identical GET and HEAD requests done with `config` at the same time share a single request to the server.
+     * @brief The single-flight group must outlive the config and all its copies.
+     * 
+     * @param config the config returned by `req_config_default`
+     * @param single_flight the group returned by `req_single_flight_init`, or NULL to send each request.
+     * @return false if config is NULL, true otherwise.
+     */
+    bool req_config_set_single_flight(RequestsConfig* config, RequestsSingleFlight* single_flight);
+
+
+    /**
+     * @brief Create a thread-safe pool of keep-alive connections.  
+     * @brief When a request is done with a config that uses this pool, a warm connection to the same origin is taken from the pool if there is one.  
+     * @brief When `req_close_connection` is called on a handler that has read its whole response, the connection goes back into the pool instead of being closed.
+     * 
+     * @param max_idle_per_origin the maximum number of idle connections kept for a single origin (scheme, host and port).
+     * @return - When it succeeds, it returns a pointer to a pool.
+     * @return - When it fails, it returns NULL.
+     */
+    RequestsPool* req_pool_init(size_t max_idle_per_origin);
+
+
+    /**
+     * @brief Close all the idle connections of the pool, free it and put your pool to `NULL`.
+     * @brief The handlers that are still in use must be closed before this call.
+     * 
+     * @param pool the address of your pool. It's a pointer to a pointer.
+     */
+    void req_pool_free(RequestsPool** pool);
+
+
+    /**
+     * @brief Open `nb_connections` connections to each origin in the background, in parallel, and leave them idle in the pool, so the first requests don't wait for the TCP and TLS handshakes.
+     * @brief From then on, a thread of the pool keeps at least `nb_connections` usable idle connections to these origins: the ones closed by the server are replaced, and so are the ones taken by a request.
+     * @brief Calling it again for an origin replaces its config and its number of connections, 0 stops keeping it warm.
+     * @brief The connections are never sent as TLS early data.
+     *
+     * @param pool the pool returned by `req_pool_init`
+     * @param config the config used to open the connections (transport, timeouts, TLS options), it's copied. It can be NULL for the default config.
+     * @param origins urls of the origins like `"https://example.com"`, their path is ignored.
+     * @param nb_origins the number of origins
+     * @param nb_connections the number of idle connections kept for each origin, at most the `max_idle_per_origin` of the pool.
+     * @return false if an origin couldn't be parsed, or if there was a memory error. The connections that fail to open are retried later, they don't make it fail.
+     */
+    bool req_pool_prewarm(RequestsPool* pool, const RequestsConfig* config, const char* const* origins, size_t nb_origins, size_t nb_connections);
+
+
+    /**
+     * @brief Create a thread-safe cache of responses, that can be shared by multiple configs with `req_config_set_cache`.
+     * @brief Responses are stored according to their `Cache-Control` header (`max-age`, `no-cache` and `no-store`),
+     * @brief and stale responses that have an `ETag` or a `Last-Modified` header are revalidated with a conditional request.
+     * @brief A fresh or revalidated response is read with `req_read_output_body` like any other response.
+     * 
+     * @param max_memory the maximum number of bytes kept in memory, the least recently used responses are evicted first. A response can't use more than a quarter of it.
+     * @param directory an existing directory where the responses are also written, and mapped back by the next cache using it. A file is deleted when its response is evicted. NULL to keep the cache in memory only.
+     * @return - When it succeeds, it returns a pointer to a cache handler.
+     * @return - When it fails, it returns NULL.
+     */
+    RequestsCache* req_cache_init(size_t max_memory, const char* directory);
+
+
+    /**
+     * @brief Free the cache and set the cache handler to NULL. The files in the directory of the cache are kept.
+     * 
+     * @param cache the address of the cache handler.
+     */
+    void req_cache_free(RequestsCache** cache);
+
+
+    /**
+     * @brief Create a thread-safe single-flight group, that can be shared by multiple configs with `req_config_set_single_flight`.
+     * @brief While a GET or HEAD request is waiting for its response, the identical requests sent by other threads don't go to the server:
+     * @brief they wait for this response, and each of them gets a handler reading the same shared body.
+     * @brief Two requests are identical if they have the same method, the same url and the same headers.
+     * @brief The requests with a `Range` or a conditional header (`If-None-Match`, `If-Modified-Since`...) are always sent on their own.
+     * 
+     * @param max_body_size the biggest body that can be shared. If the response is bigger, the waiting requests are sent on their own.
+     * @param max_wait_time how long a request waits for the shared response in milliseconds, it's sent on its own after that.
+     * @return - When it succeeds, it returns a pointer to a single-flight group.
+     * @return - When it fails, it returns NULL.
+     */
+    RequestsSingleFlight* req_single_flight_init(size_t max_body_size, req_milliseconds max_wait_time);
+
+
+    /**
+     * @brief Free the single-flight group and set its handler to NULL. No request using it must be in flight.
+     * 
+     * @param single_flight the address of the single-flight handler.
+     */
+    void req_single_flight_free(RequestsSingleFlight** single_flight);
+
     /**
      * @brief This is not meant to be used directly, unless you have exotic HTTP methods.  
      * @brief It's the generic method for all other HTTP methods.
@@ -31,10 +433,102 @@
      * @param additional_headers The headers you want to specify, they are separated by `\r\n` and __they needs__ to finish by `\r\n`.
      * @return - When it succeeds, it returns a pointer to a structure handler.
      * @return - When it fails, it returns NULL and `rh_print_last_error` can tell what happened.
+     * 
+     * @note If you send the same `additional_headers` many times, prepare them once with `req_headers_prepare` and use `req_request_prepared`.
      */
     RequestsHandler* req_request(RequestsConfig* config, RequestsHandler* handler, const char* method, const char* url, const char* data, const char* additional_headers);
 
 
+    /**
+     * @brief Parse and validate additional headers once, so they can be sent with many requests by `req_request_prepared`.  
+     * @brief The default headers overridden by `additional_headers` are found here, so each request only has to copy the prepared block.
+     * 
+     * @param additional_headers The headers you want to specify, they are separated by `\r\n` and __they needs__ to finish by `\r\n`.
+     * @return - When it succeeds, it returns a pointer to the prepared headers.
+     * @return - When the headers are malformed or when there is a memory error, it returns NULL.
+     */
+    RequestsHeaders* req_headers_prepare(const char* additional_headers);
+
+
+    /**
+     * @brief Free headers prepared by `req_headers_prepare` and put your pointer to `NULL`.
+     * 
+     * @param headers the address of your prepared headers. It's a pointer to a pointer.
+     */
+    void req_headers_free(RequestsHeaders** headers);
+
+
+    /**
+     * @brief Works like `req_request`, but with headers prepared by `req_headers_prepare`.
+     * @brief The prepared headers are not modified, they can be shared by multiple threads.
+     */
+    RequestsHandler* req_request_prepared(RequestsConfig* config, RequestsHandler* handler, const char* method, const char* url, const char* data, const RequestsHeaders* prepared_headers);
+
+
+    /**
+     * @brief Prepare a request that is sent many times with only a different path or body.  
+     * @brief The base url and the headers are parsed once and the constant parts of the request are serialized in advance.
+     * 
+     * @param config the config used by each request, can be NULL. It must stay valid as long as the template is used.
+     * @param method This parameter must be in CAPS LOCK, followed by a space, like `"GET "`, `"POST "`, etc...
+     * @param base_url the url that each path is added to, like `"https://example.com/api/v1"`.
+     * @param additional_headers The headers you want to specify, they are separated by `\r\n` and __they needs__ to finish by `\r\n`.
+     * @return - When it succeeds, it returns a pointer to the template.
+     * @return - When the url or the headers are invalid or when there is a memory error, it returns NULL.
+     */
+    RequestsTemplate* req_prepare(RequestsConfig* config, const char* method, const char* base_url, const char* additional_headers);
+
+
+    /**
+     * @brief Send the request prepared by `req_prepare`.  
+     * @brief The template is not modified, it can be shared by multiple threads.
+     * 
+     * @param request_template the template returned by `req_prepare`
+     * @param handler must be NULL if it's the first connection, otherwise, it should be an old handler. If it's NULL and the config of the template has a pool, a pooled connection is used.
+     * @param path added to the base url, it should start with `/` or `?`. It can be an empty string.
+     * @param body the body of the request, it can contain binary data.
+     * @param body_length the size of `body`.
+     * @return - When it succeeds, it returns a pointer to a structure handler.
+     * @return - When it fails, it returns NULL.
+     */
+    RequestsHandler* req_send_prepared(const RequestsTemplate* request_template, RequestsHandler* handler, const char* path, const char* body, size_t body_length);
+
+
+    /**
+     * @brief Free a template created by `req_prepare` and put your pointer to `NULL`.
+     * 
+     * @param request_template the address of your template. It's a pointer to a pointer.
+     */
+    void req_template_free(RequestsTemplate** request_template);
+
+
+    /**
+     * @brief Send a GET request to each url of `urls`, with bounded concurrency.  
+     * @brief Requests are spread over hosts in round robin, so a slow host can't starve the others.  
+     * @brief Connections are reused per origin with the pool of `config`, or with a temporary pool if `config` doesn't have one.
+     * 
+     * @param config the config used for each request, can be NULL.
+     * @param urls the urls to request.
+     * @param nb_urls the number of urls in `urls`.
+     * @param additional_headers the headers sent with each request, they are separated by `\r\n` and __they needs__ to finish by `\r\n`.
+     * @param max_in_flight the maximum number of requests at the same time.
+     * @param max_per_host the maximum number of requests at the same time on a single host.
+     * @param callback called for each response, with the index of the url in `urls`. It can be called from multiple threads at the same time.
+     * @param user_data passed as is to `callback`.
+     * @return - true when all the urls were requested (some requests may have failed, see the `callback`).
+     * @return - false if there was a memory or a thread error.
+     */
+    bool req_get_many(RequestsConfig* config, const char* const* urls, size_t nb_urls, const char* additional_headers, size_t max_in_flight, size_t max_per_host, req_batch_callback callback, void* user_data);
+
+
+    /**
+     * @brief Works like `req_get_many`, but the urls are pulled lazily from `next_url`, so the whole list doesn't have to be in memory.
+     * @brief `next_url` is always called with a lock held, so it doesn't have to be thread-safe.  
+     * @brief A url is pulled when all the hosts with waiting urls are at their limit, so a long run of urls for one host doesn't delay the other hosts. At most 65536 urls wait at the same time.
+     */
+    bool req_get_many_iterator(RequestsConfig* config, req_url_iterator next_url, void* iterator_data, const char* additional_headers, size_t max_in_flight, size_t max_per_host, req_batch_callback callback, void* user_data);
+
+
     /**
      * @brief Get one of the parsed headers in the server response.
      * 
@@ -80,18 +574,111 @@
     size_t req_read_output_body(RequestsHandler* handler, char* buffer, size_t buffer_size);
 
 
+    /**
+     * @brief This is the push version of `req_read_output_body`.  
+     * @brief It calls `on_status` with the status code, `on_header` for each header of the response and `on_body` for each piece of the body as it arrives, once the chunks are decoded.  
+     * @brief It's a blocking function, it returns once the whole body was pushed.
+     * 
+     * @param handler the handler returned by a request
+     * @param sink the callbacks to call
+     * @param user_data passed as is to each callback
+     * @return - true if the whole response was pushed.
+     * @return - false if the body couldn't be read entirely or if a callback returned false.
+     */
+    bool req_stream_output(RequestsHandler* handler, const RequestsSink* sink, void* user_data);
+
+
+    /**
+     * @brief Start a request without blocking, so many requests can be driven by a single thread with an event loop.  
+     * @brief Only the resolution of the host name blocks. A connection idle in the pool of `config` is used if there is one.  
+     * @brief The request goes on with `req_request_continue` and its body is read with `req_read_output_body_nonblocking`.  
+     * @brief Redirections, retries, the cache and the single flight are not handled, and `max_connect_time` is left to the event loop.
+     * 
+     * @param config the config used for the request, can be NULL.
+     * @param method the method followed by a space, like "GET ".
+     * @param url It's the url you want to reach, it should start with `http://` or `https://`.
+     * @param data the body of the request, "" if there is none.
+     * @param additional_headers Additional headers, each line must end with "\r\n", "" if there is none.
+     * @return - When it succeeds, it returns a handler, that must be closed with `req_close_connection`.
+     * @return - When it fails, or if `config` has a transport set by `req_config_set_transport`, it returns NULL.
+     */
+    RequestsHandler* req_request_start(RequestsConfig* config, const char* method, const char* url, const char* data, const char* additional_headers);
+
+
+    /**
+     * @brief Send the request started by `req_request_start` and receive the headers of its response, as far as it can without blocking.  
+     * @brief Once it returned `REQ_DONE`, the status code and the headers can be read.
+     * 
+     * @param handler the handler returned by `req_request_start`
+     * @return `REQ_DONE` when the headers are parsed, `REQ_FAILED` if the request failed, or the event to wait for on `req_get_socket` before calling it again.
+     */
+    RequestsProgress req_request_continue(RequestsHandler* handler);
+
+
+    /**
+     * @brief Read the next part of the body without blocking, once `req_request_continue` returned `REQ_DONE`.  
+     * @brief Unlike `req_read_output_body`, it doesn't wait to fill the buffer, it returns what has already arrived.
+     * 
+     * @param handler the handler returned by `req_request_start`
+     * @param buffer a buffer to fill with the data read
+     * @param buffer_size the size of the buffer
+     * @param size filled with the number of bytes put in `buffer`, 0 at the end of the body.
+     * @return `REQ_DONE` if `size` is set, `REQ_FAILED` if the body couldn't be read entirely, or the event to wait for on `req_get_socket` before calling it again.
+     */
+    RequestsProgress req_read_output_body_nonblocking(RequestsHandler* handler, char* buffer, size_t buffer_size, size_t* size);
+
+
+    /**
+     * @brief The socket to watch for the events asked by the non-blocking functions. It can change after each call to `req_request_continue`.
+     * 
+     * @param handler the handler returned by `req_request_start`
+     * @return the file descriptor of the socket, or -1 if there is none.
+     */
+    int req_get_socket(RequestsHandler* handler);
+
+
+    /**
+     * @brief Download `url` into the file at `path`.  
+     * @brief When the server gives the size of the body, the file is preallocated and the body is read directly into a memory mapping of the file.  
+     * @brief If the file already exists, only the missing part is requested with a `Range` header, so an interrupted download can be resumed by calling this function again.
+     * 
+     * @param config the config used for the request, can be NULL.
+     * @param url It's the url you want to download, it should start with `http://` or `https://`.
+     * @param path the path of the destination file.
+     * @return - true if the whole file was downloaded.
+     * @return - false otherwise. The file then contains only the bytes that were received.
+     */
+    bool req_download_file(RequestsConfig* config, const char* url, const char* path);
+
+
+    /**
+     * @brief Download `url` into the file at `path` with `nb_connections` connections that fetch different ranges of the file at the same time.  
+     * @brief A HEAD request checks that the server supports ranges and gives the size of the file, otherwise it works like `req_download_file`.  
+     * @brief Ranges are sized from the speed of each connection and a failed range is retried on a new connection.
+     * 
+     * @param config the config used for the requests, can be NULL.
+     * @param url It's the url you want to download, it should start with `http://` or `https://`.
+     * @param path the path of the destination file. An existing file is overwritten.
+     * @param nb_connections the number of connections opened at the same time.
+     * @return - true if the whole file was downloaded.
+     * @return - false otherwise. The file is then empty.
+     */
+    bool req_download_file_parallel(RequestsConfig* config, const char* url, const char* path, size_t nb_connections);
+
+
     /**
      * @brief To get the number of bytes read in the body of the request.  
      * @brief It can be used to get the current cursor position if you read a file from the web.
      * 
      * @param handler the handler returned by a request
-     * @return the number of bytes read since the first req_read_output_body
+     * @return the number of bytes of the body given by req_read_output_body or req_stream_output so far
      */
     size_t req_nb_bytes_read(RequestsHandler* handler);
 
 
     /**
      * @brief this function will close the connection, destroy the headers parsed tree, free all structures behind the handler and put your handler to `NULL`.
+     * @brief If the handler was created with a pool and its response was entirely read, the connection is given back to the pool instead of being closed.
      * 
      * @param ppr the address of your handler. It's a pointer to a pointer.
      */
@@ -0,0 +1,305 @@
+#ifndef REQUESTS_HPP
+    #define REQUESTS_HPP
+    #include <cstddef>
+    #include <iterator>
+    #include <optional>
+    #include <string>
+    #include <string_view>
+    #include <utility>
+    #if __cplusplus >= 202002L && __has_include(<span>)
+        #include <span>
+    #endif
+    #include "requests.h"
+
+    /* A header-only C++17 layer over requests.h. It only owns the C handles, so nothing is copied or allocated at the boundary. */
+
+    namespace requests
+    {
+        #ifdef __cpp_lib_span
+        using Bytes = std::span<char>;
+        using ConstBytes = std::span<const char>;
+        #else
+        /**
+         * @brief The subset of `std::span` used by this header, for C++17. With C++20, `std::span` is used instead.
+         */
+        template <typename T>
+        class Span
+        {
+        public:
+            constexpr Span() noexcept = default;
+            constexpr Span(T* data, std::size_t size) noexcept : pointer(data), length(size) {}
+            template <std::size_t N>
+            constexpr Span(T (&array)[N]) noexcept : pointer(array), length(N) {}
+            template <typename Container, typename = decltype(std::declval<Container&>().data())>
+            constexpr Span(Container& container) noexcept : pointer(container.data()), length(container.size()) {}
+
+            constexpr T* data() const noexcept { return pointer; }
+            constexpr std::size_t size() const noexcept { return length; }
+            constexpr bool empty() const noexcept { return length == 0; }
+            constexpr T* begin() const noexcept { return pointer; }
+            constexpr T* end() const noexcept { return pointer + length; }
+            constexpr T& operator[](std::size_t i) const noexcept { return pointer[i]; }
+
+        private:
+            T* pointer = nullptr;
+            std::size_t length = 0;
+        };
+        using Bytes = Span<char>;
+        using ConstBytes = Span<const char>;
+        #endif
+
+
+        /**
+         * @brief A null terminated string given to the C functions, from a `const char*` or a `std::string`, without copy.
+         */
+        class CString
+        {
+        public:
+            CString(const char* str) noexcept : str(str) {}
+            CString(const std::string& str) noexcept : str(str.c_str()) {}
+
+            const char* c_str() const noexcept { return str; }
+
+        private:
+            const char* str;
+        };
+
+
+        /**
+         * @brief Calls `req_init` when it's created and `req_destroy` when it's destroyed. Keep one alive in `main` while requests are done.
+         */
+        class Library
+        {
+        public:
+            Library() { req_init(); }
+            ~Library() { req_destroy(); }
+            Library(const Library&) = delete;
+            Library& operator=(const Library&) = delete;
+        };
+
+
+        /**
+         * @brief A response and the connection it came from. It's closed (or given back to the pool of its session) when it's destroyed.
+         * @brief It can be moved but not copied. A failed request gives an empty response, which converts to false.
+         */
+        class Response
+        {
+        public:
+            /**
+             * @brief An input iterator over the body, each chunk is the part of the buffer given to `Response::chunks` that was filled.
+             */
+            class ChunkIterator
+            {
+            public:
+                using iterator_category = std::input_iterator_tag;
+                using value_type = ConstBytes;
+                using difference_type = std::ptrdiff_t;
+                using pointer = const ConstBytes*;
+                using reference = const ConstBytes&;
+
+                ChunkIterator() noexcept = default;
+                ChunkIterator(Response* response, Bytes buffer) noexcept : response(response), buffer(buffer) { next(); }
+
+                reference operator*() const noexcept { return chunk; }
+                pointer operator->() const noexcept { return &chunk; }
+                ChunkIterator& operator++() noexcept { next(); return *this; }
+                void operator++(int) noexcept { next(); }
+
+                friend bool operator==(const ChunkIterator& a, const ChunkIterator& b) noexcept { return a.response == b.response; }
+                friend bool operator!=(const ChunkIterator& a, const ChunkIterator& b) noexcept { return a.response != b.response; }
+
+            private:
+                void next() noexcept
+                {
+                    std::size_t size = response->read(buffer);
+                    if(size == 0)
+                    {
+                        response = nullptr;  // the end of the body
+                        return;
+                    }
+                    chunk = ConstBytes(buffer.data(), size);
+                }
+
+                Response* response = nullptr;
+                Bytes buffer;
+                ConstBytes chunk;
+            };
+
+            /**
+             * @brief The range returned by `Response::chunks`.
+             */
+            class Chunks
+            {
+            public:
+                Chunks(Response* response, Bytes buffer) noexcept : response(response), buffer(buffer) {}
+                ChunkIterator begin() const noexcept { return ChunkIterator(response, buffer); }
+                ChunkIterator end() const noexcept { return ChunkIterator(); }
+
+            private:
+                Response* response;
+                Bytes buffer;
+            };
+
+            Response() noexcept = default;
+            explicit Response(RequestsHandler* handler) noexcept : handler(handler) {}
+            Response(Response&& other) noexcept : handler(std::exchange(other.handler, nullptr)) {}
+            Response& operator=(Response&& other) noexcept
+            {
+                if(this != &other)
+                {
+                    close();
+                    handler = std::exchange(other.handler, nullptr);
+                }
+                return *this;
+            }
+            Response(const Response&) = delete;
+            Response& operator=(const Response&) = delete;
+            ~Response() { close(); }
+
+            explicit operator bool() const noexcept { return handler != nullptr; }
+
+            /**
+             * @return the HTTP status code, or 0 for an empty response.
+             */
+            unsigned short int status_code() const noexcept { return handler != nullptr ? req_get_status_code(handler) : 0; }
+
+            /**
+             * @brief Get the value of a header (`name` is case unsensitive).
+             * @return a view borrowed from the response, valid until it's destroyed or used for another request, or `std::nullopt` if there is no such header.
+             */
+            std::optional<std::string_view> header(CString name) const noexcept
+            {
+                const char* value = handler != nullptr ? req_get_header_value(handler, name.c_str()) : nullptr;
+                if(value == nullptr)
+                {
+                    return std::nullopt;
+                }
+                return std::string_view(value);
+            }
+
+            /**
+             * @brief Read the next part of the body in `buffer`, like `req_read_output_body`.
+             * @return the number of bytes read, 0 at the end of the body.
+             */
+            std::size_t read(Bytes buffer) noexcept { return handler != nullptr ? req_read_output_body(handler, buffer.data(), buffer.size()) : 0; }
+
+            /**
+             * @brief Iterate over the rest of the body, each chunk being read in `buffer`:
+             * @brief `for(auto chunk : response.chunks(buffer)) { ... }`
+             */
+            Chunks chunks(Bytes buffer) noexcept { return Chunks(this, buffer); }
+
+            /**
+             * @brief Read the rest of the body in a string.
+             */
+            std::string text()
+            {
+                std::string body;
+                char buffer[16384];
+                std::size_t size;
+                while((size = read(buffer)) > 0)
+                {
+                    body.append(buffer, size);
+                }
+                return body;
+            }
+
+            /**
+             * @return the number of bytes of the body read so far.
+             */
+            std::size_t bytes_read() const noexcept { return handler != nullptr ? req_nb_bytes_read(handler) : 0; }
+
+            /**
+             * @brief Close the response now, the connection goes back to the pool if its body was entirely read.
+             */
+            void close() noexcept { req_close_connection(&handler); }
+
+            RequestsHandler* get() const noexcept { return handler; }
+
+            /**
+             * @brief Give up the ownership of the handler, it must then be closed with `req_close_connection`.
+             */
+            RequestsHandler* release() noexcept { return std::exchange(handler, nullptr); }
+
+        private:
+            RequestsHandler* handler = nullptr;
+        };
+
+
+        /**
+         * @brief A config with its own pool of connections, so keep-alive is used without passing handlers around.
+         * @brief It can be moved but not copied. Its responses must be destroyed before it.
+         * @brief Like the config, it can be shared by many threads.
+         */
+        class Session
+        {
+        public:
+            /**
+             * @param max_idle_per_origin the maximum number of idle connections kept for a single origin.
+             */
+            explicit Session(std::size_t max_idle_per_origin = 8) noexcept : config_(req_config_default()), pool(req_pool_init(max_idle_per_origin))
+            {
+                if(config_ == nullptr || pool == nullptr)
+                {
+                    free();
+                    return;
+                }
+                req_config_set_pool(config_, pool);
+            }
+            Session(Session&& other) noexcept : config_(std::exchange(other.config_, nullptr)), pool(std::exchange(other.pool, nullptr)) {}
+            Session& operator=(Session&& other) noexcept
+            {
+                if(this != &other)
+                {
+                    free();
+                    config_ = std::exchange(other.config_, nullptr);
+                    pool = std::exchange(other.pool, nullptr);
+                }
+                return *this;
+            }
+            Session(const Session&) = delete;
+            Session& operator=(const Session&) = delete;
+            ~Session() { free(); }
+
+            /**
+             * @return false if there was a memory error while creating the session.
+             */
+            explicit operator bool() const noexcept { return config_ != nullptr; }
+
+            /**
+             * @brief The config of the session, to change it with the `req_config_set_...` functions.
+             */
+            RequestsConfig* config() const noexcept { return config_; }
+
+            /**
+             * @brief Send a request. `method` is followed by a space like in `req_request`, for example `"OPTIONS "`.
+             * @brief `headers` are formatted like the `additional_headers` of the C functions.
+             */
+            Response request(CString method, CString url, CString data = "", CString headers = "") const noexcept
+            {
+                if(config_ == nullptr)
+                {
+                    return Response();
+                }
+                return Response(req_request(config_, nullptr, method.c_str(), url.c_str(), data.c_str(), headers.c_str()));
+            }
+
+            Response get(CString url, CString headers = "") const noexcept { return request("GET ", url, "", headers); }
+            Response head(CString url, CString headers = "") const noexcept { return request("HEAD ", url, "", headers); }
+            Response del(CString url, CString headers = "") const noexcept { return request("DELETE ", url, "", headers); }
+            Response post(CString url, CString data, CString headers = "") const noexcept { return request("POST ", url, data, headers); }
+            Response put(CString url, CString data, CString headers = "") const noexcept { return request("PUT ", url, data, headers); }
+            Response patch(CString url, CString data, CString headers = "") const noexcept { return request("PATCH ", url, data, headers); }
+
+        private:
+            void free() noexcept
+            {
+                req_config_free(&config_);
+                req_pool_free(&pool);
+            }
+
+            RequestsConfig* config_;
+            RequestsPool* pool;
+        };
+    }
+#endif
@@ -0,0 +1,403 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "requests_helper/strings/strings.h"
+#include "requests_helper/parsing/parsing.h"
+#include "requests.h"
+
+#define HOST_KEY_MAX_LENGTH (RH_MAX_CHAR_ON_HOST + sizeof(":65535:s"))
+#define MAX_QUEUED_URLS 65536  /* how many urls can wait in the host queues before the iterator is paused, it only bounds the memory */
+
+typedef struct _pending_url {
+    char* url;
+    size_t index;
+    struct _pending_url* next;
+} PendingUrl;
+
+typedef struct _host_queue {
+    char key[HOST_KEY_MAX_LENGTH];
+    PendingUrl* first;
+    PendingUrl* last;
+    size_t in_flight;
+} HostQueue;
+
+typedef struct _batch {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    req_url_iterator next_url;
+    void* iterator_data;
+    bool iterator_exhausted;
+    size_t next_index;
+
+    HostQueue* hosts;
+    size_t nb_hosts;
+    size_t hosts_capacity;
+    size_t round_robin;
+    size_t nb_pending;
+    size_t max_pending;
+    size_t max_per_host;
+
+    RequestsConfig* config;
+    const char* additional_headers;
+    req_batch_callback callback;
+    void* user_data;
+    bool failed;
+} Batch;
+
+typedef struct _array_iterator {
+    const char* const* urls;
+    size_t nb_urls;
+    size_t i;
+} ArrayIterator;
+
+
+static const char* array_next_url(void* iterator_data)
+{
+    ArrayIterator* it = (ArrayIterator*)iterator_data;
+    if(it->i >= it->nb_urls)
+    {
+        return NULL;
+    }
+    it->i++;
+    return it->urls[it->i - 1];
+}
+
+/*
+Returns the queue of the host identified by KEY, creating it if needed.
+The batch must be locked.
+*/
+static HostQueue* get_host_queue(Batch* batch, const char* key)
+{
+    for(size_t i = 0; i < batch->nb_hosts; i++)
+    {
+        if(strcmp(batch->hosts[i].key, key) == 0)
+        {
+            return &(batch->hosts[i]);
+        }
+    }
+    if(batch->nb_hosts == batch->hosts_capacity)
+    {
+        size_t capacity = batch->hosts_capacity == 0 ? 16 : 2 * batch->hosts_capacity;
+        HostQueue* temp = (HostQueue*) realloc(batch->hosts, capacity * sizeof(HostQueue));
+        if(temp == NULL)
+        {
+            return NULL;
+        }
+        batch->hosts = temp;
+        batch->hosts_capacity = capacity;
+    }
+    HostQueue* host = &(batch->hosts[batch->nb_hosts]);
+    rh_strncpy(host->key, key, HOST_KEY_MAX_LENGTH);
+    host->first = NULL;
+    host->last = NULL;
+    host->in_flight = 0;
+    batch->nb_hosts++;
+    return host;
+}
+
+/*
+Remove the hosts that have nothing left to do, so the round robin stays short.
+The batch must be locked.
+*/
+static void remove_idle_hosts(Batch* batch)
+{
+    size_t j = 0;
+    for(size_t i = 0; i < batch->nb_hosts; i++)
+    {
+        if(batch->hosts[i].first != NULL || batch->hosts[i].in_flight > 0)
+        {
+            batch->hosts[j] = batch->hosts[i];
+            j++;
+        }
+    }
+    batch->nb_hosts = j;
+    if(batch->round_robin >= batch->nb_hosts)
+    {
+        batch->round_robin = 0;
+    }
+}
+
+/*
+Pull one url from the iterator and put it in the queue of its host.
+Returns false if the iterator is exhausted or if there is a memory error.
+The batch must be locked.
+*/
+static bool pull_url(Batch* batch)
+{
+    rh_UrlSplitted url_splitted;
+    char key[HOST_KEY_MAX_LENGTH];
+    char port_str[8];
+    const char* url;
+    size_t index;
+    HostQueue* host;
+    PendingUrl* pending;
+
+    if(batch->iterator_exhausted)
+    {
+        return false;
+    }
+    url = (*batch->next_url)(batch->iterator_data);
+    if(url == NULL)
+    {
+        batch->iterator_exhausted = true;
+        return false;
+    }
+    index = batch->next_index;
+    batch->next_index++;
+
+    if(rh_parse_url(url, &url_splitted))
+    {
+        rh_uint64_to_str(port_str, url_splitted.port);
+        rh_strcpy(rh_strcpy(rh_strcpy(rh_strcpy(key, url_splitted.host), ":"), port_str), url_splitted.secured ? ":s" : ":");
+        rh_url_free(&url_splitted);
+    }
+    else
+    {
+        // the request will fail in the worker and the callback will get a NULL handler
+        key[0] = '\0';
+    }
+
+    host = get_host_queue(batch, key);
+    pending = (PendingUrl*) malloc(sizeof(PendingUrl));
+    if(host == NULL || pending == NULL)
+    {
+        free(pending);
+        batch->failed = true;
+        batch->iterator_exhausted = true;
+        return false;
+    }
+    pending->url = (char*) malloc((strlen(url) + 1) * sizeof(char));
+    if(pending->url == NULL)
+    {
+        free(pending);
+        batch->failed = true;
+        batch->iterator_exhausted = true;
+        return false;
+    }
+    rh_strcpy(pending->url, url);
+    pending->index = index;
+    pending->next = NULL;
+
+    if(host->last == NULL)
+    {
+        host->first = pending;
+    }
+    else
+    {
+        host->last->next = pending;
+    }
+    host->last = pending;
+    batch->nb_pending++;
+
+    return true;
+}
+
+/*
+Take the next url of the first host, in round robin order, that is under its concurrency limit.
+The round robin ensures that a slow host can't starve the others.
+The batch must be locked.
+*/
+static PendingUrl* pick_url(Batch* batch, HostQueue** host_picked)
+{
+    for(size_t n = 0; n < batch->nb_hosts; n++)
+    {
+        HostQueue* host = &(batch->hosts[(batch->round_robin + n) % batch->nb_hosts]);
+        if(host->first != NULL && host->in_flight < batch->max_per_host)
+        {
+            PendingUrl* pending = host->first;
+            host->first = pending->next;
+            if(host->first == NULL)
+            {
+                host->last = NULL;
+            }
+            host->in_flight++;
+            batch->nb_pending--;
+            batch->round_robin = (batch->round_robin + n + 1) % batch->nb_hosts;
+            *host_picked = host;
+            return pending;
+        }
+    }
+    return NULL;
+}
+
+static void* batch_worker(void* arg)
+{
+    Batch* batch = (Batch*)arg;
+    RequestsHandler* handler = NULL;
+
+    pthread_mutex_lock(&(batch->lock));
+    while(true)
+    {
+        HostQueue* host = NULL;
+        PendingUrl* pending = pick_url(batch, &host);
+
+        // The urls are only pulled while every queued host is at its limit, so a long run of urls for one host
+        // can't hide the urls of the other hosts, that come next in the iterator
+        while(pending == NULL && batch->nb_pending < batch->max_pending && pull_url(batch))
+        {
+            pending = pick_url(batch, &host);
+        }
+
+        if(pending == NULL)
+        {
+            if(batch->iterator_exhausted && batch->nb_pending == 0)
+            {
+                break;
+            }
+            // All the queued hosts are at their limit and nothing more can be pulled, wait for a request to finish
+            pthread_cond_wait(&(batch->changed), &(batch->lock));
+            continue;
+        }
+
+        char key[HOST_KEY_MAX_LENGTH];
+        rh_strncpy(key, host->key, HOST_KEY_MAX_LENGTH);  // host may move in memory while the batch is unlocked
+        pthread_mutex_unlock(&(batch->lock));
+
+        handler = req_get(batch->config, NULL, pending->url, batch->additional_headers);
+        (*batch->callback)(handler, pending->url, pending->index, batch->user_data);
+        req_close_connection(&handler);  // the connection goes back to the pool
+
+        free(pending->url);
+        free(pending);
+
+        pthread_mutex_lock(&(batch->lock));
+        host = get_host_queue(batch, key);
+        if(host != NULL)
+        {
+            host->in_flight--;
+        }
+        remove_idle_hosts(batch);
+        pthread_cond_broadcast(&(batch->changed));
+    }
+    pthread_cond_broadcast(&(batch->changed));
+    pthread_mutex_unlock(&(batch->lock));
+
+    return NULL;
+}
+
+/*
+Send a GET request for each url returned by NEXT_URL, with at most MAX_IN_FLIGHT requests at the same time and at most MAX_PER_HOST requests on the same host.
+CALLBACK is called from a worker thread for each response.
+*/
+bool req_get_many_iterator(RequestsConfig* config, req_url_iterator next_url, void* iterator_data, const char* additional_headers, size_t max_in_flight, size_t max_per_host, req_batch_callback callback, void* user_data)
+{
+    Batch batch;
+    RequestsPool* pool = NULL;
+    pthread_t* workers = NULL;
+    size_t nb_workers = 0;
+    bool success = false;
+
+    if(max_in_flight == 0 || max_per_host == 0)
+    {
+        return false;
+    }
+
+    batch.config = config == NULL ? req_config_default() : req_config_copy(config);
+    if(batch.config == NULL)
+    {
+        return false;
+    }
+    if(req_config_get_pool(batch.config) == NULL)
+    {
+        // connections must be reused per origin even if the caller doesn't have a pool
+        pool = req_pool_init(max_per_host);
+        if(pool == NULL)
+        {
+            goto FREE;
+        }
+        req_config_set_pool(batch.config, pool);
+    }
+
+    workers = (pthread_t*) malloc(max_in_flight * sizeof(pthread_t));
+    if(workers == NULL)
+    {
+        goto FREE;
+    }
+
+    if(pthread_mutex_init(&(batch.lock), NULL) != 0)
+    {
+        goto FREE;
+    }
+    if(pthread_cond_init(&(batch.changed), NULL) != 0)
+    {
+        pthread_mutex_destroy(&(batch.lock));
+        goto FREE;
+    }
+
+    batch.next_url = next_url;
+    batch.iterator_data = iterator_data;
+    batch.iterator_exhausted = false;
+    batch.next_index = 0;
+    batch.hosts = NULL;
+    batch.nb_hosts = 0;
+    batch.hosts_capacity = 0;
+    batch.round_robin = 0;
+    batch.nb_pending = 0;
+    batch.max_pending = MAX_QUEUED_URLS;
+    batch.max_per_host = max_per_host;
+    batch.additional_headers = additional_headers;
+    batch.callback = callback;
+    batch.user_data = user_data;
+    batch.failed = false;
+
+    for(nb_workers = 0; nb_workers < max_in_flight; nb_workers++)
+    {
+        if(pthread_create(&(workers[nb_workers]), NULL, batch_worker, &batch) != 0)
+        {
+            break;
+        }
+    }
+    if(nb_workers == 0)
+    {
+        // not a single thread could be started, do the job in this one
+        batch_worker(&batch);
+    }
+    for(size_t i = 0; i < nb_workers; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    success = !batch.failed;
+
+    for(size_t i = 0; i < batch.nb_hosts; i++)
+    {
+        // not empty only after a memory error
+        while(batch.hosts[i].first != NULL)
+        {
+            PendingUrl* next = batch.hosts[i].first->next;
+            free(batch.hosts[i].first->url);
+            free(batch.hosts[i].first);
+            batch.hosts[i].first = next;
+        }
+    }
+    free(batch.hosts);
+    pthread_cond_destroy(&(batch.changed));
+    pthread_mutex_destroy(&(batch.lock));
+
+FREE:
+    free(workers);
+    req_config_free(&(batch.config));
+    req_pool_free(&pool);
+    return success;
+}
+
+bool req_get_many(RequestsConfig* config, const char* const* urls, size_t nb_urls, const char* additional_headers, size_t max_in_flight, size_t max_per_host, req_batch_callback callback, void* user_data)
+{
+    ArrayIterator it = {
+        .urls = urls,
+        .nb_urls = nb_urls,
+        .i = 0
+    };
+
+    if(max_in_flight > nb_urls)
+    {
+        max_in_flight = nb_urls;
+    }
+    if(nb_urls == 0)
+    {
+        return true;
+    }
+
+    return req_get_many_iterator(config, array_next_url, &it, additional_headers, max_in_flight, max_per_host, callback, user_data);
+}
@@ -0,0 +1,409 @@
+#ifndef REQUESTS_CORO_HPP
+    #define REQUESTS_CORO_HPP
+    #include <cerrno>
+    #include <coroutine>
+    #include <cstddef>
+    #include <exception>
+    #include <optional>
+    #include <string>
+    #include <string_view>
+    #include <utility>
+    #ifndef __linux__
+        #error "requests_coro.hpp needs epoll, it's only available on Linux"
+    #endif
+    #include <sys/epoll.h>
+    #include <unistd.h>
+    #include "requests.hpp"
+
+    /* C++20 coroutines over the non-blocking functions of requests.h. Many requests are driven by a single thread, with an epoll loop. */
+
+    namespace requests
+    {
+        class EventLoop;
+        template <typename T = void>
+        class Task;
+
+        namespace detail
+        {
+            /**
+             * @brief An operation suspended until its socket is ready. The loop calls `try_complete` on each event and resumes the coroutine once it returns true.
+             */
+            struct Waiter
+            {
+                std::coroutine_handle<> coroutine;
+                bool (*try_complete)(Waiter* waiter) noexcept = nullptr;
+                int fd = -1;
+                RequestsProgress progress = REQ_DONE;
+            };
+
+            struct PromiseBase
+            {
+                struct FinalAwaiter
+                {
+                    bool await_ready() const noexcept { return false; }
+                    template <typename Promise>
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> coroutine) const noexcept { return coroutine.promise().continuation; }
+                    void await_resume() const noexcept {}
+                };
+
+                std::suspend_always initial_suspend() const noexcept { return {}; }
+                FinalAwaiter final_suspend() const noexcept { return {}; }
+                void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+                std::coroutine_handle<> continuation = std::noop_coroutine();
+                std::exception_ptr exception;
+            };
+
+            template <typename T>
+            struct Promise : PromiseBase
+            {
+                Task<T> get_return_object() noexcept;
+                template <typename U>
+                void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+                T result()
+                {
+                    if(exception)
+                    {
+                        std::rethrow_exception(exception);
+                    }
+                    return std::move(*value);
+                }
+
+                std::optional<T> value;
+            };
+
+            template <>
+            struct Promise<void> : PromiseBase
+            {
+                Task<void> get_return_object() noexcept;
+                void return_void() const noexcept {}
+                void result() const
+                {
+                    if(exception)
+                    {
+                        std::rethrow_exception(exception);
+                    }
+                }
+            };
+        }
+
+
+        /**
+         * @brief A coroutine that starts when it's awaited and gives back a `T`. It can be moved but not copied.
+         * @brief The tasks that nobody awaits are started with `EventLoop::spawn`.
+         */
+        template <typename T>
+        class Task
+        {
+        public:
+            using promise_type = detail::Promise<T>;
+
+            Task() noexcept = default;
+            explicit Task(std::coroutine_handle<promise_type> coroutine) noexcept : coroutine(coroutine) {}
+            Task(Task&& other) noexcept : coroutine(std::exchange(other.coroutine, nullptr)) {}
+            Task& operator=(Task&& other) noexcept
+            {
+                if(this != &other)
+                {
+                    destroy();
+                    coroutine = std::exchange(other.coroutine, nullptr);
+                }
+                return *this;
+            }
+            Task(const Task&) = delete;
+            Task& operator=(const Task&) = delete;
+            ~Task() { destroy(); }
+
+            auto operator co_await() const noexcept
+            {
+                struct Awaiter
+                {
+                    bool await_ready() const noexcept { return !coroutine || coroutine.done(); }
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) const noexcept
+                    {
+                        coroutine.promise().continuation = caller;
+                        return coroutine;
+                    }
+                    T await_resume() const { return coroutine.promise().result(); }
+
+                    std::coroutine_handle<promise_type> coroutine;
+                };
+                return Awaiter{coroutine};
+            }
+
+        private:
+            void destroy() noexcept
+            {
+                if(coroutine)
+                {
+                    coroutine.destroy();
+                    coroutine = nullptr;
+                }
+            }
+
+            std::coroutine_handle<promise_type> coroutine;
+        };
+
+        template <typename T>
+        Task<T> detail::Promise<T>::get_return_object() noexcept { return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this)); }
+        inline Task<void> detail::Promise<void>::get_return_object() noexcept { return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this)); }
+
+
+        /**
+         * @brief Waits for the sockets of the operations in progress and resumes their coroutines. It must be used by a single thread.
+         */
+        class EventLoop
+        {
+        public:
+            EventLoop() noexcept : epoll_fd(epoll_create1(EPOLL_CLOEXEC)) {}
+            EventLoop(const EventLoop&) = delete;
+            EventLoop& operator=(const EventLoop&) = delete;
+            ~EventLoop()
+            {
+                if(epoll_fd != -1)
+                {
+                    ::close(epoll_fd);
+                }
+            }
+
+            /**
+             * @return false if the epoll instance couldn't be created.
+             */
+            explicit operator bool() const noexcept { return epoll_fd != -1; }
+
+            /**
+             * @brief Start `task` now, it runs until it waits for a socket and `run` drives the rest. An exception that escapes it calls `std::terminate`.
+             */
+            void spawn(Task<void> task)
+            {
+                nb_tasks++;
+                detach(this, std::move(task));
+            }
+
+            /**
+             * @brief Wait for the sockets and resume the coroutines until all the spawned tasks are finished.
+             * @return false if epoll failed, the unfinished tasks are then left suspended.
+             */
+            bool run() noexcept
+            {
+                epoll_event events[64];
+                while(nb_tasks > 0)
+                {
+                    int nb_events = epoll_wait(epoll_fd, events, 64, -1);
+                    if(nb_events < 0 && errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if(nb_events < 0)
+                    {
+                        return false;
+                    }
+                    for(int i = 0; i < nb_events; i++)
+                    {
+                        detail::Waiter* waiter = static_cast<detail::Waiter*>(events[i].data.ptr);
+                        if(waiter->try_complete(waiter) || !arm(waiter))
+                        {
+                            waiter->coroutine.resume();
+                        }
+                    }
+                }
+                return true;
+            }
+
+            /**
+             * @brief Watch the socket of `waiter` for the event it asks. It fires once, then the socket is ignored until it's armed again.
+             * @return false if the socket can't be watched, `waiter->progress` is then set to `REQ_FAILED`.
+             */
+            bool arm(detail::Waiter* waiter) noexcept
+            {
+                epoll_event event = {};
+                event.events = (waiter->progress == REQ_WANT_WRITE ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+                event.data.ptr = waiter;
+                if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, waiter->fd, &event) == 0 || (errno == ENOENT && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, waiter->fd, &event) == 0))
+                {
+                    return true;
+                }
+                waiter->progress = REQ_FAILED;
+                return false;
+            }
+
+        private:
+            struct Detached
+            {
+                struct promise_type
+                {
+                    Detached get_return_object() const noexcept { return {}; }
+                    std::suspend_never initial_suspend() const noexcept { return {}; }
+                    std::suspend_never final_suspend() const noexcept { return {}; }
+                    void return_void() const noexcept {}
+                    void unhandled_exception() const noexcept { std::terminate(); }
+                };
+            };
+
+            static Detached detach(EventLoop* loop, Task<void> task)
+            {
+                co_await task;
+                loop->nb_tasks--;
+            }
+
+            int epoll_fd;
+            std::size_t nb_tasks = 0;
+        };
+
+
+        /**
+         * @brief Awaited to read the next part of a body, see `AsyncResponse::read`.
+         */
+        class ReadOperation : private detail::Waiter
+        {
+        public:
+            ReadOperation(EventLoop* loop, RequestsHandler* handler, Bytes buffer) noexcept : loop(loop), handler(handler), buffer(buffer)
+            {
+                try_complete = &ReadOperation::complete;
+            }
+            ReadOperation(const ReadOperation&) = delete;
+            ReadOperation& operator=(const ReadOperation&) = delete;
+
+            bool await_ready() noexcept { return handler == nullptr || step(); }
+            bool await_suspend(std::coroutine_handle<> caller) noexcept
+            {
+                coroutine = caller;
+                return loop->arm(this);
+            }
+            std::size_t await_resume() const noexcept { return size; }
+
+        private:
+            bool step() noexcept
+            {
+                progress = req_read_output_body_nonblocking(handler, buffer.data(), buffer.size(), &size);
+                fd = req_get_socket(handler);
+                return progress == REQ_DONE || progress == REQ_FAILED;
+            }
+            static bool complete(detail::Waiter* waiter) noexcept { return static_cast<ReadOperation*>(waiter)->step(); }
+
+            EventLoop* loop;
+            RequestsHandler* handler;
+            Bytes buffer;
+            std::size_t size = 0;
+        };
+
+
+        /**
+         * @brief A response whose body is read with `co_await`. Like `Response`, it's closed (or given back to the pool of its session) when it's destroyed.
+         */
+        class AsyncResponse
+        {
+        public:
+            AsyncResponse() noexcept = default;
+            AsyncResponse(EventLoop* loop, RequestsHandler* handler) noexcept : loop(loop), response(handler) {}
+
+            explicit operator bool() const noexcept { return static_cast<bool>(response); }
+            unsigned short int status_code() const noexcept { return response.status_code(); }
+            std::optional<std::string_view> header(CString name) const noexcept { return response.header(name); }
+
+            /**
+             * @brief `std::size_t size = co_await response.read(buffer);` gives what has arrived of the body, without waiting to fill `buffer`.
+             * @brief The size is 0 at the end of the body, or if it couldn't be read entirely.
+             */
+            ReadOperation read(Bytes buffer) noexcept { return ReadOperation(loop, response.get(), buffer); }
+
+            /**
+             * @brief Read the rest of the body in a string.
+             */
+            Task<std::string> text()
+            {
+                std::string body;
+                char buffer[16384];
+                std::size_t size;
+                while((size = co_await read(buffer)) > 0)
+                {
+                    body.append(buffer, size);
+                }
+                co_return body;
+            }
+
+            std::size_t bytes_read() const noexcept { return response.bytes_read(); }
+            void close() noexcept { response.close(); }
+            RequestsHandler* get() const noexcept { return response.get(); }
+            RequestsHandler* release() noexcept { return response.release(); }
+
+        private:
+            EventLoop* loop = nullptr;
+            Response response;
+        };
+
+
+        /**
+         * @brief Awaited to get the response of a request started by `AsyncSession`.
+         */
+        class RequestOperation : private detail::Waiter
+        {
+        public:
+            RequestOperation(EventLoop* loop, RequestsHandler* handler) noexcept : loop(loop), handler(handler)
+            {
+                try_complete = &RequestOperation::complete;
+            }
+            RequestOperation(const RequestOperation&) = delete;
+            RequestOperation& operator=(const RequestOperation&) = delete;
+            ~RequestOperation() { req_close_connection(&handler); }
+
+            bool await_ready() noexcept { return handler == nullptr || step(); }
+            bool await_suspend(std::coroutine_handle<> caller) noexcept
+            {
+                coroutine = caller;
+                return loop->arm(this);
+            }
+            AsyncResponse await_resume() noexcept
+            {
+                if(progress != REQ_DONE)
+                {
+                    req_close_connection(&handler);
+                }
+                return AsyncResponse(loop, std::exchange(handler, nullptr));
+            }
+
+        private:
+            bool step() noexcept
+            {
+                progress = req_request_continue(handler);
+                fd = req_get_socket(handler);
+                return progress == REQ_DONE || progress == REQ_FAILED;
+            }
+            static bool complete(detail::Waiter* waiter) noexcept { return static_cast<RequestOperation*>(waiter)->step(); }
+
+            EventLoop* loop;
+            RequestsHandler* handler;
+        };
+
+
+        /**
+         * @brief A `Session` whose requests are awaited: `AsyncResponse response = co_await session.get(url);`
+         * @brief The request starts when the method is called, and only the resolution of the host name blocks. The strings can be freed right after the call.
+         * @brief Redirections, retries, the cache and the single flight are only done by `Session`. Its responses must be destroyed before it.
+         */
+        class AsyncSession
+        {
+        public:
+            explicit AsyncSession(EventLoop& loop, std::size_t max_idle_per_origin = 8) noexcept : loop(&loop), session(max_idle_per_origin) {}
+
+            explicit operator bool() const noexcept { return static_cast<bool>(session); }
+            RequestsConfig* config() const noexcept { return session.config(); }
+
+            RequestOperation request(CString method, CString url, CString data = "", CString headers = "") const noexcept
+            {
+                return RequestOperation(loop, session ? req_request_start(session.config(), method.c_str(), url.c_str(), data.c_str(), headers.c_str()) : nullptr);
+            }
+
+            RequestOperation get(CString url, CString headers = "") const noexcept { return request("GET ", url, "", headers); }
+            RequestOperation head(CString url, CString headers = "") const noexcept { return request("HEAD ", url, "", headers); }
+            RequestOperation del(CString url, CString headers = "") const noexcept { return request("DELETE ", url, "", headers); }
+            RequestOperation post(CString url, CString data, CString headers = "") const noexcept { return request("POST ", url, data, headers); }
+            RequestOperation put(CString url, CString data, CString headers = "") const noexcept { return request("PUT ", url, data, headers); }
+            RequestOperation patch(CString url, CString data, CString headers = "") const noexcept { return request("PATCH ", url, data, headers); }
+
+        private:
+            EventLoop* loop;
+            Session session;
+        };
+    }
+#endif
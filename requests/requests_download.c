@@ -0,0 +1,554 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef WIN32
+    #include <sys/mman.h>
+    #include <pthread.h>
+#endif
+
+#include "requests_helper/strings/strings.h"
+#include "requests_helper/time/timer.h"
+#include "requests.h"
+
+#ifndef O_BINARY
+    #define O_BINARY 0
+#endif
+
+#define RANGE_HEADER_LENGTH (sizeof("Range: bytes=-\r\n") + 2 * 20)
+
+#define MIN_RANGE_SIZE ((uint64_t)256 * 1024)
+#define MAX_RANGE_SIZE ((uint64_t)64 * 1024 * 1024)
+#define TARGET_RANGE_DURATION_MS 1000  /* ranges are sized to last about this long at the measured speed */
+#define MAX_RANGE_ATTEMPTS 4
+
+
+/*
+Parse a Content-Range header like "bytes 100-199/1000", the range and the total can also be replaced by '*'.
+START and END are set to UINT64_MAX if there is no range, TOTAL is set to UINT64_MAX if it's unknown.
+Returns false if the header is malformed.
+*/
+static bool parse_content_range(const char* content_range, uint64_t* start, uint64_t* end, uint64_t* total)
+{
+    char number[21];
+    size_t i;
+
+    if(content_range == NULL || !rh_startswith(content_range, "bytes "))
+    {
+        return false;
+    }
+    content_range += 6;
+
+    *start = UINT64_MAX;
+    *end = UINT64_MAX;
+    if(*content_range == '*')
+    {
+        content_range++;
+    }
+    else
+    {
+        for(i = 0; i < 20 && RH_CHAR_IS_DIGIT(*content_range); i++, content_range++)
+            number[i] = *content_range;
+        number[i] = '\0';
+        if(i == 0 || *content_range != '-')
+            return false;
+        *start = rh_str_to_uint64(number);
+        content_range++;
+
+        for(i = 0; i < 20 && RH_CHAR_IS_DIGIT(*content_range); i++, content_range++)
+            number[i] = *content_range;
+        number[i] = '\0';
+        if(i == 0)
+            return false;
+        *end = rh_str_to_uint64(number);
+    }
+
+    if(*content_range != '/')
+    {
+        return false;
+    }
+    content_range++;
+    if(*content_range == '*')
+    {
+        *total = UINT64_MAX;
+        return true;
+    }
+    *total = rh_str_to_uint64(content_range);
+    return *total != UINT64_MAX;
+}
+
+/*
+Write RANGE_START and RANGE_END in a Range header.
+If RANGE_END is UINT64_MAX, the range goes to the end of the resource.
+*/
+static void build_range_header(char* header, uint64_t range_start, uint64_t range_end)
+{
+    char number[21];
+    header = rh_strcpy(header, "Range: bytes=");
+    header = rh_strcpy(header, rh_uint64_to_str(number, range_start));
+    header = rh_strcpy(header, "-");
+    if(range_end != UINT64_MAX)
+    {
+        header = rh_strcpy(header, rh_uint64_to_str(number, range_end));
+    }
+    rh_strcpy(header, "\r\n");
+}
+
+/*
+Returns the length of the body announced by the server, or UINT64_MAX if the body is chunked or has no length.
+*/
+static uint64_t get_body_length(RequestsHandler* handler)
+{
+    const char* content_length = req_get_header_value(handler, "content-length");
+    const char* transfer_encoding = req_get_header_value(handler, "transfer-encoding");
+    if(content_length == NULL || (transfer_encoding != NULL && rh_str_search_case_unsensitive(transfer_encoding, "chunked") != -1))
+    {
+        return UINT64_MAX;
+    }
+    return rh_str_to_uint64(content_length);
+}
+
+typedef struct _file_sink {
+    int fd;
+    uint64_t written;
+} FileSink;
+
+static bool write_to_file(const char* data, size_t size, void* user_data)
+{
+    FileSink* file = (FileSink*)user_data;
+    size_t done = 0;
+    while(done < size)
+    {
+        ssize_t n = write(file->fd, data + done, size - done);
+        if(n <= 0)
+        {
+            return false;
+        }
+        done += (size_t)n;
+        file->written += (uint64_t)n;
+    }
+    return true;
+}
+
+/*
+Copy the body of HANDLER in FD, starting at OFFSET.
+WRITTEN is set to the number of bytes written.
+Returns false if the body couldn't be entirely written.
+*/
+static bool write_body_buffered(RequestsHandler* handler, int fd, uint64_t offset, uint64_t* written)
+{
+    RequestsSink sink = {
+        .on_status = NULL,
+        .on_header = NULL,
+        .on_body = write_to_file
+    };
+    FileSink file = {
+        .fd = fd,
+        .written = 0
+    };
+    bool success;
+
+    if(lseek(fd, (off_t)offset, SEEK_SET) == (off_t)-1)
+    {
+        *written = 0;
+        return false;
+    }
+
+    success = req_stream_output(handler, &sink, &file);
+    *written = file.written;
+    return success;
+}
+
+#ifndef WIN32
+/*
+Preallocate FD to OFFSET + LENGTH bytes, map it and read the body of HANDLER directly into the mapping.
+Returns the number of bytes written, or UINT64_MAX if the file couldn't be mapped.
+*/
+static uint64_t write_body_mapped(RequestsHandler* handler, int fd, uint64_t offset, uint64_t length)
+{
+    uint64_t file_size = offset + length;
+    uint64_t written = 0;
+    char* map;
+
+    if(length == 0 || file_size > (uint64_t)SIZE_MAX || file_size > (uint64_t)INT64_MAX)
+    {
+        return UINT64_MAX;
+    }
+
+    #ifdef __linux__
+        if(posix_fallocate(fd, 0, (off_t)file_size) != 0 && ftruncate(fd, (off_t)file_size) != 0)
+        {
+            return UINT64_MAX;
+        }
+    #else
+        if(ftruncate(fd, (off_t)file_size) != 0)
+        {
+            return UINT64_MAX;
+        }
+    #endif
+
+    map = (char*) mmap(NULL, (size_t)file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED)
+    {
+        return UINT64_MAX;
+    }
+
+    while(written < length)
+    {
+        size_t size = req_read_output_body(handler, map + offset + written, (size_t)(length - written));
+        if(size == 0)
+        {
+            break;
+        }
+        written += size;
+    }
+
+    munmap(map, (size_t)file_size);
+    return written;
+}
+#endif
+
+/*
+Download URL in the file at PATH.
+If the file already exists, only the missing part is requested with a Range header.
+*/
+bool req_download_file(RequestsConfig* config, const char* url, const char* path)
+{
+    char range_header[RANGE_HEADER_LENGTH] = "";
+    RequestsHandler* handler = NULL;
+    struct stat file_stat;
+    uint64_t offset = 0;
+    uint64_t length;
+    uint64_t written = UINT64_MAX;
+    bool success = false;
+    int fd;
+
+    fd = open(path, O_RDWR | O_CREAT | O_BINARY, 0644);
+    if(fd == -1)
+    {
+        return false;
+    }
+
+    if(fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+    {
+        offset = (uint64_t)file_stat.st_size;
+        build_range_header(range_header, offset, UINT64_MAX);
+    }
+
+    handler = req_get(config, NULL, url, range_header);
+    if(handler == NULL)
+    {
+        goto END;
+    }
+
+    if(offset > 0 && req_get_status_code(handler) == 416)
+    {
+        // Range Not Satisfiable, the file might already be complete
+        uint64_t start, end, total;
+        success = parse_content_range(req_get_header_value(handler, "content-range"), &start, &end, &total) && total == offset;
+        goto END;
+    }
+    if(offset > 0 && req_get_status_code(handler) == 206)
+    {
+        uint64_t start, end, total;
+        if(!parse_content_range(req_get_header_value(handler, "content-range"), &start, &end, &total) || start != offset)
+        {
+            goto END;
+        }
+    }
+    else if(req_get_status_code(handler) == 200)
+    {
+        // The server ignored the range, restart from the beginning
+        offset = 0;
+        if(ftruncate(fd, 0) != 0)
+        {
+            goto END;
+        }
+    }
+    else
+    {
+        goto END;
+    }
+
+    length = get_body_length(handler);
+
+    #ifndef WIN32
+        if(length != UINT64_MAX)
+        {
+            written = write_body_mapped(handler, fd, offset, length);
+            success = written == length;
+        }
+    #endif
+    if(written == UINT64_MAX)
+    {
+        success = write_body_buffered(handler, fd, offset, &written) && (length == UINT64_MAX || written == length);
+    }
+
+    if(!success)
+    {
+        // Keep only what was received, so the next call can resume from there
+        if(ftruncate(fd, (off_t)(offset + written)) != 0)
+        {
+            goto END;
+        }
+    }
+
+END:
+    req_close_connection(&handler);
+    close(fd);
+    return success;
+}
+
+
+#ifndef WIN32
+typedef struct _parallel_download {
+    pthread_mutex_t lock;
+    RequestsConfig* config;
+    const char* url;
+    char* map;
+    uint64_t total;
+    uint64_t next_offset;
+    size_t nb_connections;
+    bool aborted;
+} ParallelDownload;
+
+/*
+Reserve the next range of the file for a worker.
+The range is shortened at the end of the file, so all the connections finish at about the same time.
+Returns false if there is nothing left to download.
+*/
+static bool take_range(ParallelDownload* download, uint64_t wanted_size, uint64_t* start, uint64_t* end)
+{
+    bool found = false;
+    pthread_mutex_lock(&(download->lock));
+    if(!download->aborted && download->next_offset < download->total)
+    {
+        uint64_t remaining = download->total - download->next_offset;
+        uint64_t fair_share = (remaining + download->nb_connections - 1) / download->nb_connections;
+        if(wanted_size > fair_share)
+        {
+            wanted_size = fair_share < MIN_RANGE_SIZE ? MIN_RANGE_SIZE : fair_share;
+        }
+        if(wanted_size > remaining)
+        {
+            wanted_size = remaining;
+        }
+        *start = download->next_offset;
+        *end = download->next_offset + wanted_size;
+        download->next_offset = *end;
+        found = true;
+    }
+    pthread_mutex_unlock(&(download->lock));
+    return found;
+}
+
+/*
+Download the bytes from START (included) to END (excluded) in the mapping.
+START is moved forward with the bytes received, so a failed range can be retried from where it stopped.
+*/
+static bool download_range(ParallelDownload* download, RequestsHandler** handler, uint64_t* start, uint64_t end)
+{
+    char range_header[RANGE_HEADER_LENGTH];
+    uint64_t range_start, range_end, total;
+
+    build_range_header(range_header, *start, end - 1);
+    *handler = req_get(download->config, *handler, download->url, range_header);
+    if(*handler == NULL)
+    {
+        return false;
+    }
+    if(req_get_status_code(*handler) != 206
+        || !parse_content_range(req_get_header_value(*handler, "content-range"), &range_start, &range_end, &total)
+        || range_start != *start || range_end != end - 1 || total != download->total)
+    {
+        // The server doesn't serve this range as expected, retrying is useless
+        pthread_mutex_lock(&(download->lock));
+        download->aborted = true;
+        pthread_mutex_unlock(&(download->lock));
+        return false;
+    }
+
+    while(*start < end)
+    {
+        size_t size = req_read_output_body(*handler, download->map + *start, (size_t)(end - *start));
+        if(size == 0)
+        {
+            return false;
+        }
+        *start += size;
+    }
+    return true;
+}
+
+static void* download_worker(void* arg)
+{
+    ParallelDownload* download = (ParallelDownload*)arg;
+    RequestsHandler* handler = NULL;
+    uint64_t range_size = MIN_RANGE_SIZE;
+    uint64_t start, end;
+
+    while(take_range(download, range_size, &start, &end))
+    {
+        uint64_t range_start = start;
+        unsigned int attempts = 1;
+        rh_nanoseconds timer = rh_timer_now();
+
+        while(!download_range(download, &handler, &start, end))
+        {
+            req_close_connection(&handler);  // the next attempt uses a new connection
+            pthread_mutex_lock(&(download->lock));
+            if(attempts >= MAX_RANGE_ATTEMPTS)
+            {
+                download->aborted = true;
+            }
+            bool aborted = download->aborted;
+            pthread_mutex_unlock(&(download->lock));
+            if(aborted)
+            {
+                req_close_connection(&handler);
+                return NULL;
+            }
+            attempts++;
+        }
+
+        // Adapt the size of the next range to the speed of this connection
+        rh_milliseconds elapsed = rh_timer_elapsed_ms(timer);
+        if(elapsed == 0)
+        {
+            elapsed = 1;
+        }
+        range_size = (end - range_start) * TARGET_RANGE_DURATION_MS / elapsed;
+        if(range_size < MIN_RANGE_SIZE)
+        {
+            range_size = MIN_RANGE_SIZE;
+        }
+        else if(range_size > MAX_RANGE_SIZE)
+        {
+            range_size = MAX_RANGE_SIZE;
+        }
+    }
+
+    req_close_connection(&handler);
+    return NULL;
+}
+#endif
+
+/*
+Download URL in the file at PATH, with NB_CONNECTIONS connections that each fetch a different range of the file.
+If the server doesn't support ranges, it works like req_download_file.
+*/
+bool req_download_file_parallel(RequestsConfig* config, const char* url, const char* path, size_t nb_connections)
+{
+#ifdef WIN32
+    (void)nb_connections;
+    return req_download_file(config, url, path);
+#else
+    ParallelDownload download;
+    RequestsHandler* handler;
+    pthread_t* workers = NULL;
+    const char* accept_ranges;
+    uint64_t total;
+    size_t nb_workers;
+    bool success = false;
+    int fd;
+
+    if(nb_connections <= 1)
+    {
+        return req_download_file(config, url, path);
+    }
+
+    handler = req_head(config, NULL, url, "");
+    if(handler == NULL)
+    {
+        return false;
+    }
+    accept_ranges = req_get_header_value(handler, "accept-ranges");
+    total = get_body_length(handler);
+    if(req_get_status_code(handler) != 200 || accept_ranges == NULL || rh_str_search_case_unsensitive(accept_ranges, "bytes") == -1
+        || total == UINT64_MAX || total == 0 || total > (uint64_t)SIZE_MAX || total > (uint64_t)INT64_MAX)
+    {
+        req_close_connection(&handler);
+        return req_download_file(config, url, path);
+    }
+    req_close_connection(&handler);
+
+    if(total / MIN_RANGE_SIZE + 1 < nb_connections)
+    {
+        // don't open connections that would have nothing to do
+        nb_connections = (size_t)(total / MIN_RANGE_SIZE + 1);
+    }
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if(fd == -1)
+    {
+        return false;
+    }
+    #ifdef __linux__
+        if(posix_fallocate(fd, 0, (off_t)total) != 0 && ftruncate(fd, (off_t)total) != 0)
+        {
+            goto CLOSE;
+        }
+    #else
+        if(ftruncate(fd, (off_t)total) != 0)
+        {
+            goto CLOSE;
+        }
+    #endif
+
+    download.map = (char*) mmap(NULL, (size_t)total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(download.map == MAP_FAILED)
+    {
+        goto CLOSE;
+    }
+
+    workers = (pthread_t*) malloc(nb_connections * sizeof(pthread_t));
+    if(workers == NULL || pthread_mutex_init(&(download.lock), NULL) != 0)
+    {
+        goto UNMAP;
+    }
+
+    download.config = config;
+    download.url = url;
+    download.total = total;
+    download.next_offset = 0;
+    download.nb_connections = nb_connections;
+    download.aborted = false;
+
+    for(nb_workers = 0; nb_workers < nb_connections; nb_workers++)
+    {
+        if(pthread_create(&(workers[nb_workers]), NULL, download_worker, &download) != 0)
+        {
+            break;
+        }
+    }
+    if(nb_workers == 0)
+    {
+        download_worker(&download);
+    }
+    for(size_t i = 0; i < nb_workers; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    success = !download.aborted && download.next_offset == total;
+    pthread_mutex_destroy(&(download.lock));
+
+UNMAP:
+    free(workers);
+    munmap(download.map, (size_t)total);
+CLOSE:
+    if(!success)
+    {
+        // The received ranges are not contiguous, a partial file can't be resumed
+        if(ftruncate(fd, 0) != 0)
+        {
+            success = false;
+        }
+    }
+    close(fd);
+    return success;
+#endif
+}
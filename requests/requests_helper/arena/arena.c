@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "requests_helper/arena/arena.h"
+
+#define ARENA_ALIGNMENT (_Alignof(max_align_t))
+
+typedef struct _arena_block {
+    struct _arena_block* previous;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+} ArenaBlock;
+
+struct _rh_arena {
+    ArenaBlock* current;
+    size_t block_size;
+    char* last;  /* the last allocation, the only one that can grow in place */
+};
+
+
+/*
+Create a new arena, that takes its memory from blocks of BLOCK_SIZE bytes.
+If it fails, it returns NULL.
+*/
+rh_Arena* rh_arena_init(size_t block_size)
+{
+    rh_Arena* arena = (rh_Arena*) malloc(sizeof(rh_Arena));
+    if(arena == NULL)
+    {
+        return NULL;
+    }
+
+    arena->current = NULL;
+    arena->block_size = block_size;
+    arena->last = NULL;
+
+    return arena;
+}
+
+/*
+Allocate SIZE bytes, in a new block of at least MIN_BLOCK_SIZE bytes if the current one is full.
+*/
+static void* arena_alloc(rh_Arena* arena, size_t size, size_t min_block_size)
+{
+    ArenaBlock* block = arena->current;
+    size_t offset = 0;
+
+    if(block != NULL)
+    {
+        offset = (block->used + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    }
+    if(block == NULL || offset > block->size || size > block->size - offset)
+    {
+        size_t block_size = size > min_block_size ? size : min_block_size;
+        block = (ArenaBlock*) malloc(sizeof(ArenaBlock) + block_size);
+        if(block == NULL)
+        {
+            return NULL;
+        }
+        block->previous = arena->current;
+        block->size = block_size;
+        arena->current = block;
+        offset = 0;
+    }
+
+    block->used = offset + size;
+    arena->last = (char*)block->data + offset;
+    return arena->last;
+}
+
+void* rh_arena_alloc(rh_Arena* arena, size_t size)
+{
+    return arena_alloc(arena, size, arena->block_size);
+}
+
+/*
+Append SUFFIX_LENGTH bytes of SUFFIX to STR, in place if STR is the last allocation and there is enough room after it.
+Returns the string, which may have moved, or NULL if there is a memory error.
+*/
+char* rh_arena_strcat(rh_Arena* arena, char* str, size_t str_length, const char* suffix, size_t suffix_length)
+{
+    ArenaBlock* block = arena->current;
+
+    if(str == NULL || str != arena->last || suffix_length > block->size - block->used)
+    {
+        // doubling the room makes the total cost of the copies linear in the final length
+        size_t needed = str_length + suffix_length + 1;
+        size_t min_block_size = 2 * needed > arena->block_size ? 2 * needed : arena->block_size;
+        char* copy = (char*) arena_alloc(arena, needed, min_block_size);
+        if(copy == NULL)
+        {
+            return NULL;
+        }
+        if(str_length > 0)
+        {
+            memcpy(copy, str, str_length);
+        }
+        str = copy;
+        block = arena->current;
+    }
+    else
+    {
+        block->used += suffix_length;
+    }
+
+    memcpy(str + str_length, suffix, suffix_length);
+    str[str_length + suffix_length] = '\0';
+    return str;
+}
+
+void rh_arena_free(rh_Arena** arena)
+{
+    if(*arena == NULL)
+    {
+        return;
+    }
+    ArenaBlock* block = (*arena)->current;
+    while(block != NULL)
+    {
+        ArenaBlock* previous = block->previous;
+        free(block);
+        block = previous;
+    }
+    free(*arena);
+    *arena = NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef RH_ARENA_H
+    #define RH_ARENA_H
+    #include <stddef.h>
+
+    typedef struct _rh_arena rh_Arena;
+
+    #ifdef __cplusplus
+    extern "C"{
+    #endif
+
+    /**
+     * @brief Create a new arena: the memory is taken from big blocks and it's only given back all at once, when the arena is freed.
+     * @brief It's not thread-safe.
+     *
+     * @param block_size the size of the blocks, the allocations bigger than that get a block of their own.
+     * @return - When it succeeds, it returns a pointer to an arena handler.
+     * @return - When it fails, it returns NULL.
+     */
+    rh_Arena* rh_arena_init(size_t block_size);
+
+
+    /**
+     * @brief Allocate SIZE bytes in the arena, aligned for any type.
+     *
+     * @param arena the handler returned by `rh_arena_init`
+     * @param size the number of bytes wanted
+     * @return - When it succeeds, it returns a pointer valid until the arena is freed.
+     * @return - When it fails, it's a memory error and it returns NULL.
+     */
+    void* rh_arena_alloc(rh_Arena* arena, size_t size);
+
+
+    /**
+     * @brief Append SUFFIX_LENGTH bytes of SUFFIX to the string STR, that was returned by this function.  
+     * @brief If STR is the last thing allocated in the arena, it grows in place, otherwise it's copied at the end of the arena,
+     * @brief with some room to grow, so a string built from many parts is copied only a few times.
+     *
+     * @param arena the handler returned by `rh_arena_init`
+     * @param str the string to complete, or NULL to start a new one
+     * @param str_length the length of STR
+     * @param suffix the bytes to append, they don't need to be null terminated
+     * @param suffix_length the number of bytes to append
+     * @return - When it succeeds, it returns the null terminated string, which may have moved.
+     * @return - When it fails, it's a memory error and it returns NULL, STR is still valid.
+     */
+    char* rh_arena_strcat(rh_Arena* arena, char* str, size_t str_length, const char* suffix, size_t suffix_length);
+
+
+    /**
+     * @brief Free all the memory of the arena and set the arena handler to NULL.
+     *
+     * @param arena the address of the arena handler.
+     */
+    void rh_arena_free(rh_Arena** arena);
+
+    #ifdef __cplusplus
+    }
+    #endif
+#endif
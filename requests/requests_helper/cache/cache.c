@@ -0,0 +1,740 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef WIN32
+    #include <sys/mman.h>
+#endif
+
+#include "requests_helper/cache/cache.h"
+#include "requests_helper/strings/strings.h"
+
+#define NB_BUCKETS 256  /* must be a power of 2 */
+#define MAX_ENTRY_FRACTION 4  /* an entry can't use more than 1/MAX_ENTRY_FRACTION of the memory of the cache */
+#define FILE_NAME_LENGTH 16  /* the hash of the key in hexadecimal */
+#define DISK_MAGIC "RHC1"
+
+struct _rh_cache_entry {
+    char* storage;  /* the key, the headers and the body, one after the other */
+    size_t storage_size;
+    size_t storage_capacity;
+    size_t headers_offset;
+    size_t body_offset;
+    void* map;  /* not NULL if the storage is mapped from a file of the directory */
+    size_t map_size;
+    int64_t expires_at;
+    unsigned short int status_code;
+    size_t references;
+    bool remove_file;  /* evicted by the LRU, so its file must leave the directory too */
+    struct _rh_cache_entry* hash_next;
+    struct _rh_cache_entry* lru_previous;
+    struct _rh_cache_entry* lru_next;
+};
+
+struct _rh_response_cache {
+    pthread_mutex_t lock;
+    rh_CacheEntry* buckets[NB_BUCKETS];
+    rh_CacheEntry* most_recent;
+    rh_CacheEntry* least_recent;
+    size_t memory_used;
+    size_t max_memory;
+    char* directory;
+};
+
+typedef struct _disk_header {
+    char magic[4];
+    uint16_t status_code;
+    uint16_t unused;
+    int64_t expires_at;
+    uint64_t headers_offset;
+    uint64_t body_offset;
+    uint64_t storage_size;
+} DiskHeader;
+
+
+/*
+FNV-1a hash of the key, used to select the bucket and to name the file of the entry.
+*/
+static uint64_t hash_key(const char* key)
+{
+    uint64_t hash = 14695981039346656037u;
+    while(*key != '\0')
+    {
+        hash ^= (uint8_t)(*key);
+        hash *= 1099511628211u;
+        key++;
+    }
+    return hash;
+}
+
+static inline const char* entry_key(const rh_CacheEntry* entry)
+{
+    return entry->storage;
+}
+
+/*
+Make sure that SIZE more bytes can be written in the storage of ENTRY.
+*/
+static bool reserve_storage(rh_CacheEntry* entry, size_t size)
+{
+    size_t capacity = entry->storage_capacity;
+    if(entry->storage_size + size <= capacity)
+    {
+        return true;
+    }
+    while(capacity < entry->storage_size + size)
+    {
+        capacity = 2 * capacity;
+    }
+    char* temp = (char*) realloc(entry->storage, capacity * sizeof(char));
+    if(temp == NULL)
+    {
+        return false;
+    }
+    entry->storage = temp;
+    entry->storage_capacity = capacity;
+    return true;
+}
+
+/*
+Create a new response entry, with a reference count of 1.
+If it fails, it returns NULL.
+*/
+rh_CacheEntry* rh_cache_entry_init(const char* key, unsigned short int status_code, int64_t expires_at)
+{
+    size_t key_size = strlen(key) + 1;
+    rh_CacheEntry* entry = (rh_CacheEntry*) calloc(1, sizeof(rh_CacheEntry));
+    if(entry == NULL)
+    {
+        return NULL;
+    }
+
+    entry->storage_capacity = key_size + 1024;
+    entry->storage = (char*) malloc(entry->storage_capacity * sizeof(char));
+    if(entry->storage == NULL)
+    {
+        free(entry);
+        return NULL;
+    }
+    memcpy(entry->storage, key, key_size);
+    entry->storage_size = key_size;
+    entry->headers_offset = key_size;
+    entry->body_offset = key_size;
+    entry->status_code = status_code;
+    entry->expires_at = expires_at;
+    entry->references = 1;
+
+    return entry;
+}
+
+bool rh_cache_entry_add_header(rh_CacheEntry* entry, const char* name, const char* value)
+{
+    size_t name_size = strlen(name) + 1;
+    size_t value_size = strlen(value) + 1;
+
+    if(entry->body_offset != entry->storage_size || !reserve_storage(entry, name_size + value_size))
+    {
+        return false;
+    }
+    memcpy(entry->storage + entry->storage_size, name, name_size);
+    memcpy(entry->storage + entry->storage_size + name_size, value, value_size);
+    entry->storage_size += name_size + value_size;
+    entry->body_offset = entry->storage_size;
+    return true;
+}
+
+bool rh_cache_entry_append_body(rh_CacheEntry* entry, const char* data, size_t size)
+{
+    if(!reserve_storage(entry, size))
+    {
+        return false;
+    }
+    memcpy(entry->storage + entry->storage_size, data, size);
+    entry->storage_size += size;
+    return true;
+}
+
+/*
+Create a new entry with the same content as ENTRY, but another expiration date.
+If it fails, it returns NULL.
+*/
+rh_CacheEntry* rh_cache_entry_copy(const rh_CacheEntry* entry, int64_t expires_at)
+{
+    rh_CacheEntry* copy = (rh_CacheEntry*) calloc(1, sizeof(rh_CacheEntry));
+    if(copy == NULL)
+    {
+        return NULL;
+    }
+    copy->storage = (char*) malloc(entry->storage_size * sizeof(char));
+    if(copy->storage == NULL)
+    {
+        free(copy);
+        return NULL;
+    }
+    memcpy(copy->storage, entry->storage, entry->storage_size);
+    copy->storage_size = entry->storage_size;
+    copy->storage_capacity = entry->storage_size;
+    copy->headers_offset = entry->headers_offset;
+    copy->body_offset = entry->body_offset;
+    copy->status_code = entry->status_code;
+    copy->expires_at = expires_at;
+    copy->references = 1;
+
+    return copy;
+}
+
+void rh_cache_entry_retain(rh_CacheEntry* entry)
+{
+    __atomic_add_fetch(&(entry->references), 1, __ATOMIC_RELAXED);
+}
+
+/*
+Remove a reference to the entry and free it if it was the last one.
+*/
+void rh_cache_entry_release(rh_CacheEntry** entry)
+{
+    if(*entry == NULL)
+    {
+        return;
+    }
+    if(__atomic_sub_fetch(&((*entry)->references), 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        #ifndef WIN32
+        if((*entry)->map != NULL)
+        {
+            munmap((*entry)->map, (*entry)->map_size);
+        }
+        else
+        #endif
+        {
+            free((*entry)->storage);
+        }
+        free(*entry);
+    }
+    *entry = NULL;
+}
+
+unsigned short int rh_cache_entry_status_code(const rh_CacheEntry* entry)
+{
+    return entry->status_code;
+}
+
+int64_t rh_cache_entry_expires_at(const rh_CacheEntry* entry)
+{
+    return entry->expires_at;
+}
+
+const char* rh_cache_entry_body(const rh_CacheEntry* entry, size_t* size)
+{
+    *size = entry->storage_size - entry->body_offset;
+    return entry->storage + entry->body_offset;
+}
+
+const char* rh_cache_entry_header(const rh_CacheEntry* entry, const char* name)
+{
+    size_t i = entry->headers_offset;
+    while(i < entry->body_offset)
+    {
+        const char* header_name = entry->storage + i;
+        const char* value = header_name + strlen(header_name) + 1;
+        if(rh_strcasecmp(header_name, name) == 0)
+        {
+            return value;
+        }
+        i = (size_t)(value - entry->storage) + strlen(value) + 1;
+    }
+    return NULL;
+}
+
+bool rh_cache_entry_foreach_header(const rh_CacheEntry* entry, bool (*callback)(const char* name, const char* value, void* user_data), void* user_data)
+{
+    size_t i = entry->headers_offset;
+    while(i < entry->body_offset)
+    {
+        const char* name = entry->storage + i;
+        const char* value = name + strlen(name) + 1;
+        if(!(*callback)(name, value, user_data))
+        {
+            return false;
+        }
+        i = (size_t)(value - entry->storage) + strlen(value) + 1;
+    }
+    return true;
+}
+
+/*
+Write the path of the file of KEY in PATH, that must be at least strlen(directory) + FILE_NAME_LENGTH + 2 long.
+*/
+static void build_file_path(const rh_ResponseCache* cache, const char* key, char* path)
+{
+    static const char hex[] = "0123456789abcdef";
+    uint64_t hash = hash_key(key);
+    char* writer = rh_strcpy(rh_strcpy(path, cache->directory), "/");
+    for(int i = FILE_NAME_LENGTH - 1; i >= 0; i--)
+    {
+        writer[i] = hex[hash & 0xf];
+        hash >>= 4;
+    }
+    writer[FILE_NAME_LENGTH] = '\0';
+}
+
+#ifndef WIN32
+static bool write_all(int fd, const void* data, size_t size)
+{
+    const char* bytes = (const char*)data;
+    while(size > 0)
+    {
+        ssize_t written = write(fd, bytes, size);
+        if(written <= 0)
+        {
+            return false;
+        }
+        bytes += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+/*
+Write ENTRY in the directory of the cache.
+The entry is written in a temporary file that replaces the old one at the end, so a reader never maps a partial file.
+*/
+static void write_entry_file(const rh_ResponseCache* cache, const rh_CacheEntry* entry)
+{
+    size_t directory_length = strlen(cache->directory);
+    char* path = (char*) malloc((directory_length + FILE_NAME_LENGTH + 2) * sizeof(char));
+    char* temp_path = (char*) malloc((directory_length + sizeof("/.tmp-XXXXXX")) * sizeof(char));
+    DiskHeader header;
+    int fd;
+
+    if(path == NULL || temp_path == NULL)
+    {
+        goto FREE;
+    }
+    build_file_path(cache, entry_key(entry), path);
+    rh_strcpy(rh_strcpy(temp_path, cache->directory), "/.tmp-XXXXXX");
+
+    memset(&header, 0, sizeof(DiskHeader));
+    memcpy(header.magic, DISK_MAGIC, sizeof(header.magic));
+    header.status_code = entry->status_code;
+    header.expires_at = entry->expires_at;
+    header.headers_offset = entry->headers_offset;
+    header.body_offset = entry->body_offset;
+    header.storage_size = entry->storage_size;
+
+    fd = mkstemp(temp_path);
+    if(fd < 0)
+    {
+        goto FREE;
+    }
+    if(!write_all(fd, &header, sizeof(DiskHeader)) || !write_all(fd, entry->storage, entry->storage_size))
+    {
+        close(fd);
+        unlink(temp_path);
+        goto FREE;
+    }
+    close(fd);
+    if(rename(temp_path, path) != 0)
+    {
+        unlink(temp_path);
+    }
+
+FREE:
+    free(path);
+    free(temp_path);
+}
+
+/*
+Map the file of KEY from the directory of the cache.
+If there is no valid file for this key, it returns NULL.
+*/
+static rh_CacheEntry* read_entry_file(const rh_ResponseCache* cache, const char* key)
+{
+    char* path = (char*) malloc((strlen(cache->directory) + FILE_NAME_LENGTH + 2) * sizeof(char));
+    rh_CacheEntry* entry = NULL;
+    const DiskHeader* header;
+    struct stat file_stat;
+    void* map;
+    int fd;
+
+    if(path == NULL)
+    {
+        return NULL;
+    }
+    build_file_path(cache, key, path);
+    fd = open(path, O_RDONLY);
+    free(path);
+    if(fd < 0)
+    {
+        return NULL;
+    }
+    if(fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size <= sizeof(DiskHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    header = (const DiskHeader*)map;
+    if(memcmp(header->magic, DISK_MAGIC, sizeof(header->magic)) != 0
+        || header->storage_size != (size_t)file_stat.st_size - sizeof(DiskHeader)
+        || header->body_offset > header->storage_size || header->headers_offset > header->body_offset
+        || strnlen((const char*)map + sizeof(DiskHeader), header->headers_offset) >= header->headers_offset
+        || strcmp((const char*)map + sizeof(DiskHeader), key) != 0)
+    {
+        // corrupted, or another key with the same hash
+        goto ERROR;
+    }
+
+    entry = (rh_CacheEntry*) calloc(1, sizeof(rh_CacheEntry));
+    if(entry == NULL)
+    {
+        goto ERROR;
+    }
+    entry->map = map;
+    entry->map_size = (size_t)file_stat.st_size;
+    entry->storage = (char*)map + sizeof(DiskHeader);
+    entry->storage_size = header->storage_size;
+    entry->storage_capacity = header->storage_size;
+    entry->headers_offset = header->headers_offset;
+    entry->body_offset = header->body_offset;
+    entry->status_code = header->status_code;
+    entry->expires_at = header->expires_at;
+    entry->references = 1;
+
+    return entry;
+
+ERROR:
+    munmap(map, (size_t)file_stat.st_size);
+    return NULL;
+}
+
+/*
+Delete the file of KEY from the directory of the cache, if there is one.
+*/
+static void remove_entry_file(const rh_ResponseCache* cache, const char* key)
+{
+    char* path = (char*) malloc((strlen(cache->directory) + FILE_NAME_LENGTH + 2) * sizeof(char));
+    if(path != NULL)
+    {
+        build_file_path(cache, key, path);
+        unlink(path);
+        free(path);
+    }
+}
+#endif
+
+/*
+Create a new thread-safe cache of responses.
+If it fails, it returns NULL.
+*/
+rh_ResponseCache* rh_cache_init(size_t max_memory, const char* directory)
+{
+    rh_ResponseCache* cache = (rh_ResponseCache*) calloc(1, sizeof(rh_ResponseCache));
+    if(cache == NULL)
+    {
+        return NULL;
+    }
+    if(pthread_mutex_init(&(cache->lock), NULL) != 0)
+    {
+        free(cache);
+        return NULL;
+    }
+
+    #ifndef WIN32
+    if(directory != NULL)
+    {
+        cache->directory = (char*) malloc((strlen(directory) + 1) * sizeof(char));
+        if(cache->directory == NULL)
+        {
+            pthread_mutex_destroy(&(cache->lock));
+            free(cache);
+            return NULL;
+        }
+        rh_strcpy(cache->directory, directory);
+    }
+    #else
+    (void)directory;  // there is no mmap, the cache only lives in memory
+    #endif
+
+    cache->max_memory = max_memory;
+
+    return cache;
+}
+
+size_t rh_cache_max_entry_size(const rh_ResponseCache* cache)
+{
+    return cache->max_memory / MAX_ENTRY_FRACTION;
+}
+
+/*
+Remove ENTRY from the hash table and from the LRU list, without releasing it.
+The cache must be locked.
+*/
+static void unlink_entry(rh_ResponseCache* cache, rh_CacheEntry* entry)
+{
+    rh_CacheEntry** link = &(cache->buckets[hash_key(entry_key(entry)) & (NB_BUCKETS - 1)]);
+    while(*link != entry)
+    {
+        link = &((*link)->hash_next);
+    }
+    *link = entry->hash_next;
+
+    if(entry->lru_previous != NULL)
+    {
+        entry->lru_previous->lru_next = entry->lru_next;
+    }
+    else
+    {
+        cache->most_recent = entry->lru_next;
+    }
+    if(entry->lru_next != NULL)
+    {
+        entry->lru_next->lru_previous = entry->lru_previous;
+    }
+    else
+    {
+        cache->least_recent = entry->lru_previous;
+    }
+    entry->hash_next = NULL;
+    entry->lru_previous = NULL;
+    entry->lru_next = NULL;
+
+    cache->memory_used -= entry->storage_size;
+}
+
+/*
+The cache must be locked.
+*/
+static rh_CacheEntry* find_entry(rh_ResponseCache* cache, const char* key)
+{
+    rh_CacheEntry* entry = cache->buckets[hash_key(key) & (NB_BUCKETS - 1)];
+    while(entry != NULL && strcmp(entry_key(entry), key) != 0)
+    {
+        entry = entry->hash_next;
+    }
+    return entry;
+}
+
+static void move_to_front(rh_ResponseCache* cache, rh_CacheEntry* entry)
+{
+    if(cache->most_recent == entry)
+    {
+        return;
+    }
+    entry->lru_previous->lru_next = entry->lru_next;
+    if(entry->lru_next != NULL)
+    {
+        entry->lru_next->lru_previous = entry->lru_previous;
+    }
+    else
+    {
+        cache->least_recent = entry->lru_previous;
+    }
+    entry->lru_previous = NULL;
+    entry->lru_next = cache->most_recent;
+    cache->most_recent->lru_previous = entry;
+    cache->most_recent = entry;
+}
+
+/*
+Insert ENTRY, that holds the reference of the cache, and evict the least recently used entries if the memory is exceeded.
+The cache must be locked, the evicted entries are put in EVICTED so they can be released once the cache is unlocked.
+*/
+static void insert_entry(rh_ResponseCache* cache, rh_CacheEntry* entry, rh_CacheEntry** evicted)
+{
+    rh_CacheEntry** bucket = &(cache->buckets[hash_key(entry_key(entry)) & (NB_BUCKETS - 1)]);
+    rh_CacheEntry* old = find_entry(cache, entry_key(entry));
+
+    *evicted = NULL;
+    if(old != NULL)
+    {
+        unlink_entry(cache, old);
+        old->hash_next = *evicted;
+        *evicted = old;
+    }
+
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    entry->lru_previous = NULL;
+    entry->lru_next = cache->most_recent;
+    if(cache->most_recent != NULL)
+    {
+        cache->most_recent->lru_previous = entry;
+    }
+    else
+    {
+        cache->least_recent = entry;
+    }
+    cache->most_recent = entry;
+    cache->memory_used += entry->storage_size;
+
+    while(cache->memory_used > cache->max_memory && cache->least_recent != entry)
+    {
+        old = cache->least_recent;
+        unlink_entry(cache, old);
+        old->remove_file = true;
+        old->hash_next = *evicted;
+        *evicted = old;
+    }
+}
+
+/*
+Release the entries of EVICTED, and delete the files of those that were evicted by the LRU so the directory doesn't grow forever.
+The cache must not be locked.
+*/
+static void release_evicted(rh_ResponseCache* cache, rh_CacheEntry* evicted)
+{
+    while(evicted != NULL)
+    {
+        rh_CacheEntry* next = evicted->hash_next;
+        #ifndef WIN32
+        if(evicted->remove_file && cache->directory != NULL)
+        {
+            remove_entry_file(cache, entry_key(evicted));
+        }
+        #else
+        (void)cache;
+        #endif
+        rh_cache_entry_release(&evicted);
+        evicted = next;
+    }
+}
+
+/*
+Store ENTRY, replacing the previous entry with the same key.
+Returns false if the entry is too big.
+*/
+bool rh_cache_put(rh_ResponseCache* cache, rh_CacheEntry* entry)
+{
+    rh_CacheEntry* evicted;
+
+    if(entry->storage_size > rh_cache_max_entry_size(cache))
+    {
+        return false;
+    }
+
+    #ifndef WIN32
+    if(cache->directory != NULL)
+    {
+        write_entry_file(cache, entry);
+    }
+    #endif
+
+    rh_cache_entry_retain(entry);
+    pthread_mutex_lock(&(cache->lock));
+    insert_entry(cache, entry, &evicted);
+    pthread_mutex_unlock(&(cache->lock));
+
+    release_evicted(cache, evicted);
+    return true;
+}
+
+/*
+Returns a new reference to the entry of KEY, looking in the directory if it isn't in memory.
+If there is none, it returns NULL.
+*/
+rh_CacheEntry* rh_cache_get(rh_ResponseCache* cache, const char* key)
+{
+    rh_CacheEntry* entry;
+
+    pthread_mutex_lock(&(cache->lock));
+    entry = find_entry(cache, key);
+    if(entry != NULL)
+    {
+        move_to_front(cache, entry);
+        rh_cache_entry_retain(entry);
+    }
+    pthread_mutex_unlock(&(cache->lock));
+
+    #ifndef WIN32
+    if(entry == NULL && cache->directory != NULL)
+    {
+        rh_CacheEntry* evicted = NULL;
+        entry = read_entry_file(cache, key);
+        if(entry == NULL)
+        {
+            return NULL;
+        }
+        if(entry->storage_size > rh_cache_max_entry_size(cache))
+        {
+            // the cache was bigger when this file was written, it can't be kept anymore
+            remove_entry_file(cache, key);
+            return entry;
+        }
+
+        pthread_mutex_lock(&(cache->lock));
+        rh_CacheEntry* found = find_entry(cache, key);
+        if(found != NULL)
+        {
+            // another thread was faster
+            move_to_front(cache, found);
+            rh_cache_entry_retain(found);
+            evicted = entry;
+            entry = found;
+        }
+        else
+        {
+            rh_cache_entry_retain(entry);
+            insert_entry(cache, entry, &evicted);
+        }
+        pthread_mutex_unlock(&(cache->lock));
+
+        release_evicted(cache, evicted);
+    }
+    #endif
+
+    return entry;
+}
+
+void rh_cache_remove(rh_ResponseCache* cache, const char* key)
+{
+    rh_CacheEntry* entry;
+
+    pthread_mutex_lock(&(cache->lock));
+    entry = find_entry(cache, key);
+    if(entry != NULL)
+    {
+        unlink_entry(cache, entry);
+    }
+    pthread_mutex_unlock(&(cache->lock));
+
+    rh_cache_entry_release(&entry);
+
+    #ifndef WIN32
+    if(cache->directory != NULL)
+    {
+        remove_entry_file(cache, key);
+    }
+    #endif
+}
+
+void rh_cache_free(rh_ResponseCache** cache)
+{
+    if(*cache == NULL)
+    {
+        return;
+    }
+    rh_CacheEntry* entry = (*cache)->most_recent;
+    while(entry != NULL)
+    {
+        rh_CacheEntry* next = entry->lru_next;
+        rh_cache_entry_release(&entry);
+        entry = next;
+    }
+    pthread_mutex_destroy(&((*cache)->lock));
+    free((*cache)->directory);
+    free(*cache);
+    *cache = NULL;
+}
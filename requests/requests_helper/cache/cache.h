@@ -0,0 +1,186 @@
+#ifndef RH_CACHE_H
+    #define RH_CACHE_H
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include <stdint.h>
+
+    typedef struct _rh_response_cache rh_ResponseCache;
+    typedef struct _rh_cache_entry rh_CacheEntry;
+
+    #ifdef __cplusplus
+    extern "C"{
+    #endif
+
+    /**
+     * @brief Create a new response entry, with a reference count of 1.
+     * @brief The headers must all be added before the first part of the body.
+     *
+     * @param key the key under which the entry will be stored
+     * @param status_code the status code of the response
+     * @param expires_at the unix time after which the entry must be revalidated
+     * @return - When it succeeds, it returns a pointer to the entry.
+     * @return - When it fails, it returns NULL.
+     */
+    rh_CacheEntry* rh_cache_entry_init(const char* key, unsigned short int status_code, int64_t expires_at);
+
+
+    /**
+     * @brief Add a header to an entry that doesn't have a body yet.
+     *
+     * @param entry the entry returned by `rh_cache_entry_init`
+     * @param name the name of the header
+     * @param value the value of the header
+     * @return false if there was a memory error, true otherwise.
+     */
+    bool rh_cache_entry_add_header(rh_CacheEntry* entry, const char* name, const char* value);
+
+
+    /**
+     * @brief Append a part of the body to an entry.
+     * @brief The entry must not be shared yet.
+     *
+     * @param entry the entry returned by `rh_cache_entry_init`
+     * @param data the bytes to append
+     * @param size the number of bytes to append
+     * @return false if there was a memory error, true otherwise.
+     */
+    bool rh_cache_entry_append_body(rh_CacheEntry* entry, const char* data, size_t size);
+
+
+    /**
+     * @brief Create a new entry with the same key, status code, headers and body, but another expiration date.
+     *
+     * @param entry the entry to copy
+     * @param expires_at the unix time after which the copy must be revalidated
+     * @return - When it succeeds, it returns the copy, with a reference count of 1.
+     * @return - When it fails, it returns NULL.
+     */
+    rh_CacheEntry* rh_cache_entry_copy(const rh_CacheEntry* entry, int64_t expires_at);
+
+
+    /**
+     * @brief Add a reference to an entry, so it stays valid until `rh_cache_entry_release` is called.
+     *
+     * @param entry the entry to retain
+     */
+    void rh_cache_entry_retain(rh_CacheEntry* entry);
+
+
+    /**
+     * @brief Remove a reference to an entry, free it if it was the last one and set the entry pointer to NULL.
+     *
+     * @param entry the address of the entry pointer.
+     */
+    void rh_cache_entry_release(rh_CacheEntry** entry);
+
+
+    /**
+     * @param entry an entry
+     * @return the status code of the response.
+     */
+    unsigned short int rh_cache_entry_status_code(const rh_CacheEntry* entry);
+
+
+    /**
+     * @param entry an entry
+     * @return the unix time after which the entry must be revalidated.
+     */
+    int64_t rh_cache_entry_expires_at(const rh_CacheEntry* entry);
+
+
+    /**
+     * @brief Get the body of an entry. The body is valid as long as the caller holds a reference to the entry.
+     *
+     * @param entry an entry
+     * @param size filled with the size of the body
+     * @return the first byte of the body.
+     */
+    const char* rh_cache_entry_body(const rh_CacheEntry* entry, size_t* size);
+
+
+    /**
+     * @brief Get the value of a header of an entry (`name` is case unsensitive).
+     *
+     * @param entry an entry
+     * @param name the name of the wanted header
+     * @return - the value of the header
+     * @return - NULL if the entry doesn't have this header.
+     */
+    const char* rh_cache_entry_header(const rh_CacheEntry* entry, const char* name);
+
+
+    /**
+     * @brief Call `callback` on each header of an entry, in the order they were added.
+     * @brief If `callback` returns false, the iteration stops.
+     *
+     * @param entry an entry
+     * @param callback the function called with the name and the value of each header
+     * @param user_data a pointer given to `callback`
+     * @return false if `callback` stopped the iteration, true otherwise.
+     */
+    bool rh_cache_entry_foreach_header(const rh_CacheEntry* entry, bool (*callback)(const char* name, const char* value, void* user_data), void* user_data);
+
+
+    /**
+     * @brief Create a new thread-safe cache of responses, with a least recently used eviction.
+     * @brief If `directory` is not NULL, the entries are also written in this directory and mapped back in memory when they are needed again,
+     * @brief so they survive the end of the process. The file of an entry is deleted when the entry is evicted, so the directory doesn't grow forever.
+     *
+     * @param max_memory the maximum number of bytes used by the entries kept in memory.
+     * @param directory an existing directory used to store the entries, or NULL.
+     * @return - When it succeeds, it returns a pointer to a cache handler.
+     * @return - When it fails, it returns NULL.
+     */
+    rh_ResponseCache* rh_cache_init(size_t max_memory, const char* directory);
+
+
+    /**
+     * @param cache the handler returned by `rh_cache_init`
+     * @return the size of the biggest entry that the cache accepts.
+     */
+    size_t rh_cache_max_entry_size(const rh_ResponseCache* cache);
+
+
+    /**
+     * @brief Store an entry, replacing the previous entry with the same key.
+     * @brief The cache takes its own reference, the caller keeps its reference.
+     *
+     * @param cache the handler returned by `rh_cache_init`
+     * @param entry the entry to store
+     * @return false if the entry is too big for the cache, true otherwise.
+     */
+    bool rh_cache_put(rh_ResponseCache* cache, rh_CacheEntry* entry);
+
+
+    /**
+     * @brief Get the entry stored for `key`, even if it has expired.
+     *
+     * @param cache the handler returned by `rh_cache_init`
+     * @param key the key of the wanted entry
+     * @return - a new reference to the entry, that must be released with `rh_cache_entry_release`.
+     * @return - NULL if there is no entry for this key.
+     */
+    rh_CacheEntry* rh_cache_get(rh_ResponseCache* cache, const char* key);
+
+
+    /**
+     * @brief Remove the entry stored for `key`, from the memory and from the directory.
+     *
+     * @param cache the handler returned by `rh_cache_init`
+     * @param key the key of the entry to remove
+     */
+    void rh_cache_remove(rh_ResponseCache* cache, const char* key);
+
+
+    /**
+     * @brief Release all the entries kept in memory, free the cache and set the cache handler to NULL.
+     * @brief The files in the directory are kept.
+     *
+     * @param cache the address of the cache handler.
+     */
+    void rh_cache_free(rh_ResponseCache** cache);
+
+    #ifdef __cplusplus
+    }
+    #endif
+#endif
@@ -8,8 +8,11 @@
     #include <netdb.h>
     #include <arpa/inet.h>
     #include <netinet/in.h>
+    #include <netinet/tcp.h>
     #include <sys/socket.h>
     #include <sys/time.h>
+    #include <sys/un.h>
+    #include <poll.h>
 
 #endif
 
@@ -17,9 +20,20 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
+#include <limits.h>
+
+#include <pthread.h>
 
 #include "requests_helper/network/easy_tcp_tls.h"
 #include "requests_helper/strings/strings.h"
+#ifdef RH_USE_IO_URING
+    #include "requests_helper/network/uring.h"
+#endif
+
+#define SESSION_CACHE_SIZE 64
+#define MAX_HOSTNAME_LENGTH 253
+#define SESSION_KEY_MAX_LENGTH (MAX_HOSTNAME_LENGTH + sizeof(":65535"))
 
 
 #ifdef WIN32
@@ -34,8 +48,26 @@ struct _rh_socket_handler {
     sock_fd fd;
     SSL* ssl;
     SSL_CTX* ctx;
+    bool connecting;  /* the non-blocking connect isn't finished */
+    bool handshaking;  /* the non-blocking TLS handshake isn't finished */
+    bool early_data;  /* the TLS handshake is left to the first rh_socket_send, which sends its data as TLS 1.3 early data */
+    char* session_key;  /* where the TLS sessions of this connection are cached, NULL if they are not */
+    bool quick_ack;  /* TCP_QUICKACK is set again before each reception, the kernel clears it */
+    #ifdef RH_USE_IO_URING
+    rh_UringConnection* uring;  /* not NULL when the receptions go through io_uring */
+    #endif
 };
 
+typedef struct _cached_session {
+    char key[SESSION_KEY_MAX_LENGTH];  /* "host:port" */
+    SSL_SESSION* session;
+} CachedSession;
+
+/* The TLS sessions given by the servers, to resume them on the next connections. Each SSL_CTX is used by a single connection, so the cache is shared by the process */
+static pthread_mutex_t sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+static CachedSession cached_sessions[SESSION_CACHE_SIZE];
+static size_t next_cached_session = 0;
+
 
 /*
 Internal function used to init the sockets for windows
@@ -59,12 +91,109 @@ Internal function that destroy all sockets on windows
 */
 void _rh_socket_cleanup(void)
 {
+    pthread_mutex_lock(&sessions_lock);
+    for(size_t i = 0; i < SESSION_CACHE_SIZE; i++)
+    {
+        SSL_SESSION_free(cached_sessions[i].session);
+        cached_sessions[i].session = NULL;
+    }
+    pthread_mutex_unlock(&sessions_lock);
+
     #ifdef WIN32
         WSACleanup();
     #endif
     return;
 }
 
+/*
+OpenSSL callback, called when the server of SSL gives a session (with TLS 1.3, it's after the handshake).
+The session replaces the one that was cached for the same server. If the server is new, it takes the place of the oldest one.
+Returns 1 if the cache keeps the reference to SESSION.
+*/
+static int store_session(SSL* ssl, SSL_SESSION* session)
+{
+    rh_SocketHandler* s = (rh_SocketHandler*) SSL_get_app_data(ssl);
+    CachedSession* slot = NULL;
+
+    if(s == NULL || s->session_key == NULL || !SSL_SESSION_is_resumable(session))
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&sessions_lock);
+    for(size_t i = 0; i < SESSION_CACHE_SIZE && slot == NULL; i++)
+    {
+        if(cached_sessions[i].session != NULL && strcmp(cached_sessions[i].key, s->session_key) == 0)
+        {
+            slot = &(cached_sessions[i]);
+        }
+    }
+    if(slot == NULL)
+    {
+        slot = &(cached_sessions[next_cached_session]);
+        next_cached_session = (next_cached_session + 1) % SESSION_CACHE_SIZE;
+        rh_strncpy(slot->key, s->session_key, SESSION_KEY_MAX_LENGTH);
+    }
+    SSL_SESSION_free(slot->session);
+    slot->session = session;
+    pthread_mutex_unlock(&sessions_lock);
+
+    return 1;
+}
+
+/*
+Remove the session cached for KEY from the cache and return it, or NULL if there is none.
+A TLS 1.3 ticket should only be used once, the connection that resumes it gets new ones.
+*/
+static SSL_SESSION* take_session(const char* key)
+{
+    SSL_SESSION* session = NULL;
+    pthread_mutex_lock(&sessions_lock);
+    for(size_t i = 0; i < SESSION_CACHE_SIZE && session == NULL; i++)
+    {
+        if(cached_sessions[i].session != NULL && strcmp(cached_sessions[i].key, key) == 0)
+        {
+            session = cached_sessions[i].session;
+            cached_sessions[i].session = NULL;
+        }
+    }
+    pthread_mutex_unlock(&sessions_lock);
+    return session;
+}
+
+/*
+Cache the sessions of the TLS connection S to SERVER_HOSTNAME, and resume the cached one if there is one.
+Returns the number of bytes that can be sent as early data with the resumed session, 0 if there is none.
+*/
+static uint32_t resume_session(rh_SocketHandler* s, const char* server_hostname, const char* str_server_port)
+{
+    SSL_SESSION* session;
+    uint32_t max_early_data = 0;
+
+    s->session_key = (char*) malloc(SESSION_KEY_MAX_LENGTH * sizeof(char));
+    if(s->session_key == NULL)
+    {
+        return 0;
+    }
+    size_t length = rh_strncpy(s->session_key, server_hostname, MAX_HOSTNAME_LENGTH + 1) - 1;
+    rh_strcpy(rh_strcpy(s->session_key + length, ":"), str_server_port);
+
+    SSL_CTX_set_session_cache_mode(s->ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(s->ctx, store_session);
+    SSL_set_app_data(s->ssl, s);
+
+    session = take_session(s->session_key);
+    if(session != NULL)
+    {
+        if(SSL_set_session(s->ssl, session) == 1)
+        {
+            max_early_data = SSL_SESSION_get_max_early_data(session);
+        }
+        SSL_SESSION_free(session);
+    }
+    return max_early_data;
+}
+
 /*
 Internal function to set a file descriptor in blocking/non-blocking mode
 */
@@ -85,10 +214,75 @@ static bool set_blocking_mode(sock_fd fd, bool blocking)
 }
 
 
+/*
+Set an integer option of FD, ignoring the failures: the connection works without it.
+*/
+static void set_int_option(sock_fd fd, int level, int name, int value)
+{
+    setsockopt(fd, level, name, (const void*)&value, sizeof(value));
+}
+
+/*
+Apply the TCP OPTIONS to FD, before it's connected: the buffer sizes decide the window scale sent with the SYN, and Fast Open changes the connect itself.
+The options that the system doesn't have are ignored.
+*/
+static void set_socket_options(sock_fd fd, const rh_SocketOptions* options)
+{
+    if(options == NULL)
+    {
+        return;
+    }
+    if(options->no_delay)
+    {
+        set_int_option(fd, IPPROTO_TCP, TCP_NODELAY, 1);
+    }
+    if(options->receive_buffer_size > 0)
+    {
+        set_int_option(fd, SOL_SOCKET, SO_RCVBUF, options->receive_buffer_size);
+    }
+    if(options->send_buffer_size > 0)
+    {
+        set_int_option(fd, SOL_SOCKET, SO_SNDBUF, options->send_buffer_size);
+    }
+    if(options->keepalive_idle > 0)
+    {
+        set_int_option(fd, SOL_SOCKET, SO_KEEPALIVE, 1);
+        #ifdef TCP_KEEPIDLE
+        set_int_option(fd, IPPROTO_TCP, TCP_KEEPIDLE, options->keepalive_idle);
+        #elif defined(TCP_KEEPALIVE)
+        set_int_option(fd, IPPROTO_TCP, TCP_KEEPALIVE, options->keepalive_idle);  // macOS
+        #endif
+        #ifdef TCP_KEEPINTVL
+        if(options->keepalive_interval > 0)
+        {
+            set_int_option(fd, IPPROTO_TCP, TCP_KEEPINTVL, options->keepalive_interval);
+        }
+        #endif
+        #ifdef TCP_KEEPCNT
+        if(options->keepalive_count > 0)
+        {
+            set_int_option(fd, IPPROTO_TCP, TCP_KEEPCNT, options->keepalive_count);
+        }
+        #endif
+    }
+    #ifdef TCP_FASTOPEN_CONNECT
+    if(options->fast_open)
+    {
+        set_int_option(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1);
+    }
+    #endif
+    #ifdef SO_BUSY_POLL
+    if(options->busy_poll > 0)
+    {
+        set_int_option(fd, SOL_SOCKET, SO_BUSY_POLL, options->busy_poll);
+    }
+    #endif
+}
+
 /*
 Internal function to connect or build a socket according to the AI_FAMILY specified
 */
-static sock_fd build_connected_socket(const char* server_hostname, char* str_server_port, rh_milliseconds max_connect_time)
+static sock_fd build_connected_socket(const char* server_hostname, char* str_server_port, rh_milliseconds max_connect_time, const rh_SocketOptions* options)
 {
     int r;
     size_t i = 0;
@@ -147,6 +341,7 @@ static sock_fd build_connected_socket(const char* server_hostname, char* str_ser
             continue;
         }
 
+        set_socket_options(fds[i], options);
         set_blocking_mode(fds[i], false);
         if(connect(fds[i], next_result->ai_addr, (socklen_t)next_result->ai_addrlen) == -1 && errno != EINPROGRESS)
         {
@@ -244,11 +439,12 @@ This function will create the socket and returns a socket handler.
 
 SERVER_HOSTNAME: the targeted server ip, formatted like "127.0.0.1", like "2001:0db8:85a3:0000:0000:8a2e:0370:7334" or like "example.com"
 SERVER_PORT: the opened server port that listen the connection
+OPTIONS: the TCP options of the connection, NULL for the default ones
 
 - when it succeeds, it returns a pointer to a structure handler.
 - when it fails, it returns NULL and rh_print_last_error() can tell what happened
 */
-rh_SocketHandler* rh_socket_client_init(const char* server_hostname, uint16_t server_port, rh_milliseconds max_connect_time)
+rh_SocketHandler* rh_socket_client_init(const char* server_hostname, uint16_t server_port, rh_milliseconds max_connect_time, const rh_SocketOptions* options)
 {
     char str_server_port[8];  // 2**16 = 65536 (5 chars)
     rh_SocketHandler* client;
@@ -262,7 +458,7 @@ rh_SocketHandler* rh_socket_client_init(const char* server_hostname, uint16_t se
 
     rh_uint64_to_str(str_server_port, server_port);
 
-    client->fd = build_connected_socket(server_hostname, str_server_port, max_connect_time);
+    client->fd = build_connected_socket(server_hostname, str_server_port, max_connect_time, options);
     if(client->fd == RH_INVALID_SOCKET)
     {
         free(client);
@@ -271,11 +467,36 @@ rh_SocketHandler* rh_socket_client_init(const char* server_hostname, uint16_t se
 
     client->ssl = NULL;
     client->ctx = NULL;
+    client->connecting = false;
+    client->handshaking = false;
+    client->early_data = false;
+    client->session_key = NULL;
+    client->quick_ack = options != NULL && options->quick_ack;
+    #ifdef RH_USE_IO_URING
+    client->uring = NULL;
+    #endif
 
 
     return client;
 }
 
+/*
+Apply the TLS OPTIONS, that must be chosen before the handshake, to SSL.
+With kTLS, OpenSSL hands the keys to the kernel once the handshake is done, if the kernel and the cipher support it. Otherwise, the records are still encrypted by OpenSSL.
+*/
+static void set_ssl_options(SSL* ssl, const rh_SocketOptions* options)
+{
+    #ifndef OPENSSL_NO_KTLS
+    if(options != NULL && options->ktls)
+    {
+        SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+    }
+    #else
+    (void)ssl;
+    (void)options;
+    #endif
+}
+
 /*
 This function works like rh_socket_client_init, but it will create an ssl secured socket connection.
 
@@ -286,14 +507,14 @@ SNI_HOSTNAME: this is especially for web applications, when a single ip address
 - when it succeeds, it returns a pointer to a structure handler.
 - when it fails, it returns NULL and rh_print_last_error() can tell what happened
 */
-rh_SocketHandler* rh_socket_ssl_client_init(const char* server_hostname, uint16_t server_port, rh_milliseconds max_connect_time)
+rh_SocketHandler* rh_socket_ssl_client_init(const char* server_hostname, uint16_t server_port, rh_milliseconds max_connect_time, const rh_SocketOptions* options)
 {
     rh_SocketHandler* client;
     SSL_library_init();
     OpenSSL_add_all_algorithms();  /* Load cryptos, et.al. */
     SSL_load_error_strings();   /* Bring in and register error messages */
 
-    client = rh_socket_client_init(server_hostname, server_port, max_connect_time);
+    client = rh_socket_client_init(server_hostname, server_port, max_connect_time, options);
     if(client == NULL)
         return NULL;
 
@@ -312,6 +533,20 @@ rh_SocketHandler* rh_socket_ssl_client_init(const char* server_hostname, uint16_
 
     SSL_set_tlsext_host_name(client->ssl, server_hostname);
     SSL_set_fd(client->ssl, (int)client->fd);
+    set_ssl_options(client->ssl, options);
+
+    if(options != NULL && options->session_cache)
+    {
+        char str_server_port[8];
+        rh_uint64_to_str(str_server_port, server_port);
+        if(resume_session(client, server_hostname, str_server_port) > 0 && options->early_data)
+        {
+            // the request will be sent with the ClientHello
+            client->early_data = true;
+            SSL_set_connect_state(client->ssl);
+            return client;
+        }
+    }
 
     if (SSL_connect(client->ssl) == -1)
     {
@@ -323,6 +558,355 @@ rh_SocketHandler* rh_socket_ssl_client_init(const char* server_hostname, uint16_
 }
 
 
+#ifndef WIN32
+/*
+Connect FD to the unix socket at ADDRESS, waiting at most MAX_CONNECT_TIME if the server can't accept it at once.
+FD must be in non-blocking mode, it's left in blocking mode.
+*/
+static bool connect_unix(int fd, const struct sockaddr_un* address, rh_milliseconds max_connect_time)
+{
+    if(connect(fd, (const struct sockaddr*)address, sizeof(*address)) == 0)
+    {
+        return set_blocking_mode(fd, true);
+    }
+
+    if(errno == EINPROGRESS)
+    {
+        // Like TCP, wait until the socket is writable and look at the result of the connection
+        struct pollfd pfd = {
+            .fd = fd,
+            .events = POLLOUT,
+            .revents = 0
+        };
+        int so_error;
+        socklen_t len = sizeof(so_error);
+        if(poll(&pfd, 1, max_connect_time > INT_MAX ? INT_MAX : (int)max_connect_time) < 1
+            || getsockopt(fd, SOL_SOCKET, SO_ERROR, (void*)&so_error, &len) != 0 || so_error != 0)
+        {
+            return false;
+        }
+        return set_blocking_mode(fd, true);
+    }
+
+    if((errno == EAGAIN || errno == EWOULDBLOCK) && max_connect_time > 0)
+    {
+        // Linux: the backlog of the server is full and nothing is pending, so there is nothing to poll.
+        // A blocking connect waits for a free place, at most SO_SNDTIMEO.
+        struct timeval tv = {(time_t)(max_connect_time / 1000), (suseconds_t)(max_connect_time % 1000) * 1000};
+        struct timeval no_timeout = {0, 0};
+        bool connected;
+        if(!set_blocking_mode(fd, true) || setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) != 0)
+        {
+            return false;
+        }
+        connected = connect(fd, (const struct sockaddr*)address, sizeof(*address)) == 0;
+        return setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &no_timeout, sizeof(no_timeout)) == 0 && connected;
+    }
+    return false;
+}
+#endif
+
+/*
+Connect to the unix socket at PATH, like a local server or a sidecar proxy.
+If the server can't accept the connection at once, for example because its backlog is full, it waits at most MAX_CONNECT_TIME milliseconds.
+
+- when it succeeds, it returns a pointer to a structure handler.
+- when it fails, it returns NULL and errno contains more information.
+*/
+rh_SocketHandler* rh_socket_unix_client_init(const char* path, rh_milliseconds max_connect_time)
+{
+#ifdef WIN32
+    (void)path;
+    (void)max_connect_time;
+    return NULL;
+#else
+    struct sockaddr_un address;
+    rh_SocketHandler* client;
+    size_t path_length = strlen(path);
+
+    if(path_length == 0 || path_length >= sizeof(address.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path, path_length + 1);
+
+    client = (rh_SocketHandler*) malloc(sizeof(rh_SocketHandler));
+    if(client == NULL)
+    {
+        return NULL;
+    }
+    client->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(client->fd == RH_INVALID_SOCKET)
+    {
+        free(client);
+        return NULL;
+    }
+    if(!set_blocking_mode(client->fd, false) || !connect_unix(client->fd, &address, max_connect_time))
+    {
+        close(client->fd);
+        free(client);
+        return NULL;
+    }
+
+    client->ssl = NULL;
+    client->ctx = NULL;
+    client->connecting = false;
+    client->handshaking = false;
+    client->early_data = false;
+    client->session_key = NULL;
+    client->quick_ack = false;
+    #ifdef RH_USE_IO_URING
+    client->uring = NULL;
+    #endif
+
+    return client;
+#endif
+}
+
+
+/*
+Start to connect to SERVER_HOSTNAME without blocking, except for the resolution of the name.
+The first address that accepts to start a connection is used.
+The connection must be completed with rh_socket_client_continue.
+*/
+rh_SocketHandler* rh_socket_client_start(const char* server_hostname, uint16_t server_port, bool secured, const rh_SocketOptions* options)
+{
+    char str_server_port[8];
+    struct addrinfo* result = NULL;
+    struct addrinfo* next_result;
+    rh_SocketHandler* client;
+    rh_SocketOptions tcp_options;
+
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags = 0,
+        .ai_protocol = IPPROTO_TCP
+    };
+
+    if(options != NULL)
+    {
+        // a deferred Fast Open connect would only fail with the first non-blocking write
+        tcp_options = *options;
+        tcp_options.fast_open = false;
+    }
+
+    if(secured)
+    {
+        SSL_library_init();
+        OpenSSL_add_all_algorithms();
+        SSL_load_error_strings();
+    }
+
+    client = (rh_SocketHandler*) malloc(sizeof(rh_SocketHandler));
+    if(client == NULL)
+    {
+        return NULL;
+    }
+    client->fd = RH_INVALID_SOCKET;
+    client->ssl = NULL;
+    client->ctx = NULL;
+    client->connecting = true;
+    client->handshaking = secured;
+    client->early_data = false;
+    client->session_key = NULL;
+    client->quick_ack = options != NULL && options->quick_ack;
+    #ifdef RH_USE_IO_URING
+    client->uring = NULL;
+    #endif
+
+    rh_uint64_to_str(str_server_port, server_port);
+    if(getaddrinfo(server_hostname, str_server_port, &hints, &result))
+    {
+        free(client);
+        return NULL;
+    }
+
+    for(next_result = result; next_result != NULL && client->fd == RH_INVALID_SOCKET; next_result = next_result->ai_next)
+    {
+        client->fd = socket(next_result->ai_family, next_result->ai_socktype, next_result->ai_protocol);
+        if(client->fd == RH_INVALID_SOCKET)
+        {
+            continue;
+        }
+        set_socket_options(client->fd, options != NULL ? &tcp_options : NULL);
+        if(!set_blocking_mode(client->fd, false) || (connect(client->fd, next_result->ai_addr, (socklen_t)next_result->ai_addrlen) == -1 && errno != EINPROGRESS))
+        {
+            #ifdef WIN32
+                closesocket(client->fd);
+            #else
+                close(client->fd);
+            #endif
+            client->fd = RH_INVALID_SOCKET;
+        }
+    }
+    freeaddrinfo(result);
+
+    if(client->fd == RH_INVALID_SOCKET)
+    {
+        free(client);
+        return NULL;
+    }
+
+    if(secured)
+    {
+        client->ctx = SSL_CTX_new(SSLv23_client_method());
+        client->ssl = client->ctx != NULL ? SSL_new(client->ctx) : NULL;
+        if(client->ssl == NULL)
+        {
+            rh_socket_close(&client);
+            return NULL;
+        }
+        SSL_set_tlsext_host_name(client->ssl, server_hostname);
+        SSL_set_fd(client->ssl, (int)client->fd);
+        set_ssl_options(client->ssl, options);
+        if(options != NULL && options->session_cache)
+        {
+            resume_session(client, server_hostname, str_server_port);
+        }
+        SSL_set_connect_state(client->ssl);
+    }
+
+    return client;
+}
+
+/*
+Continue the connection started by rh_socket_client_start, and its TLS handshake.
+Returns RH_SOCKET_DONE once the connection can be used, or the event to wait for before calling it again.
+*/
+rh_SocketProgress rh_socket_client_continue(rh_SocketHandler* s)
+{
+    if(s->connecting)
+    {
+        int so_error;
+        socklen_t len = sizeof(so_error);
+
+        #ifdef WIN32
+        fd_set fdset;
+        struct timeval tv = {0, 0};
+        FD_ZERO(&fdset);
+        FD_SET(s->fd, &fdset);
+        int r = select((int)s->fd + 1, NULL, &fdset, NULL, &tv);
+        #else
+        struct pollfd pfd = {
+            .fd = s->fd,
+            .events = POLLOUT,
+            .revents = 0
+        };
+        int r = poll(&pfd, 1, 0);
+        #endif
+        if(r < 0)
+        {
+            return RH_SOCKET_FAILED;
+        }
+        if(r == 0)
+        {
+            return RH_SOCKET_WANT_WRITE;
+        }
+        if(getsockopt(s->fd, SOL_SOCKET, SO_ERROR, (void*)&so_error, &len) != 0 || so_error != 0)
+        {
+            return RH_SOCKET_FAILED;
+        }
+        s->connecting = false;
+    }
+
+    if(s->handshaking)
+    {
+        int r = SSL_do_handshake(s->ssl);
+        if(r != 1)
+        {
+            return rh_socket_progress(s, r, true);
+        }
+        s->handshaking = false;
+    }
+
+    return RH_SOCKET_DONE;
+}
+
+bool rh_socket_set_blocking(rh_SocketHandler* s, bool blocking)
+{
+    #ifdef RH_USE_IO_URING
+    if(!blocking && s->uring != NULL)
+    {
+        // The readiness of the socket is watched by the caller, so the data must stay in the socket
+        if(rh_uring_has_pending_data(s->uring))
+        {
+            return false;
+        }
+        rh_uring_detach(&(s->uring));
+        if(s->ssl != NULL)
+        {
+            SSL_set_rfd(s->ssl, (int)s->fd);
+        }
+    }
+    #endif
+    return set_blocking_mode(s->fd, blocking);
+}
+
+int rh_socket_fd(const rh_SocketHandler* s)
+{
+    return (int)s->fd;
+}
+
+/*
+Tell why an operation on a non-blocking socket returned RESULT (0 or less).
+READING is true if it was a reception.
+*/
+rh_SocketProgress rh_socket_progress(rh_SocketHandler* s, ssize_t result, bool reading)
+{
+    if(s->ssl != NULL)
+    {
+        switch(SSL_get_error(s->ssl, (int)result))
+        {
+            case SSL_ERROR_WANT_READ:
+                return RH_SOCKET_WANT_READ;
+            case SSL_ERROR_WANT_WRITE:
+                return RH_SOCKET_WANT_WRITE;
+            default:
+                return RH_SOCKET_FAILED;
+        }
+    }
+
+    #ifdef WIN32
+    bool would_block = result < 0 && WSAGetLastError() == WSAEWOULDBLOCK;
+    #else
+    bool would_block = result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    #endif
+    if(!would_block)
+    {
+        return RH_SOCKET_FAILED;
+    }
+    return reading ? RH_SOCKET_WANT_READ : RH_SOCKET_WANT_WRITE;
+}
+
+
+/*
+Send BUFFER as TLS 1.3 early data, with the ClientHello of the resumed session, then finish the handshake.
+If the server rejected the early data, or if BUFFER is too big for them, it's sent again once the handshake is done.
+*/
+static ssize_t send_early_data(rh_SocketHandler* s, const char* buffer, size_t n)
+{
+    size_t written = 0;
+
+    s->early_data = false;
+    if(n <= SSL_SESSION_get_max_early_data(SSL_get_session(s->ssl)) && SSL_write_early_data(s->ssl, buffer, n, &written) != 1)
+    {
+        return -1;
+    }
+    if(SSL_connect(s->ssl) != 1)
+    {
+        return -1;
+    }
+    if(written == n && SSL_get_early_data_status(s->ssl) == SSL_EARLY_DATA_ACCEPTED)
+    {
+        return (ssize_t)n;
+    }
+    return SSL_write(s->ssl, buffer, (int)n);
+}
+
 
 /*
 This function will send the data contained in the buffer array through the socket
@@ -338,6 +922,10 @@ FLAGS: I recommend you to let this parameter to 0, but you can see the man page
 */
 ssize_t rh_socket_send(rh_SocketHandler* s, const char* buffer, size_t n)
 {
+    if(s->early_data)
+    {
+        return send_early_data(s, buffer, n);
+    }
     if(s->ssl == NULL)
     {
         return send(s->fd, buffer, n, 0);
@@ -362,16 +950,277 @@ FLAGS: I recommend you to let this parameter to 0, but you can see the man page
 */
 ssize_t rh_socket_recv(rh_SocketHandler* s, char* buffer, size_t n)
 {
+    #ifdef TCP_QUICKACK
+    if(s->quick_ack)
+    {
+        set_int_option(s->fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+    }
+    #endif
+    #ifdef RH_USE_IO_URING
+    if(s->uring != NULL && s->ssl == NULL)
+    {
+        return rh_uring_recv(s->uring, buffer, n);
+    }
+    #endif
     if(s->ssl == NULL)
     {
         return recv(s->fd, buffer, n, 0);
     }
     else
     {
+        s->early_data = false;  // SSL_read does the handshake if it wasn't done
         return SSL_read(s->ssl, buffer, (int)n);
     }
 }
 
+#ifdef RH_USE_IO_URING
+static BIO_METHOD* uring_bio_method = NULL;
+static pthread_once_t uring_bio_once = PTHREAD_ONCE_INIT;
+
+static int uring_bio_read(BIO* bio, char* buffer, int size)
+{
+    ssize_t received = rh_uring_recv((rh_UringConnection*) BIO_get_data(bio), buffer, (size_t)size);
+    BIO_clear_retry_flags(bio);
+    if(received < 0 && errno == EAGAIN)
+    {
+        BIO_set_retry_read(bio);
+    }
+    return (int)received;
+}
+
+static long uring_bio_ctrl(BIO* bio, int cmd, long num, void* ptr)
+{
+    (void)bio;
+    (void)num;
+    (void)ptr;
+    return cmd == BIO_CTRL_FLUSH ? 1 : 0;
+}
+
+static int uring_bio_create(BIO* bio)
+{
+    BIO_set_init(bio, 1);
+    return 1;
+}
+
+static void init_uring_bio_method(void)
+{
+    BIO_METHOD* method = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "rh_uring");
+    if(method == NULL)
+    {
+        return;
+    }
+    if(!BIO_meth_set_read(method, uring_bio_read) || !BIO_meth_set_ctrl(method, uring_bio_ctrl) || !BIO_meth_set_create(method, uring_bio_create))
+    {
+        BIO_meth_free(method);
+        return;
+    }
+    uring_bio_method = method;
+}
+#endif
+
+bool rh_socket_io_uring_available(void)
+{
+    #ifdef RH_USE_IO_URING
+    return rh_uring_available();
+    #else
+    return false;
+    #endif
+}
+
+bool rh_socket_ktls_available(void)
+{
+    #ifndef OPENSSL_NO_KTLS
+    return true;
+    #else
+    return false;
+    #endif
+}
+
+/*
+Receive the data of the connection S through io_uring from now on.
+For a TLS connection, OpenSSL reads the records through a BIO that takes them from io_uring, and still writes directly in the socket.
+Returns false if io_uring can't be used, the connection then works as before.
+*/
+bool rh_socket_use_io_uring(rh_SocketHandler* s)
+{
+    #ifdef RH_USE_IO_URING
+    if(s->uring != NULL)
+    {
+        return true;
+    }
+    if(s->connecting || s->handshaking || s->early_data || (s->ssl != NULL && BIO_get_ktls_recv(SSL_get_rbio(s->ssl))))
+    {
+        // the kernel decrypts the records, they must be read by OpenSSL from the socket itself
+        return false;
+    }
+    s->uring = rh_uring_attach((int)s->fd);
+    if(s->uring == NULL)
+    {
+        return false;
+    }
+    if(s->ssl != NULL)
+    {
+        BIO* bio;
+        pthread_once(&uring_bio_once, init_uring_bio_method);
+        bio = uring_bio_method != NULL ? BIO_new(uring_bio_method) : NULL;
+        if(bio == NULL)
+        {
+            rh_uring_detach(&(s->uring));
+            return false;
+        }
+        BIO_set_data(bio, s->uring);
+        SSL_set0_rbio(s->ssl, bio);
+    }
+    return true;
+    #else
+    (void)s;
+    return false;
+    #endif
+}
+
+/*
+Tell, without blocking, if something was received on the socket.
+Returns -1 if the connection failed or was hung up, 1 if there is something to read (data or an end of stream), 0 otherwise.
+*/
+static int poll_received(rh_SocketHandler* s, rh_milliseconds timeout)
+{
+    #ifdef RH_USE_IO_URING
+    if(s->uring != NULL)
+    {
+        // the receptions are posted by io_uring, there is nothing to poll on
+        rh_UringState state = rh_uring_wait(s->uring, timeout > INT_MAX ? INT_MAX : (int)timeout);
+        return state == RH_URING_CLOSED ? -1 : state == RH_URING_READABLE;
+    }
+    #endif
+
+    #ifdef WIN32
+    fd_set fdset;
+    struct timeval tv = {(long)(timeout / 1000), (long)(timeout % 1000) * 1000};
+    FD_ZERO(&fdset);
+    FD_SET(s->fd, &fdset);
+    int r = select((int)s->fd + 1, &fdset, NULL, NULL, &tv);
+    if(r < 0)
+    {
+        return -1;
+    }
+    #else
+    struct pollfd pfd = {
+        .fd = s->fd,
+        .events = POLLIN,
+        .revents = 0
+    };
+    int r = poll(&pfd, 1, timeout > INT_MAX ? INT_MAX : (int)timeout);
+    if(r < 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+    {
+        return -1;
+    }
+    #endif
+    return r > 0;
+}
+
+/*
+Internal function to choose if the receptions can block, without taking the socket out of io_uring
+*/
+static bool set_reception_blocking(rh_SocketHandler* s, bool blocking)
+{
+    #ifdef RH_USE_IO_URING
+    if(s->uring != NULL)
+    {
+        rh_uring_set_blocking(s->uring, blocking);
+        return true;
+    }
+    #endif
+    return set_blocking_mode(s->fd, blocking);
+}
+
+/*
+Check, without blocking, that an idle connection can still be used.
+The connection is dead if the peer closed it, sent a TLS close_notify, or sent data that nobody asked for.
+TLS 1.3 session tickets sent after the handshake are consumed without killing the connection.
+*/
+bool rh_socket_is_alive(rh_SocketHandler* s)
+{
+    char byte;
+    int received;
+
+    if(s->ssl != NULL && SSL_pending(s->ssl) > 0)
+    {
+        return false;
+    }
+
+    received = poll_received(s, 0);
+    if(received < 0)
+    {
+        return false;
+    }
+    if(received == 0)
+    {
+        // nothing happened since the last response
+        return true;
+    }
+
+    if(s->ssl == NULL)
+    {
+        // Data or EOF, a quiet connection has neither
+        return false;
+    }
+
+    // It may only be a TLS record that isn't application data, let OpenSSL look at it
+    if(!set_reception_blocking(s, false))
+    {
+        return false;
+    }
+    int peeked = SSL_peek(s->ssl, &byte, 1);
+    int error = peeked > 0 ? SSL_ERROR_NONE : SSL_get_error(s->ssl, peeked);
+    set_reception_blocking(s, true);
+
+    return peeked <= 0 && error == SSL_ERROR_WANT_READ;
+}
+
+/*
+Wait at most TIMEOUT milliseconds for the peer to send something, without reading it.
+The TLS records that carry no application data, like the session tickets, don't count.
+Returns true if something can be read, or if the connection was closed or failed, so the next reception tells what happened.
+*/
+bool rh_socket_wait_readable(rh_SocketHandler* s, rh_milliseconds timeout)
+{
+    rh_nanoseconds start = rh_timer_now();
+
+    while(true)
+    {
+        char byte;
+        rh_milliseconds elapsed = rh_timer_elapsed_ms(start);
+        int received;
+
+        if(s->ssl != NULL && SSL_pending(s->ssl) > 0)
+        {
+            return true;
+        }
+        if(elapsed >= timeout)
+        {
+            return false;
+        }
+        received = poll_received(s, timeout - elapsed);
+        if(received != 1 || s->ssl == NULL)
+        {
+            return received != 0;
+        }
+
+        if(!set_reception_blocking(s, false))
+        {
+            return true;
+        }
+        int peeked = SSL_peek(s->ssl, &byte, 1);
+        int error = peeked > 0 ? SSL_ERROR_NONE : SSL_get_error(s->ssl, peeked);
+        set_reception_blocking(s, true);
+        if(peeked > 0 || error != SSL_ERROR_WANT_READ)
+        {
+            return true;
+        }
+        // only a record without application data, keep waiting
+    }
+}
+
 /*
 This function take the address of the pointer on the handler, release all the stuff, close the socket and put the SocketHandler pointer to NULL.
 
@@ -393,12 +1242,16 @@ void rh_socket_close(rh_SocketHandler** pps)
     {
         SSL_CTX_free((*pps)->ctx);
     }
+    #ifdef RH_USE_IO_URING
+    rh_uring_detach(&((*pps)->uring));
+    #endif
     #ifdef WIN32
         closesocket((*pps)->fd);
     #else
         close((*pps)->fd);
     #endif
 
+    free((*pps)->session_key);
     free(*pps);
     *pps = NULL;
 }
\ No newline at end of file
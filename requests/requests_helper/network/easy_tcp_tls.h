@@ -14,6 +14,28 @@
 
     typedef struct _rh_socket_handler rh_SocketHandler;
 
+    typedef enum _rh_socket_progress {
+        RH_SOCKET_DONE,
+        RH_SOCKET_WANT_READ,  /* wait until the socket is readable and try again */
+        RH_SOCKET_WANT_WRITE,  /* wait until the socket is writable and try again */
+        RH_SOCKET_FAILED
+    } rh_SocketProgress;
+
+    typedef struct _rh_socket_options {
+        bool ktls;  /* let the kernel encrypt and decrypt the TLS records after the handshake, if the kernel and the cipher allow it */
+        bool session_cache;  /* resume the TLS session given by the server on a previous connection, and keep the new ones */
+        bool early_data;  /* with a resumed TLS 1.3 session that allows it, send the first data given to rh_socket_send with the handshake */
+        bool no_delay;  /* disable Nagle's algorithm (TCP_NODELAY), so the small writes leave at once */
+        int receive_buffer_size;  /* SO_RCVBUF in bytes, 0 to let the kernel tune it */
+        int send_buffer_size;  /* SO_SNDBUF in bytes, 0 to let the kernel tune it */
+        int keepalive_idle;  /* seconds of idleness before the first TCP keepalive probe, 0 to send no probe */
+        int keepalive_interval;  /* seconds between two keepalive probes, 0 for the default of the system */
+        int keepalive_count;  /* the number of unanswered probes before the connection is dropped, 0 for the default of the system */
+        bool fast_open;  /* send the first data with the SYN if the server gave a TCP Fast Open cookie before (TCP_FASTOPEN_CONNECT), blocking connections only */
+        int busy_poll;  /* microseconds of busy polling of the device queue when nothing was received yet (SO_BUSY_POLL), 0 to disable it */
+        bool quick_ack;  /* acknowledge the received data at once instead of delaying the ACK (TCP_QUICKACK) */
+    } rh_SocketOptions;
+
     #ifdef __cplusplus
     extern "C"{
     #endif
@@ -30,13 +52,15 @@
 
     /**
      * @brief This function works like socket_client_init, but it will create an ssl secured socket connection.
+     * @brief If `options` asks for early data and a resumed session allows them, the handshake is done by the first `rh_socket_send`, which sends its data with it.
      * 
      * @param server_hostname the targeted server ip, formatted like "127.0.0.1", like "2001:0db8:85a3:0000:0000:8a2e:0370:7334" or like "example.com"
      * @param server_port the opened server port that listen the connection
+     * @param options the options of the connection, NULL for the default ones.
      * @return - when it succeeds, it returns a pointer to a structure handler.
      * @return - when it fails, it returns `NULL` and `rh_print_last_error()` can tell what happened
      */
-    rh_SocketHandler* rh_socket_ssl_client_init(const char* server_hostname, uint16_t server_port, rh_milliseconds max_connect_time);
+    rh_SocketHandler* rh_socket_ssl_client_init(const char* server_hostname, uint16_t server_port, rh_milliseconds max_connect_time, const rh_SocketOptions* options);
 
 
     /**
@@ -44,10 +68,96 @@
      * 
      * @param server_hostname the targeted server host name, formatted like "127.0.0.1", like "2001:0db8:85a3:0000:0000:8a2e:0370:7334" or like "example.com"
      * @param server_port the opened server port that listen the connection
+     * @param options the options of the connection, NULL for the default ones.
      * @return - when it succeeds, it returns a pointer to a structure handler.
      * @return - when it fails, it returns `NULL` and `rh_print_last_error()` can tell what happened
      */
-    rh_SocketHandler* rh_socket_client_init(const char* server_hostname, uint16_t server_port, rh_milliseconds max_connect_time);
+    rh_SocketHandler* rh_socket_client_init(const char* server_hostname, uint16_t server_port, rh_milliseconds max_connect_time, const rh_SocketOptions* options);
+
+    /**
+     * @brief Connect to a unix socket. If the server can't accept the connection at once, for example because its backlog is full, it waits for it.
+     * @brief It always fails on Windows.
+     * 
+     * @param path the path of the socket, like "/var/run/docker.sock"
+     * @param max_connect_time the maximum time to wait for the server in milliseconds, 0 to fail if it can't accept the connection at once.
+     * @return - when it succeeds, it returns a pointer to a structure handler, that is used like the one of `rh_socket_client_init`.
+     * @return - when it fails, it returns `NULL`
+     */
+    rh_SocketHandler* rh_socket_unix_client_init(const char* path, rh_milliseconds max_connect_time);
+
+    /**
+     * @brief Start to connect to a server without blocking, except for the resolution of `server_hostname`.
+     * @brief The socket is non-blocking and the connection must be completed with `rh_socket_client_continue`.
+     * 
+     * @param server_hostname the targeted server host name, formatted like "127.0.0.1", like "2001:0db8:85a3:0000:0000:8a2e:0370:7334" or like "example.com"
+     * @param server_port the opened server port that listen the connection
+     * @param secured true to do a TLS handshake once connected
+     * @param options the options of the connection, NULL for the default ones.
+     * @return - when it succeeds, it returns a pointer to a structure handler.
+     * @return - when it fails, it returns `NULL`
+     */
+    rh_SocketHandler* rh_socket_client_start(const char* server_hostname, uint16_t server_port, bool secured, const rh_SocketOptions* options);
+
+
+    /**
+     * @brief Continue the connection started by `rh_socket_client_start`, and its TLS handshake if it's secured.
+     * 
+     * @param s the handler returned by `rh_socket_client_start`
+     * @return `RH_SOCKET_DONE` once the connection can be used, `RH_SOCKET_FAILED` if it failed, or the event to wait for before calling it again.
+     */
+    rh_SocketProgress rh_socket_client_continue(rh_SocketHandler* s);
+
+
+    /**
+     * @return true if the library was built with io_uring (`RH_USE_IO_URING`) and the kernel accepts it.
+     */
+    bool rh_socket_io_uring_available(void);
+
+
+    /**
+     * @brief Receive the data of a connected socket through io_uring from now on: a multishot reception fills registered buffers as the data arrives,
+     * @brief and the completions of all the connections are collected by the same system calls.
+     * 
+     * @param s a pointer to a SocketHandler, whose connection is completed
+     * @return false if io_uring can't be used, or if the kernel decrypts the TLS records (kTLS). The socket then works as before.
+     */
+    bool rh_socket_use_io_uring(rh_SocketHandler* s);
+
+
+    /**
+     * @return false if OpenSSL was built without kTLS. Whether the kernel takes over a connection is only known after its handshake.
+     */
+    bool rh_socket_ktls_available(void);
+
+
+    /**
+     * @brief Switch a socket between the blocking and the non-blocking modes.
+     * @brief A socket is taken out of io_uring when it becomes non-blocking, so its readiness can be watched again. It fails if io_uring holds data that wasn't read.
+     * 
+     * @param s a pointer to a SocketHandler
+     * @param blocking true for the blocking mode
+     * @return false if it failed.
+     */
+    bool rh_socket_set_blocking(rh_SocketHandler* s, bool blocking);
+
+
+    /**
+     * @param s a pointer to a SocketHandler
+     * @return the file descriptor of the socket, to wait for its events.
+     */
+    int rh_socket_fd(const rh_SocketHandler* s);
+
+
+    /**
+     * @brief Tell why `rh_socket_send` or `rh_socket_recv` didn't transfer anything on a non-blocking socket. It must be called right after them.
+     * 
+     * @param s a pointer to a SocketHandler
+     * @param result the value returned by `rh_socket_send` or `rh_socket_recv`
+     * @param reading true after `rh_socket_recv`, false after `rh_socket_send`
+     * @return the event to wait for before trying again, or `RH_SOCKET_FAILED` if the connection failed or was closed.
+     */
+    rh_SocketProgress rh_socket_progress(rh_SocketHandler* s, ssize_t result, bool reading);
+
 
     /**
      * @brief This function will send the data contained in the buffer array through the socket
@@ -72,6 +182,26 @@
     ssize_t rh_socket_recv(rh_SocketHandler* s, char* buffer, size_t n);
 
 
+    /**
+     * @brief Check, without blocking, that an idle connection can still be used.
+     * @brief The connection is considered dead if the peer closed it, sent a TLS close_notify alert, or sent unexpected data.
+     * 
+     * @param s a pointer to a SocketHandler with no response left to read.
+     * @return true if the connection looks alive, false otherwise.
+     */
+    bool rh_socket_is_alive(rh_SocketHandler* s);
+
+
+    /**
+     * @brief Wait for the peer to send something, without reading it. The TLS records without application data, like the session tickets, are ignored.
+     *
+     * @param s a pointer to a SocketHandler in blocking mode.
+     * @param timeout the maximum time to wait, in milliseconds.
+     * @return true if something can be read or if the connection was closed or failed, false if nothing came in time.
+     */
+    bool rh_socket_wait_readable(rh_SocketHandler* s, rh_milliseconds timeout);
+
+
     /**
      * @brief This function take the address of the pointer on the handler to release all the stuff and put the rh_SocketHandler pointer to NULL.
      * 
@@ -0,0 +1,726 @@
+#ifdef RH_USE_IO_URING
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "requests_helper/network/uring.h"
+
+#define URING_ENTRIES 256
+#define NB_BUFFERS 128  /* must be a power of 2 */
+#define BUFFER_SIZE 16384
+#define BUFFER_GROUP 0
+#define NO_BUFFER UINT16_MAX
+
+struct _rh_uring_connection {
+    int fd;
+    uint16_t first;  /* the received buffers that are not entirely read, linked by next_buffer */
+    uint16_t last;
+    size_t offset;  /* the bytes already read in the first buffer */
+    int error;
+    bool eof;
+    bool armed;  /* a multishot reception is in flight */
+    bool starved;  /* the last reception stopped because all the buffers were in use */
+    bool fallback;  /* the kernel doesn't support multishot receptions, recv is used instead */
+    bool nonblocking;
+};
+
+/*
+The instance shared by the whole process. A connection can be used by any thread, so everything is protected by the lock.
+Only one thread at a time waits in io_uring_enter, it collects the completions of everybody and wakes the others up.
+*/
+typedef struct _uring {
+    int fd;
+    pthread_mutex_t lock;
+    pthread_cond_t reaped;
+    bool waiting;  /* a thread waits in io_uring_enter, only this one can reap the completions */
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    struct io_uring_sqe* sqes;
+
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+
+    struct io_uring_buf_ring* buffer_ring;  /* the free buffers, registered in the kernel */
+    uint16_t buffer_ring_tail;
+    char* buffers;
+    uint32_t buffer_length[NB_BUFFERS];
+    uint16_t next_buffer[NB_BUFFERS];
+} Uring;
+
+static Uring uring;
+static bool uring_ready = false;
+static pthread_once_t uring_once = PTHREAD_ONCE_INIT;
+
+
+static inline int uring_setup(unsigned entries, struct io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, uring.fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/*
+Same as uring_enter with IORING_ENTER_GETEVENTS, but the wait stops after TIMEOUT, like io_uring_wait_cqe_timeout.
+*/
+static inline int uring_enter_timeout(unsigned to_submit, struct __kernel_timespec* timeout)
+{
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)(uintptr_t)timeout;
+    return (int)syscall(__NR_io_uring_enter, uring.fd, to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+static inline int uring_register(unsigned opcode, void* arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, uring.fd, opcode, arg, nr_args);
+}
+
+/*
+Put the buffer BID back in the ring of free buffers.
+*/
+static void give_back(uint16_t bid)
+{
+    struct io_uring_buf* buffer = &(uring.buffer_ring->bufs[uring.buffer_ring_tail & (NB_BUFFERS - 1)]);
+    buffer->addr = (uint64_t)(uintptr_t)(uring.buffers + (size_t)bid * BUFFER_SIZE);
+    buffer->len = BUFFER_SIZE;
+    buffer->bid = bid;
+    uring.buffer_ring_tail++;
+    __atomic_store_n(&(uring.buffer_ring->tail), uring.buffer_ring_tail, __ATOMIC_RELEASE);
+}
+
+static void init_uring(void)
+{
+    struct io_uring_params params;
+    struct io_uring_buf_reg buffer_reg;
+    void* sq_ring = MAP_FAILED;
+    void* cq_ring = MAP_FAILED;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t buffer_ring_size = NB_BUFFERS * sizeof(struct io_uring_buf);
+
+    memset(&params, 0, sizeof(params));
+    uring.fd = uring_setup(URING_ENTRIES, &params);
+    if(uring.fd < 0)
+    {
+        return;
+    }
+    if(!(params.features & IORING_FEAT_EXT_ARG))
+    {
+        // the waits with a timeout need Linux 5.11, older than the provided buffer rings anyway
+        close(uring.fd);
+        return;
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        sq_ring_size = sq_ring_size > cq_ring_size ? sq_ring_size : cq_ring_size;
+        cq_ring_size = sq_ring_size;
+    }
+    sq_ring = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQ_RING);
+    if(sq_ring == MAP_FAILED)
+    {
+        goto ERROR;
+    }
+    cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_ring : mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_CQ_RING);
+    if(cq_ring == MAP_FAILED)
+    {
+        goto ERROR;
+    }
+    uring.sqes = (struct io_uring_sqe*) mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQES);
+    if(uring.sqes == MAP_FAILED)
+    {
+        goto ERROR;
+    }
+
+    uring.sq_head = (unsigned*)((char*)sq_ring + params.sq_off.head);
+    uring.sq_tail = (unsigned*)((char*)sq_ring + params.sq_off.tail);
+    uring.sq_array = (unsigned*)((char*)sq_ring + params.sq_off.array);
+    uring.sq_mask = *(unsigned*)((char*)sq_ring + params.sq_off.ring_mask);
+    uring.sq_entries = params.sq_entries;
+    uring.cq_head = (unsigned*)((char*)cq_ring + params.cq_off.head);
+    uring.cq_tail = (unsigned*)((char*)cq_ring + params.cq_off.tail);
+    uring.cq_mask = *(unsigned*)((char*)cq_ring + params.cq_off.ring_mask);
+    uring.cqes = (struct io_uring_cqe*)((char*)cq_ring + params.cq_off.cqes);
+
+    // The buffer ring must be page aligned, mmap gives that
+    uring.buffer_ring = (struct io_uring_buf_ring*) mmap(NULL, buffer_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(uring.buffer_ring == MAP_FAILED)
+    {
+        goto ERROR;
+    }
+    uring.buffers = (char*) malloc((size_t)NB_BUFFERS * BUFFER_SIZE);
+    if(uring.buffers == NULL)
+    {
+        goto ERROR;
+    }
+    memset(&buffer_reg, 0, sizeof(buffer_reg));
+    buffer_reg.ring_addr = (uint64_t)(uintptr_t)uring.buffer_ring;
+    buffer_reg.ring_entries = NB_BUFFERS;
+    buffer_reg.bgid = BUFFER_GROUP;
+    if(uring_register(IORING_REGISTER_PBUF_RING, &buffer_reg, 1) != 0)
+    {
+        // provided buffer rings need Linux 5.19
+        goto ERROR;
+    }
+    uring.buffer_ring_tail = 0;
+    for(uint16_t bid = 0; bid < NB_BUFFERS; bid++)
+    {
+        give_back(bid);
+    }
+
+    if(pthread_mutex_init(&(uring.lock), NULL) != 0)
+    {
+        goto ERROR;
+    }
+    if(pthread_cond_init(&(uring.reaped), NULL) != 0)
+    {
+        pthread_mutex_destroy(&(uring.lock));
+        goto ERROR;
+    }
+    uring.waiting = false;
+    uring_ready = true;
+    return;
+
+ERROR:
+    free(uring.buffers);
+    if(uring.buffer_ring != NULL && uring.buffer_ring != MAP_FAILED)
+    {
+        munmap(uring.buffer_ring, buffer_ring_size);
+    }
+    if(uring.sqes != NULL && uring.sqes != MAP_FAILED)
+    {
+        munmap(uring.sqes, params.sq_entries * sizeof(struct io_uring_sqe));
+    }
+    if(cq_ring != MAP_FAILED && cq_ring != sq_ring)
+    {
+        munmap(cq_ring, cq_ring_size);
+    }
+    if(sq_ring != MAP_FAILED)
+    {
+        munmap(sq_ring, sq_ring_size);
+    }
+    close(uring.fd);
+}
+
+bool rh_uring_available(void)
+{
+    pthread_once(&uring_once, init_uring);
+    return uring_ready;
+}
+
+/*
+Returns the number of entries queued in the submission ring that the kernel didn't take yet.
+*/
+static inline unsigned nb_unsubmitted(void)
+{
+    return *(uring.sq_tail) - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE);
+}
+
+static void submit(void)
+{
+    unsigned to_submit = nb_unsubmitted();
+    if(to_submit > 0)
+    {
+        uring_enter(to_submit, 0, 0);
+    }
+}
+
+/*
+Returns a cleared submission entry, that is queued by push_sqe, or NULL if the submission ring is full.
+The lock must be held.
+*/
+static struct io_uring_sqe* get_sqe(void)
+{
+    if(nb_unsubmitted() == uring.sq_entries)
+    {
+        submit();
+        if(nb_unsubmitted() == uring.sq_entries)
+        {
+            return NULL;
+        }
+    }
+    unsigned index = *(uring.sq_tail) & uring.sq_mask;
+    memset(&(uring.sqes[index]), 0, sizeof(struct io_uring_sqe));
+    uring.sq_array[index] = index;
+    return &(uring.sqes[index]);
+}
+
+static inline void push_sqe(void)
+{
+    __atomic_store_n(uring.sq_tail, *(uring.sq_tail) + 1, __ATOMIC_RELEASE);
+}
+
+/*
+Queue a multishot reception on CONNECTION, it will be submitted with the next system call.
+The lock must be held.
+*/
+static bool arm(rh_UringConnection* connection)
+{
+    struct io_uring_sqe* sqe = get_sqe();
+    if(sqe == NULL)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connection->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = (uint64_t)(uintptr_t)connection;
+    push_sqe();
+    connection->armed = true;
+    return true;
+}
+
+static void dispatch(const struct io_uring_cqe* cqe)
+{
+    rh_UringConnection* connection = (rh_UringConnection*)(uintptr_t)cqe->user_data;
+    if(connection == NULL)
+    {
+        // the result of a cancellation
+        return;
+    }
+
+    if(cqe->flags & IORING_CQE_F_BUFFER)
+    {
+        uint16_t bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        if(cqe->res <= 0)
+        {
+            give_back(bid);
+        }
+        else
+        {
+            uring.buffer_length[bid] = (uint32_t)cqe->res;
+            uring.next_buffer[bid] = NO_BUFFER;
+            if(connection->last == NO_BUFFER)
+            {
+                connection->first = bid;
+            }
+            else
+            {
+                uring.next_buffer[connection->last] = bid;
+            }
+            connection->last = bid;
+        }
+    }
+    if(cqe->res == 0)
+    {
+        connection->eof = true;
+    }
+    else if(cqe->res == -ENOBUFS)
+    {
+        connection->starved = true;
+    }
+    else if(cqe->res == -EINVAL)
+    {
+        // multishot receptions need Linux 6.0
+        connection->fallback = true;
+    }
+    else if(cqe->res < 0 && cqe->res != -ECANCELED)
+    {
+        connection->error = -cqe->res;
+    }
+
+    if(!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        connection->armed = false;
+    }
+}
+
+/*
+Give the completions to their connections.
+The lock must be held and no thread must be waiting in io_uring_enter.
+*/
+static void reap(void)
+{
+    unsigned head = *(uring.cq_head);
+    unsigned tail = __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+    while(head != tail)
+    {
+        dispatch(&(uring.cqes[head & uring.cq_mask]));
+        head++;
+    }
+    __atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+}
+
+/*
+Wait until new completions are reaped, and submit what is queued on the way.
+The lock must be held, it's released during the wait.
+*/
+static void wait_completions(void)
+{
+    if(uring.waiting)
+    {
+        // Another thread waits in the kernel, it will wake us up
+        submit();
+        pthread_cond_wait(&(uring.reaped), &(uring.lock));
+        return;
+    }
+
+    uring.waiting = true;
+    unsigned to_submit = nb_unsubmitted();
+    pthread_mutex_unlock(&(uring.lock));
+    uring_enter(to_submit, 1, IORING_ENTER_GETEVENTS);
+    pthread_mutex_lock(&(uring.lock));
+    uring.waiting = false;
+    reap();
+    pthread_cond_broadcast(&(uring.reaped));
+}
+
+/*
+Same as wait_completions, but it returns after TIMEOUT nanoseconds even if nothing was reaped.
+The lock must be held, it's released during the wait.
+*/
+static void wait_completions_timeout(uint64_t timeout)
+{
+    if(uring.waiting)
+    {
+        // Another thread waits in the kernel, it will wake us up
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += (time_t)(timeout / (1000 * 1000 * 1000));
+        deadline.tv_nsec += (long)(timeout % (1000 * 1000 * 1000));
+        if(deadline.tv_nsec >= 1000 * 1000 * 1000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000 * 1000 * 1000;
+        }
+        submit();
+        pthread_cond_timedwait(&(uring.reaped), &(uring.lock), &deadline);
+        return;
+    }
+
+    struct __kernel_timespec kernel_timeout = {
+        .tv_sec = (long long)(timeout / (1000 * 1000 * 1000)),
+        .tv_nsec = (long long)(timeout % (1000 * 1000 * 1000))
+    };
+    uring.waiting = true;
+    unsigned to_submit = nb_unsubmitted();
+    pthread_mutex_unlock(&(uring.lock));
+    uring_enter_timeout(to_submit, &kernel_timeout);
+    pthread_mutex_lock(&(uring.lock));
+    uring.waiting = false;
+    reap();
+    pthread_cond_broadcast(&(uring.reaped));
+}
+
+static inline uint64_t monotonic_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 * 1000 * 1000 + (uint64_t)now.tv_nsec;
+}
+
+/*
+Copy the received buffers of CONNECTION in BUFFER, at most N bytes, and give back the buffers entirely read.
+The lock must be held.
+*/
+static size_t read_buffers(rh_UringConnection* connection, char* buffer, size_t n)
+{
+    size_t copied = 0;
+    while(copied < n && connection->first != NO_BUFFER)
+    {
+        uint16_t bid = connection->first;
+        size_t length = uring.buffer_length[bid] - connection->offset;
+        if(length > n - copied)
+        {
+            length = n - copied;
+        }
+        memcpy(buffer + copied, uring.buffers + (size_t)bid * BUFFER_SIZE + connection->offset, length);
+        copied += length;
+        connection->offset += length;
+        if(connection->offset == uring.buffer_length[bid])
+        {
+            connection->first = uring.next_buffer[bid];
+            if(connection->first == NO_BUFFER)
+            {
+                connection->last = NO_BUFFER;
+            }
+            connection->offset = 0;
+            give_back(bid);
+        }
+    }
+    return copied;
+}
+
+rh_UringConnection* rh_uring_attach(int fd)
+{
+    rh_UringConnection* connection;
+    if(!rh_uring_available())
+    {
+        return NULL;
+    }
+    connection = (rh_UringConnection*) calloc(1, sizeof(rh_UringConnection));
+    if(connection == NULL)
+    {
+        return NULL;
+    }
+    // The reception is armed by the first rh_uring_recv, in the same system call as the wait
+    connection->fd = fd;
+    connection->first = NO_BUFFER;
+    connection->last = NO_BUFFER;
+    return connection;
+}
+
+ssize_t rh_uring_recv(rh_UringConnection* connection, char* buffer, size_t n)
+{
+    ssize_t received = -1;
+
+    pthread_mutex_lock(&(uring.lock));
+    while(true)
+    {
+        if(!uring.waiting)
+        {
+            reap();
+        }
+        if(connection->first != NO_BUFFER)
+        {
+            received = (ssize_t)read_buffers(connection, buffer, n);
+            break;
+        }
+        if(connection->eof)
+        {
+            received = 0;
+            break;
+        }
+        if(connection->error != 0)
+        {
+            errno = connection->error;
+            break;
+        }
+        if(!connection->armed && (connection->starved || connection->fallback))
+        {
+            // The data waits in the socket until some buffers are given back. All the completions of the last reception were reaped, so nothing is received out of order.
+            connection->starved = false;
+            pthread_mutex_unlock(&(uring.lock));
+            return recv(connection->fd, buffer, n, connection->nonblocking ? MSG_DONTWAIT : 0);
+        }
+        if(!connection->armed && !arm(connection))
+        {
+            connection->fallback = true;
+            continue;
+        }
+        if(connection->nonblocking)
+        {
+            submit();
+            errno = EAGAIN;
+            break;
+        }
+        wait_completions();
+    }
+    pthread_mutex_unlock(&(uring.lock));
+
+    return received;
+}
+
+/*
+Returns true if a completion for CONNECTION waits in the completion ring.
+The lock must be held. The ring is only read, so it works while another thread waits in the kernel.
+*/
+static bool has_unreaped_completion(const rh_UringConnection* connection)
+{
+    unsigned tail = __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+    for(unsigned head = *(uring.cq_head); head != tail; head++)
+    {
+        if(uring.cqes[head & uring.cq_mask].user_data == (uint64_t)(uintptr_t)connection)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+rh_UringState rh_uring_state(rh_UringConnection* connection)
+{
+    rh_UringState state = RH_URING_IDLE;
+    bool armed;
+
+    pthread_mutex_lock(&(uring.lock));
+    if(!uring.waiting)
+    {
+        reap();
+    }
+    if(connection->first != NO_BUFFER || (uring.waiting && has_unreaped_completion(connection)))
+    {
+        state = RH_URING_READABLE;
+    }
+    else if(connection->eof || connection->error != 0)
+    {
+        state = RH_URING_CLOSED;
+    }
+    armed = connection->armed;
+    pthread_mutex_unlock(&(uring.lock));
+
+    if(state == RH_URING_IDLE && !armed)
+    {
+        // nothing is received through io_uring, look at the socket itself
+        struct pollfd pfd = {
+            .fd = connection->fd,
+            .events = POLLIN,
+            .revents = 0
+        };
+        int r = poll(&pfd, 1, 0);
+        if(r < 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+        {
+            state = RH_URING_CLOSED;
+        }
+        else if(r > 0)
+        {
+            state = RH_URING_READABLE;
+        }
+    }
+    return state;
+}
+
+rh_UringState rh_uring_wait(rh_UringConnection* connection, int timeout)
+{
+    uint64_t deadline = monotonic_now() + (uint64_t)timeout * 1000 * 1000;
+    rh_UringState state = RH_URING_IDLE;
+
+    if(timeout <= 0)
+    {
+        return rh_uring_state(connection);
+    }
+
+    pthread_mutex_lock(&(uring.lock));
+    while(true)
+    {
+        uint64_t now;
+        if(!uring.waiting)
+        {
+            reap();
+        }
+        if(connection->first != NO_BUFFER || (uring.waiting && has_unreaped_completion(connection)))
+        {
+            state = RH_URING_READABLE;
+            break;
+        }
+        if(connection->eof || connection->error != 0)
+        {
+            state = RH_URING_CLOSED;
+            break;
+        }
+        if(!connection->armed && (connection->starved || connection->fallback))
+        {
+            // The data waits in the socket, like in rh_uring_recv
+            pthread_mutex_unlock(&(uring.lock));
+            now = monotonic_now();
+            struct pollfd pfd = {
+                .fd = connection->fd,
+                .events = POLLIN,
+                .revents = 0
+            };
+            int r = poll(&pfd, 1, now < deadline ? (int)((deadline - now + 999999) / (1000 * 1000)) : 0);
+            if(r < 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+            {
+                return RH_URING_CLOSED;
+            }
+            return r > 0 ? RH_URING_READABLE : RH_URING_IDLE;
+        }
+        if(!connection->armed && !arm(connection))
+        {
+            connection->fallback = true;
+            continue;
+        }
+        now = monotonic_now();
+        if(now >= deadline)
+        {
+            submit();
+            break;
+        }
+        wait_completions_timeout(deadline - now);
+    }
+    pthread_mutex_unlock(&(uring.lock));
+
+    return state;
+}
+
+void rh_uring_set_blocking(rh_UringConnection* connection, bool blocking)
+{
+    connection->nonblocking = !blocking;
+}
+
+bool rh_uring_has_pending_data(rh_UringConnection* connection)
+{
+    bool pending;
+    pthread_mutex_lock(&(uring.lock));
+    if(!uring.waiting)
+    {
+        reap();
+    }
+    pending = connection->first != NO_BUFFER || (uring.waiting && has_unreaped_completion(connection));
+    pthread_mutex_unlock(&(uring.lock));
+    return pending;
+}
+
+void rh_uring_detach(rh_UringConnection** connection)
+{
+    rh_UringConnection* c = *connection;
+    if(c == NULL)
+    {
+        return;
+    }
+    *connection = NULL;
+
+    pthread_mutex_lock(&(uring.lock));
+    if(c->armed)
+    {
+        struct io_uring_sqe* sqe;
+        while((sqe = get_sqe()) == NULL)
+        {
+            wait_completions();
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = (uint64_t)(uintptr_t)c;
+        sqe->user_data = 0;
+        push_sqe();
+
+        // The connection can't be freed while the kernel may still complete a reception on it
+        while(true)
+        {
+            if(!uring.waiting)
+            {
+                reap();
+            }
+            if(!c->armed)
+            {
+                break;
+            }
+            wait_completions();
+        }
+    }
+    while(c->first != NO_BUFFER)
+    {
+        uint16_t bid = c->first;
+        c->first = uring.next_buffer[bid];
+        give_back(bid);
+    }
+    pthread_mutex_unlock(&(uring.lock));
+
+    free(c);
+}
+
+#else
+typedef int rh_uring_disabled;  /* ISO C forbids an empty translation unit */
+#endif
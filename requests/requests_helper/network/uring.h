@@ -0,0 +1,99 @@
+#ifndef RH_URING_H
+    #define RH_URING_H
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include <sys/types.h>
+
+    /* Only built when RH_USE_IO_URING is defined, see makefile.py */
+
+    typedef struct _rh_uring_connection rh_UringConnection;
+
+    typedef enum _rh_uring_state {
+        RH_URING_IDLE,  /* nothing was received */
+        RH_URING_READABLE,  /* some data is waiting to be read */
+        RH_URING_CLOSED  /* the peer closed the connection or it failed, and there is nothing left to read */
+    } rh_UringState;
+
+    #ifdef __cplusplus
+    extern "C"{
+    #endif
+
+    /**
+     * @brief Set up the io_uring instance shared by the whole process, the first time it's called.
+     *
+     * @return false if the kernel refuses io_uring or its provided buffer rings.
+     */
+    bool rh_uring_available(void);
+
+
+    /**
+     * @brief Receive the data of a connected socket through the shared io_uring instance.
+     * @brief A multishot reception fills the registered buffers as the data arrives, without a system call per reception.
+     *
+     * @param fd a connected stream socket, in blocking mode.
+     * @return - When it succeeds, it returns a pointer to a connection handler.
+     * @return - When it fails, it returns NULL and the socket can still be used directly.
+     */
+    rh_UringConnection* rh_uring_attach(int fd);
+
+
+    /**
+     * @brief Receive at most `n` bytes, like `recv`. The completions of all the connections are collected by the same system call.
+     *
+     * @param connection the handler returned by `rh_uring_attach`
+     * @param buffer a buffer to fill
+     * @param n the size of the buffer
+     * @return the number of bytes received, 0 at the end of the stream, -1 if it failed.
+     * @return In the non-blocking mode, it returns -1 with `errno` set to `EAGAIN` if nothing was received.
+     */
+    ssize_t rh_uring_recv(rh_UringConnection* connection, char* buffer, size_t n);
+
+
+    /**
+     * @brief Tell, without blocking, if something was received on the connection.
+     *
+     * @param connection the handler returned by `rh_uring_attach`
+     * @return the state of the connection.
+     */
+    rh_UringState rh_uring_state(rh_UringConnection* connection);
+
+
+    /**
+     * @brief Wait until something is received on the connection, or until it's closed, without polling in a loop.
+     * @brief The thread sleeps in io_uring_enter, or on the thread that already waits there, at most `timeout` milliseconds.
+     *
+     * @param connection the handler returned by `rh_uring_attach`
+     * @param timeout the maximum time to wait in milliseconds, like `poll`. 0 returns at once.
+     * @return the state of the connection, RH_URING_IDLE if the timeout expired.
+     */
+    rh_UringState rh_uring_wait(rh_UringConnection* connection, int timeout);
+
+
+    /**
+     * @brief Choose if `rh_uring_recv` waits for the data or returns at once. The socket itself isn't changed.
+     *
+     * @param connection the handler returned by `rh_uring_attach`
+     * @param blocking true for the blocking mode
+     */
+    void rh_uring_set_blocking(rh_UringConnection* connection, bool blocking);
+
+
+    /**
+     * @param connection the handler returned by `rh_uring_attach`
+     * @return true if some data was received but not read yet.
+     */
+    bool rh_uring_has_pending_data(rh_UringConnection* connection);
+
+
+    /**
+     * @brief Stop receiving through io_uring, give back the buffers that were not read, free the connection and set the connection pointer to NULL.
+     * @brief The socket isn't closed.
+     *
+     * @param connection the address of the connection handler.
+     */
+    void rh_uring_detach(rh_UringConnection** connection);
+
+    #ifdef __cplusplus
+    }
+    #endif
+#endif
@@ -1,4 +1,6 @@
 #include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
 #include "requests_helper/parsing/parsing.h"
 #include "requests_helper/strings/strings.h"
 
@@ -51,6 +53,9 @@ rh_ParserTree* rh_parse_urlencoded_form(const char* data)
 bool rh_parse_url(const char* url, rh_UrlSplitted* url_splitted)
 {
     int i = 0;
+    size_t uri_length;
+
+    url_splitted->uri = NULL;
 
     if(rh_startswith(url, "https://"))
     {
@@ -64,6 +69,12 @@ bool rh_parse_url(const char* url, rh_UrlSplitted* url_splitted)
         url_splitted->port = 80;
         url += 7;
     }
+    else if(rh_startswith(url, "http+unix://"))
+    {
+        url_splitted->secured = false;
+        url_splitted->port = RH_UNIX_SOCKET_PORT;
+        url += 12;
+    }
     else
     {
         return false;
@@ -80,6 +91,12 @@ bool rh_parse_url(const char* url, rh_UrlSplitted* url_splitted)
     }
     url_splitted->host[i] = '\0';
 
+    if(*url == ':' && url_splitted->port == RH_UNIX_SOCKET_PORT)
+    {
+        // a unix socket has no port
+        return false;
+    }
+
     // get the port if it is specified
     if(*url == ':')
     {
@@ -111,30 +128,42 @@ bool rh_parse_url(const char* url, rh_UrlSplitted* url_splitted)
     }
 
 
-    // get the relative url from url
-    i = 0;
-    while(i < RH_MAX_URI_LENGTH && *url != '\0' && *url != '#')
+    // get the relative url from url, the fragment is not sent
+    uri_length = strcspn(url, "#");
+    url_splitted->uri = (char*) malloc((uri_length > 0 ? uri_length + 1 : 2) * sizeof(char));
+    if(url_splitted->uri == NULL)
     {
-        url_splitted->uri[i] = *url;
-        i++;
-        url++;
+        return false;
     }
-    if(i == 0)
+    if(uri_length == 0)
     {
         // There is no relative url
-        url_splitted->uri[i] = '/';
-        i++;
+        rh_strcpy(url_splitted->uri, "/");
     }
-    url_splitted->uri[i] = '\0';
-
-    if(*url != '\0' && *url != '#')
+    else
     {
-        return false;
+        memcpy(url_splitted->uri, url, uri_length);
+        url_splitted->uri[uri_length] = '\0';
     }
 
     return true;
 }
 
+void rh_url_free(rh_UrlSplitted* url_splitted)
+{
+    free(url_splitted->uri);
+    url_splitted->uri = NULL;
+}
+
+const char* rh_url_scheme(const rh_UrlSplitted* url_splitted)
+{
+    if(url_splitted->secured)
+    {
+        return "https";
+    }
+    return url_splitted->port == RH_UNIX_SOCKET_PORT ? "http+unix" : "http";
+}
+
 
 /*
 Decode an urlencoded string in SRC to the buffer DEST.
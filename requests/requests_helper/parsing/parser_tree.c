@@ -1,9 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "requests_helper/arena/arena.h"
 #include "requests_helper/strings/strings.h"
 #include "requests_helper/parsing/parser_tree.h"
 
+#define TREE_ARENA_BLOCK_SIZE 4096  /* enough for the headers of most responses */
+
 typedef struct _tree_node {
     char* key;
     char* value;
@@ -12,9 +15,12 @@ typedef struct _tree_node {
 } TreeNode;
 
 struct _rh_parser_tree {
+    rh_Arena* arena;  /* the nodes, the keys and the values are all freed with the tree */
     TreeNode* root;
     char* current_key;
     char* current_value;
+    size_t current_key_length;
+    size_t current_value_length;
 };
 
 
@@ -30,88 +36,62 @@ rh_ParserTree* rh_ptree_init()
         return NULL;
     }
 
+    tree->arena = rh_arena_init(TREE_ARENA_BLOCK_SIZE);
+    if(tree->arena == NULL)
+    {
+        free(tree);
+        return NULL;
+    }
     tree->root = NULL;
     tree->current_key = NULL;
     tree->current_value = NULL;
+    tree->current_key_length = 0;
+    tree->current_value_length = 0;
 
     return tree;
 }
 
 /*
-Allocate the space for the partial_key and concatenate it to the older one.
-It can be called multiple time if the key you want to store is separated in multiples chunks.
-However, because of the realloc, it's quicker if you work with large chunks.
-If it succeeded, it returns true.
-If it fails, it's a memory error, the operation is aborted and the previously allocated key is freed.
+Append at most LENGTH-1 characters of PART to the string STR of length STR_LENGTH, in the arena of TREE.
 */
-bool rh_ptree_update_key(rh_ParserTree* tree, const char* partial_key, size_t partial_key_len)
+static bool append_part(rh_ParserTree* tree, char** str, size_t* str_length, const char* part, size_t length)
 {
-    char* writer;
-    if(tree->current_key == NULL)
-    {
-        // New key
-        tree->current_key = (char*) malloc((partial_key_len + 1) * sizeof(char));
-        writer = tree->current_key;
-    }
-    else
+    size_t part_length = 0;
+    while(part_length + 1 < length && part[part_length] != '\0')
     {
-        size_t len_old_key = strlen(tree->current_key);
-        char* temp = (char*) realloc(tree->current_key, (len_old_key + partial_key_len + 1) * sizeof(char));
-        if(temp == NULL)
-        {
-            free(tree->current_key);
-            tree->current_key = NULL;
-        }
-        tree->current_key = temp;
-        writer = tree->current_key + len_old_key;
+        part_length++;
     }
-    if(tree->current_key == NULL)
+
+    char* temp = rh_arena_strcat(tree->arena, *str, *str_length, part, part_length);
+    if(temp == NULL)
     {
         return false;
     }
-
-    rh_strncpy(writer, partial_key, partial_key_len);
-
+    *str = temp;
+    *str_length += part_length;
     return true;
 }
 
 /*
-Allocate the space for the partial_value and concatenate it to the older one.
+Concatenate the partial_key to the older one.
+It can be called multiple time if the key you want to store is separated in multiples chunks.
+If it succeeded, it returns true.
+If it fails, it's a memory error.
+*/
+bool rh_ptree_update_key(rh_ParserTree* tree, const char* partial_key, size_t partial_key_len)
+{
+    return append_part(tree, &(tree->current_key), &(tree->current_key_length), partial_key, partial_key_len);
+}
+
+/*
+Concatenate the partial_value to the older one.
 It can be called multiple time if the value you want to store is separated in multiples chunks.
-However, because of the realloc, it's quicker if you work with large chunks.
 If it succeeded, it returns true.
-If it fails, it's a memory error, the operation is aborted and the previously allocated value is freed.
+If it fails, it's a memory error.
 */
 bool rh_ptree_update_value(rh_ParserTree* tree, const char* partial_value, size_t partial_value_len)
 {
-    char* writer;
-    if(tree->current_value == NULL)
-    {
-        // New key
-        tree->current_value = (char*) malloc((partial_value_len + 1) * sizeof(char));
-        writer = tree->current_value;
-    }
-    else
-    {
-        size_t len_old_value = strlen(tree->current_value);
-        char* temp = (char*) realloc(tree->current_value, (len_old_value + partial_value_len + 1) * sizeof(char));
-        if(temp == NULL)
-        {
-            free(tree->current_value);
-            tree->current_value = NULL;
-            return false;
-        }
-        tree->current_value = temp;
-        writer = tree->current_value + len_old_value;
-    }
-    if(tree->current_value == NULL)
-    {
-        return false;
-    }
-
-    rh_strncpy(writer, partial_value, partial_value_len);
-
-    return true;
+    return append_part(tree, &(tree->current_value), &(tree->current_value_length), partial_value, partial_value_len);
 }
 
 /*
@@ -121,10 +101,11 @@ You can use this in case you realize while parsing that the current partial key/
 */
 void rh_ptree_abort(rh_ParserTree* tree)
 {
-    free(tree->current_key);
+    // the memory stays in the arena until the tree is freed
     tree->current_key = NULL;
-    free(tree->current_value);
+    tree->current_key_length = 0;
     tree->current_value = NULL;
+    tree->current_value_length = 0;
 }
 
 /*
@@ -136,7 +117,7 @@ For example, you can decode a base64 or an urlencoded string at this moment.
 */
 bool rh_ptree_push(rh_ParserTree* tree, void (*data_modifications)(char*))
 {
-    TreeNode* node = (TreeNode*) malloc(sizeof(TreeNode));
+    TreeNode* node = (TreeNode*) rh_arena_alloc(tree->arena, sizeof(TreeNode));
     if(node == NULL)
         return false;
     node->key = tree->current_key;
@@ -148,8 +129,7 @@ bool rh_ptree_push(rh_ParserTree* tree, void (*data_modifications)(char*))
     node->left_child = NULL;
     node->right_child = NULL;
 
-    tree->current_key = NULL;
-    tree->current_value = NULL;
+    rh_ptree_abort(tree);
 
     if(tree->root == NULL)
     {
@@ -165,10 +145,7 @@ bool rh_ptree_push(rh_ParserTree* tree, void (*data_modifications)(char*))
         if(cmp == 0)
         {
             // The key already exists, just replace the value
-            free(root->value);
             root->value = node->value;
-            free(node->key);
-            free(node);
             return true;
         }
         if(cmp < 0)
@@ -220,22 +197,6 @@ const char* rh_ptree_get_value(rh_ParserTree* tree, const char* key)
     return NULL;
 }
 
-static void _ptree_free(TreeNode* root)
-{
-    if(root == NULL)
-        return;
-
-    if(root->left_child != NULL)
-        _ptree_free(root->left_child);
-    if(root->right_child != NULL)
-        _ptree_free(root->right_child);
-
-    free(root->key);
-    free(root->value);
-
-    free(root);
-}
-
 /*
 Take the address of the tree handler.
 Free the tree and set the tree handler to NULL.
@@ -244,14 +205,37 @@ void rh_ptree_free(rh_ParserTree** tree)
 {
     if(*tree != NULL)
     {
-        _ptree_free((*tree)->root);
-        free((*tree)->current_key);
-        free((*tree)->current_value);
+        rh_arena_free(&((*tree)->arena));
         free(*tree);
         *tree = NULL;
     }
 }
 
+static bool _ptree_foreach(TreeNode* root, bool (*callback)(const char* key, const char* value, void* user_data), void* user_data)
+{
+    if(root == NULL)
+        return true;
+
+    if(!_ptree_foreach(root->left_child, callback, user_data))
+        return false;
+    if(root->key != NULL && !(*callback)(root->key, root->value == NULL ? "" : root->value, user_data))
+        return false;
+    return _ptree_foreach(root->right_child, callback, user_data);
+}
+
+/*
+Call CALLBACK on each key/value couple of the tree, in alphabetical order of the keys.
+If CALLBACK returns false, the iteration stops and it returns false.
+*/
+bool rh_ptree_foreach(rh_ParserTree* tree, bool (*callback)(const char* key, const char* value, void* user_data), void* user_data)
+{
+    if(tree == NULL)
+    {
+        return true;
+    }
+    return _ptree_foreach(tree->root, callback, user_data);
+}
+
 static void _ptree_display(TreeNode* root)
 {
     if(root->left_child != NULL)
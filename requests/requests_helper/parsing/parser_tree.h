@@ -19,29 +19,27 @@
 
 
     /**
-     * @brief Allocate the space for the partial_key and concatenate it to the older one.  
-     * @brief It can be called multiple time if the key you want to store is separated in multiples chunks.  
-     * @brief However, because of the realloc, it's quicker if you work with large chunks.
+     * @brief Concatenate the partial_key to the older one, in the memory of the tree.  
+     * @brief It can be called multiple time if the key you want to store is separated in multiples chunks, the key grows in place most of the time.
      * 
      * @param tree The handler returned by `rh_ptree_init`
      * @param partial_key a string that is the part of the key you are actually parsing
      * @param partial_key_len the strlen of the key (can be used to limit the size of the buffer)
      * @return - When it succeeds, it returns true.
-     * @return - When it fails, it's a memory error, the operation is aborted and the previously allocated key is freed.
+     * @return - When it fails, it's a memory error.
      */
     bool rh_ptree_update_key(rh_ParserTree* tree, const char* partial_key, size_t partial_key_len);
 
 
     /**
-     * @brief Allocate the space for the partial_value and concatenate it to the older one.  
-     * @brief It can be called multiple time if the value you want to store is separated in multiples chunks.  
-     * @brief However, because of the realloc, it's quicker if you work with large chunks.
+     * @brief Concatenate the partial_value to the older one, in the memory of the tree.  
+     * @brief It can be called multiple time if the value you want to store is separated in multiples chunks, the value grows in place most of the time.
      * 
      * @param tree The handler returned by `rh_ptree_init`
      * @param partial_value a string that is the part of the value you are actually parsing
      * @param partial_value_len the strlen of the value (can be used to limit the size of the buffer)
      * @return - When it succeeds, it returns true.
-     * @return - When it fails, it's a memory error, the operation is aborted and the previously allocated value is freed.
+     * @return - When it fails, it's a memory error.
      */
     bool rh_ptree_update_value(rh_ParserTree* tree, const char* partial_value, size_t partial_value_len);
 
@@ -87,6 +85,19 @@
     void rh_ptree_abort(rh_ParserTree* tree);
 
 
+    /**
+     * @brief Call `callback` on each key/value couple of the tree, in alphabetical order of the keys.  
+     * @brief The strings given to `callback` are owned by the tree, they must not be modified or used after the tree is freed.  
+     * @brief If `callback` returns false, the iteration stops.
+     * 
+     * @param tree The handler returned by `rh_ptree_init`
+     * @param callback the function to call on each couple
+     * @param user_data passed as is to `callback`
+     * @return false if the iteration was stopped by `callback`, true otherwise.
+     */
+    bool rh_ptree_foreach(rh_ParserTree* tree, bool (*callback)(const char* key, const char* value, void* user_data), void* user_data);
+
+
     /**
      * @brief Display the tree.  
      * Used for debug purpose.
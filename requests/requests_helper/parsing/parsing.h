@@ -5,13 +5,13 @@
     #include "requests_helper/parsing/parser_tree.h"
 
     #define RH_MAX_CHAR_ON_HOST 253 /* this is exact, don't change */
-    #define RH_MAX_URI_LENGTH 1024  /* this can be changed, it's the maximum length a url can have */
+    #define RH_UNIX_SOCKET_PORT 0  /* the port of the http+unix urls, whose host is the urlencoded path of a unix socket */
 
     typedef struct _rh_url_splitted
     {
         char host[RH_MAX_CHAR_ON_HOST + 1];
-        char uri[RH_MAX_URI_LENGTH + 1];
-        uint16_t port;
+        char* uri;  /* allocated by rh_parse_url, released by rh_url_free */
+        uint16_t port;  /* RH_UNIX_SOCKET_PORT for a http+unix url */
         bool secured;
     } rh_UrlSplitted;
 
@@ -23,15 +23,32 @@
 
     /**
      * @brief split `url` into host, uri, port and whether or not it's http or https. Fill the structure `url_splitted` with these infos.
+     * @brief The uri has no length limit, it's allocated with the size it needs and it must be released with `rh_url_free`.
+     * @brief A `http+unix://%2Fpath%2Fto%2Fsocket/uri` url targets a unix socket: its host is the urlencoded path and its port is `RH_UNIX_SOCKET_PORT`.
      *
      * @param url The url to split
      * @param url_splitted A pointer to rh_UrlSplitted structure that will be filled with the url components.
      * @return - When it succeeds, it returns true
-     * @return - When it fails, it returns false and `rh_print_last_error()` can tell what happened.
+     * @return - When it fails, it returns false, `url_splitted->uri` is NULL and `rh_print_last_error()` can tell what happened.
      */
     bool rh_parse_url(const char *url, rh_UrlSplitted *url_splitted);
 
 
+    /**
+     * @brief Release the uri of a structure filled by `rh_parse_url` and set it to NULL. It can be called more than once.
+     *
+     * @param url_splitted the structure given to `rh_parse_url`
+     */
+    void rh_url_free(rh_UrlSplitted *url_splitted);
+
+
+    /**
+     * @param url_splitted a structure filled by `rh_parse_url`
+     * @return the scheme of the url, without "://": "http", "https" or "http+unix".
+     */
+    const char* rh_url_scheme(const rh_UrlSplitted *url_splitted);
+
+
     /**
      * @brief This is used in combination of `rh_parser_search_occurrence_in_bytes_stream`. Call this to specify that you are searching in new stream.
      *
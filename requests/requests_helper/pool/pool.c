@@ -0,0 +1,282 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "requests_helper/pool/pool.h"
+#include "requests_helper/strings/strings.h"
+
+typedef struct _origin_bucket {
+    char* origin;
+    void** connections;
+    size_t nb_connections;
+    struct _origin_bucket* next;
+} OriginBucket;
+
+typedef struct _pool_shard {
+    pthread_mutex_t lock;
+    OriginBucket* buckets;
+} PoolShard;
+
+struct _rh_connection_pool {
+    PoolShard shards[RH_POOL_SHARDS];
+    size_t max_idle_per_origin;
+    void (*destroy_connection)(void*);
+    bool (*is_expired)(void*);
+};
+
+
+/*
+FNV-1a hash of the origin, used to select the shard.
+*/
+static uint32_t hash_origin(const char* origin)
+{
+    uint32_t hash = 2166136261u;
+    while(*origin != '\0')
+    {
+        hash ^= (uint8_t)(*origin);
+        hash *= 16777619u;
+        origin++;
+    }
+    return hash;
+}
+
+static inline PoolShard* get_shard(rh_ConnectionPool* pool, const char* origin)
+{
+    return &(pool->shards[hash_origin(origin) & (RH_POOL_SHARDS - 1)]);
+}
+
+/*
+Returns the bucket of ORIGIN in SHARD, or NULL if there is none.
+The shard must be locked.
+*/
+static OriginBucket* find_bucket(PoolShard* shard, const char* origin)
+{
+    OriginBucket* bucket = shard->buckets;
+    while(bucket != NULL && strcmp(bucket->origin, origin) != 0)
+    {
+        bucket = bucket->next;
+    }
+    return bucket;
+}
+
+/*
+Create a new thread-safe pool of idle connections.
+If it fails, it returns NULL.
+*/
+rh_ConnectionPool* rh_pool_init(size_t max_idle_per_origin, void (*destroy_connection)(void*), bool (*is_expired)(void*))
+{
+    size_t i;
+    rh_ConnectionPool* pool = (rh_ConnectionPool*) malloc(sizeof(rh_ConnectionPool));
+    if(pool == NULL)
+    {
+        return NULL;
+    }
+
+    for(i = 0; i < RH_POOL_SHARDS; i++)
+    {
+        if(pthread_mutex_init(&(pool->shards[i].lock), NULL) != 0)
+        {
+            while(i > 0)
+            {
+                i--;
+                pthread_mutex_destroy(&(pool->shards[i].lock));
+            }
+            free(pool);
+            return NULL;
+        }
+        pool->shards[i].buckets = NULL;
+    }
+
+    pool->max_idle_per_origin = max_idle_per_origin;
+    pool->destroy_connection = destroy_connection;
+    pool->is_expired = is_expired;
+
+    return pool;
+}
+
+/*
+Remove the oldest connection of BUCKET if it has expired, so the dead connections don't pile up at the bottom of the stack.
+Returns the removed connection, that must be destroyed once the shard is unlocked, or NULL.
+The shard must be locked.
+*/
+static void* remove_expired(rh_ConnectionPool* pool, OriginBucket* bucket)
+{
+    void* oldest;
+    if(pool->is_expired == NULL || bucket->nb_connections == 0 || !(*pool->is_expired)(bucket->connections[0]))
+    {
+        return NULL;
+    }
+    oldest = bucket->connections[0];
+    bucket->nb_connections--;
+    memmove(bucket->connections, bucket->connections + 1, bucket->nb_connections * sizeof(void*));
+    return oldest;
+}
+
+/*
+Give an idle connection to the pool.
+If the pool is full for this origin or if there is a memory error, the connection is destroyed and it returns false.
+*/
+bool rh_pool_put(rh_ConnectionPool* pool, const char* origin, void* connection)
+{
+    PoolShard* shard = get_shard(pool, origin);
+    OriginBucket* bucket;
+    void* expired = NULL;
+
+    pthread_mutex_lock(&(shard->lock));
+
+    bucket = find_bucket(shard, origin);
+    if(bucket == NULL)
+    {
+        size_t origin_size = strlen(origin) + 1;
+        bucket = (OriginBucket*) malloc(sizeof(OriginBucket));
+        if(bucket == NULL)
+        {
+            goto ERROR;
+        }
+        bucket->origin = (char*) malloc(origin_size * sizeof(char));
+        bucket->connections = (void**) malloc(pool->max_idle_per_origin * sizeof(void*));
+        if(bucket->origin == NULL || bucket->connections == NULL)
+        {
+            free(bucket->origin);
+            free(bucket->connections);
+            free(bucket);
+            goto ERROR;
+        }
+        rh_strncpy(bucket->origin, origin, origin_size);
+        bucket->nb_connections = 0;
+        bucket->next = shard->buckets;
+        shard->buckets = bucket;
+    }
+
+    expired = remove_expired(pool, bucket);
+
+    if(bucket->nb_connections >= pool->max_idle_per_origin)
+    {
+        goto ERROR;
+    }
+
+    bucket->connections[bucket->nb_connections] = connection;
+    bucket->nb_connections++;
+
+    pthread_mutex_unlock(&(shard->lock));
+    if(expired != NULL)
+    {
+        (*pool->destroy_connection)(expired);
+    }
+    return true;
+
+ERROR:
+    pthread_mutex_unlock(&(shard->lock));
+    (*pool->destroy_connection)(connection);
+    if(expired != NULL)
+    {
+        (*pool->destroy_connection)(expired);
+    }
+    return false;
+}
+
+/*
+Take the most recently released connection for ORIGIN.
+If there is none, it returns NULL.
+*/
+void* rh_pool_take(rh_ConnectionPool* pool, const char* origin)
+{
+    PoolShard* shard = get_shard(pool, origin);
+    OriginBucket* bucket;
+    void* connection = NULL;
+
+    pthread_mutex_lock(&(shard->lock));
+
+    bucket = find_bucket(shard, origin);
+    if(bucket != NULL && bucket->nb_connections > 0)
+    {
+        bucket->nb_connections--;
+        connection = bucket->connections[bucket->nb_connections];
+    }
+
+    pthread_mutex_unlock(&(shard->lock));
+
+    return connection;
+}
+
+/*
+Destroy the idle connections of ORIGIN for which IS_USABLE returns false, and return the number of the others.
+The connections are destroyed once the shard is unlocked. If there is a memory error, they are only counted.
+*/
+size_t rh_pool_prune(rh_ConnectionPool* pool, const char* origin, bool (*is_usable)(void*))
+{
+    PoolShard* shard = get_shard(pool, origin);
+    OriginBucket* bucket;
+    void** removed = NULL;
+    size_t nb_removed = 0;
+    size_t nb_kept = 0;
+
+    pthread_mutex_lock(&(shard->lock));
+
+    bucket = find_bucket(shard, origin);
+    if(bucket != NULL && bucket->nb_connections > 0)
+    {
+        removed = (void**) malloc(bucket->nb_connections * sizeof(void*));
+        if(removed == NULL)
+        {
+            nb_kept = bucket->nb_connections;
+        }
+        else
+        {
+            for(size_t i = 0; i < bucket->nb_connections; i++)
+            {
+                if((*is_usable)(bucket->connections[i]))
+                {
+                    bucket->connections[nb_kept] = bucket->connections[i];  // the order, oldest first, is kept
+                    nb_kept++;
+                }
+                else
+                {
+                    removed[nb_removed] = bucket->connections[i];
+                    nb_removed++;
+                }
+            }
+            bucket->nb_connections = nb_kept;
+        }
+    }
+
+    pthread_mutex_unlock(&(shard->lock));
+
+    for(size_t i = 0; i < nb_removed; i++)
+    {
+        (*pool->destroy_connection)(removed[i]);
+    }
+    free(removed);
+    return nb_kept;
+}
+
+/*
+Destroy all the idle connections, free the pool and set the pool handler to NULL.
+*/
+void rh_pool_free(rh_ConnectionPool** pool)
+{
+    if(*pool == NULL)
+    {
+        return;
+    }
+    for(size_t i = 0; i < RH_POOL_SHARDS; i++)
+    {
+        PoolShard* shard = &((*pool)->shards[i]);
+        OriginBucket* bucket = shard->buckets;
+        while(bucket != NULL)
+        {
+            OriginBucket* next = bucket->next;
+            for(size_t j = 0; j < bucket->nb_connections; j++)
+            {
+                (*(*pool)->destroy_connection)(bucket->connections[j]);
+            }
+            free(bucket->connections);
+            free(bucket->origin);
+            free(bucket);
+            bucket = next;
+        }
+        pthread_mutex_destroy(&(shard->lock));
+    }
+    free(*pool);
+    *pool = NULL;
+}
@@ -0,0 +1,76 @@
+#ifndef RH_POOL_H
+    #define RH_POOL_H
+    #include <stdbool.h>
+    #include <stddef.h>
+
+    #define RH_POOL_SHARDS 16  /* must be a power of 2 */
+
+    typedef struct _rh_connection_pool rh_ConnectionPool;
+
+    #ifdef __cplusplus
+    extern "C"{
+    #endif
+
+    /**
+     * @brief Create a new thread-safe pool of idle connections.
+     * @brief Connections are stored by origin (for example `"https://example.com:443"`) in shards selected by the hash of the origin,
+     * @brief so threads working on different origins rarely wait on the same lock.
+     *
+     * @param max_idle_per_origin the maximum number of idle connections kept for a single origin.
+     * @param destroy_connection a function used to release a connection that the pool can't keep anymore.
+     * @param is_expired a cheap function telling if an idle connection can't be used anymore, the oldest expired connections are destroyed when new ones are released. It can be NULL.
+     * @return - When it succeeds, it returns a pointer to a pool handler.
+     * @return - When it fails, it returns NULL.
+     */
+    rh_ConnectionPool* rh_pool_init(size_t max_idle_per_origin, void (*destroy_connection)(void*), bool (*is_expired)(void*));
+
+
+    /**
+     * @brief Give an idle connection to the pool.
+     * @brief Once this function is called, the caller doesn't own the connection anymore and must not use it.
+     *
+     * @param pool the handler returned by `rh_pool_init`
+     * @param origin the origin of the connection
+     * @param connection the connection to store
+     * @return - true if the connection was stored.
+     * @return - false if the pool was full or if there was a memory error, in this case, the connection is destroyed with the `destroy_connection` function.
+     */
+    bool rh_pool_put(rh_ConnectionPool* pool, const char* origin, void* connection);
+
+
+    /**
+     * @brief Take an idle connection from the pool.
+     * @brief The most recently released connection is returned first, because it's the most likely to still be alive.
+     * @brief The connection is removed from the pool, so no other thread can get it until it's released again.
+     *
+     * @param pool the handler returned by `rh_pool_init`
+     * @param origin the origin of the wanted connection
+     * @return - a connection if there was one for this origin.
+     * @return - NULL otherwise.
+     */
+    void* rh_pool_take(rh_ConnectionPool* pool, const char* origin);
+
+
+    /**
+     * @brief Destroy the idle connections of an origin that can't be used anymore, and count the others.
+     *
+     * @param pool the handler returned by `rh_pool_init`
+     * @param origin the origin of the connections
+     * @param is_usable a function telling if an idle connection can still be used. It's called while the origin is locked, so it must not block.
+     * @return the number of idle connections left for this origin.
+     */
+    size_t rh_pool_prune(rh_ConnectionPool* pool, const char* origin, bool (*is_usable)(void*));
+
+
+    /**
+     * @brief Destroy all the idle connections stored in the pool, free the pool and set the pool handler to NULL.
+     * @brief The connections that are currently taken are not affected.
+     *
+     * @param pool the address of the pool handler.
+     */
+    void rh_pool_free(rh_ConnectionPool** pool);
+
+    #ifdef __cplusplus
+    }
+    #endif
+#endif
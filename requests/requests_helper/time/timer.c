@@ -1,5 +1,9 @@
 #include <time.h>
 #include <unistd.h>
+
+#ifdef WIN32
+    #include <windows.h>
+#endif
 #include "requests_helper/time/timer.h"
 
 
@@ -10,4 +14,20 @@ rh_nanoseconds rh_timer_now(void)
     clock_gettime(CLOCK_MONOTONIC, &timer);
 
     return (uint64_t)timer.tv_sec * 1000 * 1000 * 1000 + (uint64_t)timer.tv_nsec;
-}
\ No newline at end of file
+}
+
+void rh_timer_sleep_ms(rh_milliseconds duration)
+{
+    #ifdef WIN32
+    Sleep((DWORD)duration);
+    #else
+    struct timespec remaining = {
+        .tv_sec = (time_t)(duration / 1000),
+        .tv_nsec = (long)(duration % 1000) * 1000 * 1000
+    };
+    while(nanosleep(&remaining, &remaining) != 0)
+    {
+        ;  // interrupted by a signal
+    }
+    #endif
+}
@@ -12,6 +12,8 @@ typedef uint64_t rh_seconds;
 
 rh_nanoseconds rh_timer_now(void);
 
+void rh_timer_sleep_ms(rh_milliseconds duration);
+
 
 static inline rh_nanoseconds rh_timer_elapsed_ns(rh_nanoseconds start)
 {
@@ -0,0 +1,425 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "requests.h"
+#include "requests_helper/pool/pool.h"
+#include "loopback_server.h"
+
+/*
+Hammer a single connection pool from many threads against the loopback server of tools/, and check that
+no connection is ever handed out twice, used after it was destroyed, or leaked.
+The first part drives rh_pool_take/rh_pool_put/rh_pool_prune directly with connections that track their owner, the second
+one shares a RequestsPool between threads doing requests while req_pool_prewarm prunes and refills it in the background.
+Build it with -fsanitize=thread or -fsanitize=address to also catch the races and the memory errors.
+Usage: ./pool_stress [number of requests per thread]
+*/
+
+#define NB_THREADS 32
+#define NB_ORIGINS 4
+#define REQUESTS_PER_CONNECTION 16  /* the server closes each connection after this many responses */
+#define MAX_SERVER_CONNECTIONS 65536
+#define PRUNE_INTERVAL 8
+
+#define STATE_IDLE 0
+#define STATE_TAKEN 1
+#define STATE_DESTROYED 2
+
+typedef struct _tracked_connection {
+    int fd;
+    int state;  /* read and written with __atomic, a connection is never freed before the end, so a stale pointer can be detected */
+    long server_id;
+    struct _tracked_connection* next;
+} TrackedConnection;
+
+static uint16_t server_port = 0;
+static unsigned long next_server_id = 0;
+static long last_count[MAX_SERVER_CONNECTIONS];
+static size_t nb_errors = 0;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static TrackedConnection* registry = NULL;
+
+static __thread uint64_t random_state = 0;
+
+
+static void report(const char* error)
+{
+    if(__atomic_fetch_add(&nb_errors, 1, __ATOMIC_RELAXED) < 20)
+    {
+        fprintf(stderr, "error: %s\n", error);
+    }
+}
+
+static uint64_t next_random(void)
+{
+    if(random_state == 0)
+    {
+        random_state = (uint64_t)(uintptr_t)&random_state | 1;
+    }
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+/*
+Serve the requests of CONNECTION: each response echoes the path of the request with the id of the connection
+and the number of responses already sent on it, so the client can tell if it got the response of another request.
+*/
+static void serve(LoopbackConnection* connection)
+{
+    long id = (long)__atomic_fetch_add(&next_server_id, 1, __ATOMIC_RELAXED);
+
+    for(long count = 0; count < REQUESTS_PER_CONNECTION; count++)
+    {
+        char path[200];
+        char body[256];
+        char response[512];
+        bool last = count == REQUESTS_PER_CONNECTION - 1;
+
+        if(!loopback_read_request(connection, path, sizeof(path)))
+        {
+            return;
+        }
+        snprintf(body, sizeof(body), "%ld %ld %s", id, count, path);
+        snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n%s\r\n%s", strlen(body), last ? "Connection: close\r\n" : "", body);
+        if(!loopback_send_all(connection->fd, response, strlen(response)))
+        {
+            return;
+        }
+    }
+}
+
+/*
+Check a response body "ID COUNT PATH" against the path that was requested, and that the responses of connection ID arrive in order.
+*/
+static bool check_body(const char* body, const char* path, long* id)
+{
+    long count;
+    int path_offset = 0;
+
+    if(sscanf(body, "%ld %ld %n", id, &count, &path_offset) != 2 || path_offset == 0 || *id < 0 || *id >= MAX_SERVER_CONNECTIONS)
+    {
+        report("malformed response");
+        return false;
+    }
+    if(strcmp(body + path_offset, path) != 0)
+    {
+        report("got the response of another request, a connection was used by two requests at the same time");
+        return false;
+    }
+    if(__atomic_exchange_n(&last_count[*id], count, __ATOMIC_RELAXED) != count - 1)
+    {
+        report("the responses of a connection arrived out of order");
+        return false;
+    }
+    return true;
+}
+
+
+/*
+Part 1: the pool of requests_helper with connections that know if they are owned.
+*/
+
+static void destroy_connection(void* connection)
+{
+    TrackedConnection* tracked = (TrackedConnection*)connection;
+    int expected = STATE_IDLE;
+    if(!__atomic_compare_exchange_n(&(tracked->state), &expected, STATE_DESTROYED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        report(expected == STATE_TAKEN ? "the pool destroyed a connection in use" : "the pool destroyed a connection twice");
+        return;
+    }
+    close(tracked->fd);
+    tracked->fd = -1;
+}
+
+/*
+The pool only calls it on its idle connections, they never expire.
+*/
+static bool never_expired(void* connection)
+{
+    if(__atomic_load_n(&(((TrackedConnection*)connection)->state), __ATOMIC_ACQUIRE) != STATE_IDLE)
+    {
+        report("the pool holds a connection that is in use or destroyed");
+    }
+    return false;
+}
+
+/*
+Drop a quarter of the idle connections, so the prunes run at the same time as the takes and the puts.
+*/
+static bool sometimes_usable(void* connection)
+{
+    never_expired(connection);
+    return next_random() % 4 != 0;
+}
+
+static TrackedConnection* open_connection(void)
+{
+    struct sockaddr_in address = {0};
+    TrackedConnection* tracked = (TrackedConnection*) calloc(1, sizeof(TrackedConnection));
+    if(tracked == NULL)
+    {
+        return NULL;
+    }
+    tracked->fd = socket(AF_INET, SOCK_STREAM, 0);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(server_port);
+    if(tracked->fd < 0 || connect(tracked->fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        if(tracked->fd >= 0)
+        {
+            close(tracked->fd);
+        }
+        free(tracked);
+        return NULL;
+    }
+    tracked->state = STATE_TAKEN;
+    tracked->server_id = -1;
+
+    pthread_mutex_lock(&registry_lock);
+    tracked->next = registry;
+    registry = tracked;
+    pthread_mutex_unlock(&registry_lock);
+    return tracked;
+}
+
+/*
+Send a request for PATH on TRACKED and check its response. CLOSED is set to true if the server closes the connection after it.
+*/
+static bool round_trip(TrackedConnection* tracked, const char* path, bool* closed)
+{
+    char buffer[1024];
+    size_t length = 0;
+    char* end;
+    char* field;
+    size_t content_length = 0;
+    long id;
+
+    snprintf(buffer, sizeof(buffer), "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", path);
+    if(!loopback_send_all(tracked->fd, buffer, strlen(buffer)))
+    {
+        report("send failed on a pooled connection");
+        return false;
+    }
+
+    buffer[0] = '\0';
+    while((end = strstr(buffer, "\r\n\r\n")) == NULL || (field = strstr(buffer, "Content-Length: ")) == NULL
+        || length < (size_t)(end + 4 - buffer) + (content_length = strtoul(field + sizeof("Content-Length: ") - 1, NULL, 10)))
+    {
+        ssize_t received = recv(tracked->fd, buffer + length, sizeof(buffer) - 1 - length, 0);
+        if(received <= 0)
+        {
+            report("a pooled connection was closed before its response");
+            return false;
+        }
+        length += (size_t)received;
+        buffer[length] = '\0';
+    }
+    *closed = strstr(buffer, "Connection: close") != NULL;
+
+    if(!check_body(end + 4, path, &id))
+    {
+        return false;
+    }
+    if(tracked->server_id != -1 && tracked->server_id != id)
+    {
+        report("a connection answered with the id of another one");
+        return false;
+    }
+    tracked->server_id = id;
+    return true;
+}
+
+typedef struct _worker_args {
+    rh_ConnectionPool* pool;
+    RequestsConfig* config;
+    size_t nb_requests;
+    size_t index;
+} WorkerArgs;
+
+static void* pool_worker(void* arg)
+{
+    WorkerArgs* args = (WorkerArgs*)arg;
+    char origin[32];
+    char path[64];
+
+    for(size_t i = 0; i < args->nb_requests; i++)
+    {
+        TrackedConnection* tracked;
+        bool closed = false;
+
+        snprintf(origin, sizeof(origin), "origin-%u", (unsigned int)(next_random() % NB_ORIGINS));
+        snprintf(path, sizeof(path), "/pool/%zu/%zu", args->index, i);
+
+        tracked = (TrackedConnection*)rh_pool_take(args->pool, origin);
+        if(tracked != NULL)
+        {
+            int expected = STATE_IDLE;
+            if(!__atomic_compare_exchange_n(&(tracked->state), &expected, STATE_TAKEN, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                report(expected == STATE_TAKEN ? "a connection was handed out twice" : "a destroyed connection was handed out");
+                continue;
+            }
+        }
+        else if((tracked = open_connection()) == NULL)
+        {
+            report("can't connect to the server");
+            continue;
+        }
+
+        if(!round_trip(tracked, path, &closed) || closed)
+        {
+            __atomic_store_n(&(tracked->state), STATE_IDLE, __ATOMIC_RELEASE);
+            destroy_connection(tracked);
+        }
+        else
+        {
+            __atomic_store_n(&(tracked->state), STATE_IDLE, __ATOMIC_RELEASE);
+            rh_pool_put(args->pool, origin, tracked);  // tracked isn't ours anymore
+        }
+
+        if(i % PRUNE_INTERVAL == 0)
+        {
+            rh_pool_prune(args->pool, origin, sometimes_usable);
+        }
+    }
+    return NULL;
+}
+
+
+/*
+Part 2: the public functions, with a pool shared through the config and refilled by req_pool_prewarm.
+*/
+
+static void* request_worker(void* arg)
+{
+    WorkerArgs* args = (WorkerArgs*)arg;
+    char url[96];
+    char path[64];
+    char body[256];
+
+    for(size_t i = 0; i < args->nb_requests; i++)
+    {
+        RequestsHandler* handler;
+        size_t length = 0;
+        size_t n;
+        long id;
+
+        snprintf(path, sizeof(path), "/public/%zu/%zu", args->index, i);
+        snprintf(url, sizeof(url), "http://127.0.0.1:%u%s", server_port, path);
+        handler = req_get(args->config, NULL, url, "");
+        if(handler == NULL)
+        {
+            report("a request failed");
+            continue;
+        }
+        while(length < sizeof(body) - 1 && (n = req_read_output_body(handler, body + length, sizeof(body) - 1 - length)) > 0)
+        {
+            length += n;
+        }
+        body[length] = '\0';
+        if(req_get_status_code(handler) != 200)
+        {
+            report("unexpected status code");
+        }
+        else
+        {
+            check_body(body, path, &id);
+        }
+        req_close_connection(&handler);  // the connection goes back into the pool
+    }
+    return NULL;
+}
+
+static bool run_threads(void* (*worker)(void*), rh_ConnectionPool* pool, RequestsConfig* config, size_t nb_requests)
+{
+    pthread_t threads[NB_THREADS];
+    WorkerArgs args[NB_THREADS];
+    size_t nb_threads;
+
+    for(nb_threads = 0; nb_threads < NB_THREADS; nb_threads++)
+    {
+        args[nb_threads].pool = pool;
+        args[nb_threads].config = config;
+        args[nb_threads].nb_requests = nb_requests;
+        args[nb_threads].index = nb_threads;
+        if(pthread_create(&(threads[nb_threads]), NULL, worker, &(args[nb_threads])) != 0)
+        {
+            break;
+        }
+    }
+    for(size_t i = 0; i < nb_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    return nb_threads == NB_THREADS;
+}
+
+int main(int argc, char** argv)
+{
+    size_t nb_requests = argc > 1 ? strtoul(argv[1], NULL, 10) : 500;
+    rh_ConnectionPool* pool;
+    RequestsPool* requests_pool;
+    RequestsConfig* config;
+    size_t nb_connections = 0;
+    char origin[64];
+    const char* const origins[1] = {origin};
+
+    for(size_t i = 0; i < MAX_SERVER_CONNECTIONS; i++)
+    {
+        last_count[i] = -1;
+    }
+    server_port = loopback_server_start(serve);
+    if(nb_requests == 0 || server_port == 0)
+    {
+        fprintf(stderr, "usage: %s [number of requests per thread]\n", argv[0]);
+        return 1;
+    }
+
+    pool = rh_pool_init(8, destroy_connection, never_expired);
+    if(pool == NULL || !run_threads(pool_worker, pool, NULL, nb_requests))
+    {
+        fprintf(stderr, "can't start the pool test\n");
+        return 1;
+    }
+    rh_pool_free(&pool);
+    while(registry != NULL)
+    {
+        TrackedConnection* next = registry->next;
+        if(registry->state != STATE_DESTROYED)
+        {
+            report("a connection was leaked by the pool");
+        }
+        nb_connections++;
+        free(registry);
+        registry = next;
+    }
+    printf("rh_pool: %d threads x %zu requests on %zu connections, %zu errors\n", NB_THREADS, nb_requests, nb_connections, nb_errors);
+
+    req_init();
+    config = req_config_default();
+    requests_pool = req_pool_init(8);
+    snprintf(origin, sizeof(origin), "http://127.0.0.1:%u", server_port);
+    if(config == NULL || requests_pool == NULL || !req_config_set_pool(config, requests_pool)
+        || !req_pool_prewarm(requests_pool, config, origins, 1, 4) || !run_threads(request_worker, NULL, config, nb_requests))
+    {
+        fprintf(stderr, "can't start the requests test\n");
+        return 1;
+    }
+    req_pool_free(&requests_pool);
+    req_config_free(&config);
+    req_destroy();
+    printf("RequestsPool: %d threads x %zu requests, %zu errors in total\n", NB_THREADS, nb_requests, nb_errors);
+
+    return nb_errors == 0 ? 0 : 1;
+}
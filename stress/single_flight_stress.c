@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "requests.h"
+#include "loopback_server.h"
+
+/*
+Send identical and overlapping requests for one url from many threads through a single-flight group, against the loopback
+server of tools/, and check that each request gets its own response: the ranges of a file are never merged, a shared body is
+complete, and a request whose shared response is too long to come is sent on its own.
+Build it with -fsanitize=thread or -fsanitize=address to also catch the races and the memory errors.
+Usage: ./single_flight_stress [number of rounds]
+*/
+
+#define NB_THREADS 32
+#define FILE_SIZE (NB_THREADS * 4096)
+#define RESPONSE_DELAY_US 20000  /* each response of the server waits this long, so the identical requests overlap */
+#define SLOW_DELAY_US 1000000
+#define MAX_WAIT_TIME 100  /* milliseconds, for the group used against the slow path */
+
+static uint16_t server_port = 0;
+static char file_content[FILE_SIZE];
+static size_t nb_file_requests = 0;
+static size_t nb_slow_requests = 0;
+static size_t nb_errors = 0;
+
+static pthread_barrier_t start_barrier;
+
+
+static void report(const char* error)
+{
+    if(__atomic_fetch_add(&nb_errors, 1, __ATOMIC_RELAXED) < 20)
+    {
+        fprintf(stderr, "error: %s\n", error);
+    }
+}
+
+/*
+Serve the requests of CONNECTION: "/file" is a file of FILE_SIZE bytes that supports the ranges, "/slow" answers after a second.
+*/
+static void serve(LoopbackConnection* connection)
+{
+    char path[200];
+    char headers[256];
+
+    while(loopback_read_request(connection, path, sizeof(path)))
+    {
+        size_t start = 0;
+        size_t end = FILE_SIZE - 1;
+        const char* body = file_content;
+        size_t length;
+
+        if(strcmp(path, "/slow") == 0)
+        {
+            __atomic_fetch_add(&nb_slow_requests, 1, __ATOMIC_RELAXED);
+            usleep(SLOW_DELAY_US);
+            body = "slow";
+            length = 4;
+            snprintf(headers, sizeof(headers), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n", length);
+        }
+        else if(connection->range[0] != '\0')
+        {
+            if(sscanf(connection->range, "bytes=%zu-%zu", &start, &end) < 1 || end >= FILE_SIZE)
+            {
+                end = FILE_SIZE - 1;
+            }
+            if(start > end)
+            {
+                return;
+            }
+            body += start;
+            length = end - start + 1;
+            snprintf(headers, sizeof(headers), "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %zu-%zu/%d\r\nContent-Length: %zu\r\n\r\n",
+                start, end, FILE_SIZE, length);
+        }
+        else
+        {
+            length = FILE_SIZE;
+            snprintf(headers, sizeof(headers), "HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\nContent-Length: %zu\r\n\r\n", length);
+        }
+
+        if(!connection->head && strcmp(path, "/slow") != 0)
+        {
+            __atomic_fetch_add(&nb_file_requests, 1, __ATOMIC_RELAXED);
+            usleep(RESPONSE_DELAY_US);
+        }
+        if(!loopback_send_all(connection->fd, headers, strlen(headers)) || (!connection->head && !loopback_send_all(connection->fd, body, length)))
+        {
+            return;
+        }
+    }
+}
+
+/*
+Read the whole body of HANDLER in BUFFER, and close it.
+Returns the number of bytes read, or (size_t)-1 if the request failed.
+*/
+static size_t read_body(RequestsHandler** handler, char* buffer, size_t buffer_size)
+{
+    size_t length = 0;
+    size_t n;
+
+    if(*handler == NULL)
+    {
+        report("a request failed");
+        return (size_t)-1;
+    }
+    while(length < buffer_size && (n = req_read_output_body(*handler, buffer + length, buffer_size - length)) > 0)
+    {
+        length += n;
+    }
+    req_close_connection(handler);
+    return length;
+}
+
+typedef struct _worker_args {
+    RequestsConfig* config;
+    size_t nb_rounds;
+    size_t index;
+} WorkerArgs;
+
+/*
+Each thread asks for its own range of the same url at the same time as the others.
+*/
+static void* range_worker(void* arg)
+{
+    WorkerArgs* args = (WorkerArgs*)arg;
+    size_t part = FILE_SIZE / NB_THREADS;
+    size_t start = args->index * part;
+    char url[64];
+    char range[64];
+    char* body = (char*) malloc(FILE_SIZE);
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/file", server_port);
+    snprintf(range, sizeof(range), "Range: bytes=%zu-%zu\r\n", start, start + part - 1);
+    for(size_t i = 0; body != NULL && i < args->nb_rounds; i++)
+    {
+        RequestsHandler* handler;
+        unsigned short int status_code;
+        size_t length;
+
+        pthread_barrier_wait(&start_barrier);
+        handler = req_get(args->config, NULL, url, range);
+        status_code = handler != NULL ? req_get_status_code(handler) : 0;
+        length = read_body(&handler, body, FILE_SIZE);
+        if(length == (size_t)-1)
+        {
+            continue;
+        }
+        if(status_code != 206 || length != part || memcmp(body, file_content + start, part) != 0)
+        {
+            report("a range request got the response of another request");
+        }
+    }
+    free(body);
+    return NULL;
+}
+
+/*
+Each thread asks for the whole file at the same time as the others, the responses can be shared.
+*/
+static void* shared_worker(void* arg)
+{
+    WorkerArgs* args = (WorkerArgs*)arg;
+    char url[64];
+    char* body = (char*) malloc(FILE_SIZE + 1);
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/file", server_port);
+    for(size_t i = 0; body != NULL && i < args->nb_rounds; i++)
+    {
+        RequestsHandler* handler;
+        size_t length;
+
+        pthread_barrier_wait(&start_barrier);
+        handler = req_get(args->config, NULL, url, "");
+        length = read_body(&handler, body, FILE_SIZE + 1);
+        if(length != (size_t)-1 && (length != FILE_SIZE || memcmp(body, file_content, FILE_SIZE) != 0))
+        {
+            report("a shared response is incomplete");
+        }
+    }
+    free(body);
+    return NULL;
+}
+
+/*
+The first request of /slow leads the flight, the others give up after MAX_WAIT_TIME and are sent on their own.
+*/
+static void* slow_worker(void* arg)
+{
+    WorkerArgs* args = (WorkerArgs*)arg;
+    char url[64];
+    char body[16];
+    RequestsHandler* handler;
+    size_t length;
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/slow", server_port);
+    pthread_barrier_wait(&start_barrier);
+    handler = req_get(args->config, NULL, url, "");
+    length = read_body(&handler, body, sizeof(body));
+    if(length != (size_t)-1 && (length != 4 || memcmp(body, "slow", 4) != 0))
+    {
+        report("a response of /slow is wrong");
+    }
+    return NULL;
+}
+
+static bool run_threads(void* (*worker)(void*), RequestsConfig* config, size_t nb_rounds)
+{
+    pthread_t threads[NB_THREADS];
+    WorkerArgs args[NB_THREADS];
+    size_t nb_threads;
+
+    for(nb_threads = 0; nb_threads < NB_THREADS; nb_threads++)
+    {
+        args[nb_threads].config = config;
+        args[nb_threads].nb_rounds = nb_rounds;
+        args[nb_threads].index = nb_threads;
+        if(pthread_create(&(threads[nb_threads]), NULL, worker, &(args[nb_threads])) != 0)
+        {
+            break;
+        }
+    }
+    for(size_t i = 0; i < nb_threads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    return nb_threads == NB_THREADS;
+}
+
+/*
+Download the file with req_download_file_parallel, whose ranges are requested at the same time.
+*/
+static void check_parallel_download(RequestsConfig* config)
+{
+    char path[] = "/tmp/single_flight_stress-XXXXXX";
+    char url[64];
+    char* content = (char*) malloc(FILE_SIZE + 1);
+    FILE* file;
+    size_t length = 0;
+    int fd = mkstemp(path);
+
+    if(fd < 0 || content == NULL)
+    {
+        report("can't create the file of the parallel download");
+        free(content);
+        return;
+    }
+    close(fd);
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/file", server_port);
+    if(!req_download_file_parallel(config, url, path, 8))
+    {
+        report("req_download_file_parallel failed");
+    }
+    else if((file = fopen(path, "rb")) != NULL)
+    {
+        length = fread(content, 1, FILE_SIZE + 1, file);
+        fclose(file);
+        if(length != FILE_SIZE || memcmp(content, file_content, FILE_SIZE) != 0)
+        {
+            report("req_download_file_parallel wrote a wrong file");
+        }
+    }
+    unlink(path);
+    free(content);
+}
+
+int main(int argc, char** argv)
+{
+    size_t nb_rounds = argc > 1 ? strtoul(argv[1], NULL, 10) : 20;
+    RequestsSingleFlight* single_flight = req_single_flight_init(FILE_SIZE, 30000);
+    RequestsSingleFlight* impatient = req_single_flight_init(FILE_SIZE, MAX_WAIT_TIME);
+    RequestsConfig* config;
+    RequestsConfig* impatient_config;
+    size_t nb_shared;
+
+    for(size_t i = 0; i < FILE_SIZE; i++)
+    {
+        file_content[i] = (char)((i * 2654435761u) >> 24);
+    }
+    req_init();
+    config = req_config_default();
+    impatient_config = req_config_default();
+    server_port = loopback_server_start(serve);
+    if(nb_rounds == 0 || server_port == 0 || single_flight == NULL || impatient == NULL || config == NULL || impatient_config == NULL
+        || pthread_barrier_init(&start_barrier, NULL, NB_THREADS) != 0)
+    {
+        fprintf(stderr, "usage: %s [number of rounds]\n", argv[0]);
+        return 1;
+    }
+    req_config_set_single_flight(config, single_flight);
+    req_config_set_single_flight(impatient_config, impatient);
+
+    if(!run_threads(range_worker, config, nb_rounds))
+    {
+        fprintf(stderr, "can't start the range test\n");
+        return 1;
+    }
+    check_parallel_download(config);
+
+    __atomic_store_n(&nb_file_requests, 0, __ATOMIC_RELAXED);
+    if(!run_threads(shared_worker, config, nb_rounds))
+    {
+        fprintf(stderr, "can't start the shared test\n");
+        return 1;
+    }
+    nb_shared = NB_THREADS * nb_rounds - nb_file_requests;
+
+    if(!run_threads(slow_worker, impatient_config, 1))
+    {
+        fprintf(stderr, "can't start the timeout test\n");
+        return 1;
+    }
+    if(nb_slow_requests < 2)
+    {
+        report("the requests waiting for /slow didn't give up after the maximum wait time");
+    }
+
+    pthread_barrier_destroy(&start_barrier);
+    req_config_free(&config);
+    req_config_free(&impatient_config);
+    req_single_flight_free(&single_flight);
+    req_single_flight_free(&impatient);
+    req_destroy();
+
+    printf("%zu identical requests shared a response, %zu requests of /slow reached the server, %zu errors\n", nb_shared, nb_slow_requests, nb_errors);
+    return nb_errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,22 @@
+import powermake
+
+
+PROGRAMS = ("pool_stress", "single_flight_stress")
+
+
+def on_build(config: powermake.Config):
+    files = powermake.get_files("../requests/**/*.c", "../tools/*.c")
+
+    config.add_includedirs("../requests", "../tools")
+    config.add_shared_libs("ssl", "crypto", "pthread")
+    config.add_flags("-fsanitize=thread")
+    config.set_optimization("-O1")
+
+    objects = powermake.compile_files(config, files)
+
+    for program in PROGRAMS:
+        program_objects = powermake.compile_files(config, {program + ".c"})
+        powermake.link_files(config, set(objects) | set(program_objects), executable_name=program)
+
+
+powermake.run("stress", build_callback=on_build)
@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "loopback_server.h"
+
+static void (*serve_callback)(LoopbackConnection* connection) = NULL;
+
+
+static void* serve_connection(void* arg)
+{
+    LoopbackConnection* connection = (LoopbackConnection*)arg;
+    (*serve_callback)(connection);
+    close(connection->fd);
+    free(connection);
+    return NULL;
+}
+
+static void* run_server(void* arg)
+{
+    int listener = (int)(intptr_t)arg;
+    while(true)
+    {
+        pthread_t thread;
+        LoopbackConnection* connection;
+        int fd = accept(listener, NULL, NULL);
+        if(fd < 0)
+        {
+            continue;
+        }
+        connection = (LoopbackConnection*) malloc(sizeof(LoopbackConnection));
+        if(connection == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        connection->length = 0;
+        if(pthread_create(&thread, NULL, serve_connection, connection) != 0)
+        {
+            close(fd);
+            free(connection);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+uint16_t loopback_server_start(void (*serve)(LoopbackConnection* connection))
+{
+    pthread_t thread;
+    struct sockaddr_in address = {0};
+    socklen_t address_length = sizeof(address);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+
+    if(listener < 0)
+    {
+        return 0;
+    }
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 256) != 0
+        || getsockname(listener, (struct sockaddr*)&address, &address_length) != 0)
+    {
+        close(listener);
+        return 0;
+    }
+    serve_callback = serve;
+    if(pthread_create(&thread, NULL, run_server, (void*)(intptr_t)listener) != 0 || pthread_detach(thread) != 0)
+    {
+        close(listener);
+        return 0;
+    }
+    return ntohs(address.sin_port);
+}
+
+/*
+Read the headers of the next request of CONNECTION, copy its path in PATH, keep its method and its range, and drop its body.
+*/
+bool loopback_read_request(LoopbackConnection* connection, char* path, size_t path_size)
+{
+    char* buffer = connection->buffer;
+    char* end;
+    char* field;
+    char* path_end;
+    size_t request_length;
+    size_t path_length;
+    size_t content_length = 0;
+
+    buffer[connection->length] = '\0';
+    while((end = strstr(buffer, "\r\n\r\n")) == NULL)
+    {
+        ssize_t received = recv(connection->fd, buffer + connection->length, LOOPBACK_BUFFER_SIZE - 1 - connection->length, 0);
+        if(received <= 0)
+        {
+            // closed, or headers bigger than the buffer
+            return false;
+        }
+        connection->length += (size_t)received;
+        buffer[connection->length] = '\0';
+    }
+    request_length = (size_t)(end + 4 - buffer);
+
+    // "METHOD /path HTTP/1.1"
+    field = strchr(buffer, ' ');
+    path_end = field != NULL ? strchr(field + 1, ' ') : NULL;
+    if(path_end == NULL || path_end > end || path_size == 0)
+    {
+        return false;
+    }
+    path_length = (size_t)(path_end - field - 1);
+    if(path_length >= path_size)
+    {
+        path_length = path_size - 1;
+    }
+    memcpy(path, field + 1, path_length);
+    path[path_length] = '\0';
+    connection->head = strncmp(buffer, "HEAD ", 5) == 0;
+
+    connection->range[0] = '\0';
+    field = strstr(buffer, "\r\nRange: ");
+    if(field != NULL && field < end)
+    {
+        size_t range_length = strcspn(field + sizeof("\r\nRange: ") - 1, "\r");
+        if(range_length >= sizeof(connection->range))
+        {
+            range_length = sizeof(connection->range) - 1;
+        }
+        memcpy(connection->range, field + sizeof("\r\nRange: ") - 1, range_length);
+        connection->range[range_length] = '\0';
+    }
+
+    field = strstr(buffer, "Content-Length: ");
+    if(field != NULL && field < end)
+    {
+        content_length = strtoul(field + sizeof("Content-Length: ") - 1, NULL, 10);
+    }
+
+    // read and drop the body
+    while(connection->length - request_length < content_length)
+    {
+        ssize_t received;
+        content_length -= connection->length - request_length;
+        connection->length = 0;
+        request_length = 0;
+        received = recv(connection->fd, buffer, LOOPBACK_BUFFER_SIZE - 1, 0);
+        if(received <= 0)
+        {
+            return false;
+        }
+        connection->length = (size_t)received;
+    }
+    memmove(buffer, buffer + request_length + content_length, connection->length - request_length - content_length);
+    connection->length -= request_length + content_length;
+    return true;
+}
+
+bool loopback_send_all(int fd, const char* buffer, size_t n)
+{
+    while(n > 0)
+    {
+        ssize_t sent = send(fd, buffer, n, MSG_NOSIGNAL);
+        if(sent <= 0)
+        {
+            return false;
+        }
+        buffer += sent;
+        n -= (size_t)sent;
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef LOOPBACK_SERVER_H
+    #define LOOPBACK_SERVER_H
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include <stdint.h>
+
+    /* A small HTTP/1.1 server on 127.0.0.1 for the programs of stress/ and benchmarks/, it's not part of the library */
+
+    #define LOOPBACK_BUFFER_SIZE 16384
+
+    typedef struct _loopback_connection {
+        int fd;
+        char buffer[LOOPBACK_BUFFER_SIZE];
+        size_t length;  /* the bytes received after the current request */
+        bool head;  /* the current request is a HEAD request */
+        char range[64];  /* the value of the Range header of the current request, empty if there is none */
+    } LoopbackConnection;
+
+    #ifdef __cplusplus
+    extern "C"{
+    #endif
+
+    /**
+     * @brief Listen on a free port of 127.0.0.1 and serve each connection from its own thread, until the program exits.
+     *
+     * @param serve called once per connection, the connection is closed and freed when it returns.
+     * @return the port of the server, or 0 if it couldn't be started.
+     */
+    uint16_t loopback_server_start(void (*serve)(LoopbackConnection* connection));
+
+
+    /**
+     * @brief Read the next request of the connection. Its body is read and dropped, its method and its Range header are kept in the connection.
+     *
+     * @param connection the connection given to `serve`
+     * @param path a buffer filled with the path of the request, it's truncated if it doesn't fit.
+     * @param path_size the size of `path`
+     * @return false if the connection was closed, or if the headers don't fit in the buffer of the connection.
+     */
+    bool loopback_read_request(LoopbackConnection* connection, char* path, size_t path_size);
+
+
+    /**
+     * @brief Send the N bytes of BUFFER, like `send` but until everything is sent.
+     *
+     * @return false if the connection was closed.
+     */
+    bool loopback_send_all(int fd, const char* buffer, size_t n);
+
+    #ifdef __cplusplus
+    }
+    #endif
+#endif